@@ -42,6 +42,9 @@
 # the utility looks at the label ending in "thread-s" to identify the format
 # and decode accordingly.
 #
+# 3. NDJSON files (.ndjson or .jsonl), as streamed by p11perftest --results, with one record per line
+# {"test case": "testcase", "key label": "key", "vector name": "vector", "completed": "...", "results": { "data1": "blah", ... }}
+#
 
 import json
 import xlsxwriter
@@ -65,8 +68,19 @@ def retrieve_rows(listofjsons):
     for f in listofjsons:
         # recover JSON structure
         try:
+            # NDJSON: one record per test case and vector
+            if f.name.endswith(('.ndjson', '.jsonl')):
+                for line in f:
+                    if line.strip():
+                        record = json.loads(line)
+                        yield f.name,record['test case'],record['key label'],record['vector name'],record['results']
+                continue
+
             testcases = json.loads( f.read() );
 
+            # the preflight node holds the capabilities of the token, not results
+            testcases.pop('preflight', None)
+
             # if the file consists of a dictionnary of entries which keys are labelled '* thread-s',
             # we assume the file concatenate several testcase groups per number of threads.
             # treat it differently.
@@ -90,12 +104,8 @@ def retrieve_rows(listofjsons):
 class Converter:
     def __init__(self, toxlsx):
         self.toxlsx = toxlsx
-        self.row = 0
-        self.col = 0
-        self.titlerow = False
-        self.maxrow = self.row
-        self.maxcol = self.col
-        self.columns = list()
+        self.titles = [ 'file name', 'test case', 'key label', 'vector name' ]
+        self.rows = list()
 
     def __enter__(self):
         self.workbook = xlsxwriter.Workbook(self.toxlsx, options={'nan_inf_to_errors': True})
@@ -105,76 +115,45 @@ class Converter:
         return self
 
     def __exit__(self ,type, value, traceback):
-        self.worksheet.add_table(*self.size, {'style': 'Table Style Medium 16', 'columns' : self.columns})
+        # columns are written only now, as test cases may not all report the same measures
+        # (e.g. calibration, software baseline or lock profile). Cells are aligned on column titles.
+        columns = list()
+        for col, column_title in enumerate(self.titles):
+            column_dict = { 'header':column_title }
+            if column_title.endswith('relerr'): # special case: if relerr in the name, then we show percents
+                column_dict['format'] = self.percent_format
+            columns.append(column_dict)
+            self.worksheet.write(0, col, column_title)
+
+        for row, cells in enumerate(self.rows, start=1):
+            for col, column_title in enumerate(self.titles):
+                if column_title in cells:
+                    self.worksheet.write(row, col, cells[column_title])
+
+        self.worksheet.add_table(0, 0, len(self.rows), len(self.titles)-1, {'style': 'Table Style Medium 16', 'columns' : columns})
         self.workbook.close()
 
-    @property
-    def size(self):
-        return 0,0,self.maxrow-1,self.maxcol-1
-
     def add_a_row(self, filename, testcase, key, vectorname, vector):
 
-        def recursive_title(vector, prefix=""):
-            for subk,subv in vector.items():
-                if not isinstance(subv,(dict)):
-                    column_title = (prefix + f"{subk} ").strip()
-                    column_dict = { 'header':column_title }
-                    if column_title.endswith('relerr'): # special case: if relerr in the name, then we show percents
-                        column_dict['format'] = self.percent_format
-
-                    # remember for later, when we call __exit__()
-                    self.columns.append(column_dict)
-
-                    # write cell
-                    self.worksheet.write(self.row, self.col, column_title)
-                    self.col+=1
-                else:
-                    recursive_title(subv, prefix + f"{subk} ")
+        cells = { 'file name': filename, 'test case': testcase, 'key label': key, 'vector name': vectorname }
 
         def recursive_value(vector, prefix=""):
             for subk,subv in vector.items():
                 if not isinstance(subv,(dict)):
-                    self.worksheet.write(self.row, self.col, cast.get(subk, noop)(subv))
-                    self.col+=1
+                    column_title = (prefix + f"{subk} ").strip()
+                    if column_title not in self.titles:
+                        self.titles.append(column_title)
+                    cells[column_title] = cast.get(subk, noop)(subv)
                 else:
                     recursive_value(subv, prefix + f"{subk} ")
 
-        # the title has not been defined yet, let's fetch all the info from the file itself
-        if self.titlerow is False:
-            self.worksheet.write(self.row,0,'file name')
-            self.worksheet.write(self.row,1,'test case')
-            self.worksheet.write(self.row,2,'key label')
-            self.worksheet.write(self.row,3,'vector name')
-            self.columns.extend( [
-                { 'header' : 'file name'},
-                { 'header' : 'test case'},
-                { 'header' : 'key label'},
-                { 'header' : 'vector name'},])
-
-            self.col=4
-
-            recursive_title(vector)
-            self.maxcol = self.col
-
-            self.titlerow = True
-            self.row+=1
-
-        self.worksheet.write(self.row,0,filename)
-        self.worksheet.write(self.row,1,testcase)
-        self.worksheet.write(self.row,2,key)
-        self.worksheet.write(self.row,3,vectorname)
-        self.col=4
-        # we have defined the title already, proceed with row data
         recursive_value(vector)
-
-        self.row+=1
-        self.col=0
-        self.maxrow = self.row
+        self.rows.append(cells)
 
 if __name__ == '__main__':
 
     parser = argparse.ArgumentParser(description='Convert p11perftest JSON files to Excel spreadsheet format')
-    parser.add_argument('input', metavar='JSONFILE', help='Path to JSON input file(s)', nargs='+', type=argparse.FileType('r'))
+    parser.add_argument('input', metavar='JSONFILE', help='Path to JSON or NDJSON input file(s)', nargs='+', type=argparse.FileType('r'))
     parser.add_argument('output', metavar='XLSXFILE', help='Path to Excel XLSX spreadsheet file')
     args = parser.parse_args()
 
@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+
+#
+# Copyright (c) 2021 Mastercard
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# p11samples.py loads raw samples files written by p11perftest --samples-out,
+# and plots latency distributions.
+#
+# A samples file is made of a 64 bytes header, followed by columns, in native byte order:
+#  - start    uint64[count]: start of the call, CLOCK_MONOTONIC, in ns
+#  - duration uint64[count]: wall clock time of the call, in ns
+#  - thread   uint32[count]: thread index
+#  - rc       uint32[count]: return code of the call (CKR_xxx)
+#
+# Columns are memory-mapped, so that large files can be loaded without copy:
+#
+#   import p11samples
+#   df = p11samples.load('RSA_PKCS_SHA256_rsa-2048_testvec0032_4th.samples')
+#   df['duration'].describe()
+#
+
+import argparse
+import os
+import numpy as np
+import pandas as pd
+
+header_dtype = np.dtype([
+    ('magic', 'S8'),
+    ('version', '<u4'),
+    ('header_size', '<u4'),
+    ('count', '<u8'),
+    ('threads', '<u4'),
+    ('reserved', '<u4'),
+    ('realtime', '<u8'),
+    ('monotonic', '<u8'),
+    ('padding', 'V16'),
+])
+
+columns = [('start', np.uint64), ('duration', np.uint64), ('thread', np.uint32), ('rc', np.uint32)]
+
+
+def read_header(path):
+    header = np.fromfile(path, dtype=header_dtype, count=1)
+    if len(header) != 1 or header['magic'][0] != b'P11SMPLS' or header['version'][0] != 1:
+        raise ValueError(f"{path} is not a samples file, or has an unsupported version")
+    return header[0]
+
+
+def load(path):
+    """load a samples file into a DataFrame, with start (relative to the first call) and duration in ns"""
+    header = read_header(path)
+    count = int(header['count'])
+
+    data = {}
+    offset = int(header['header_size'])
+    for name, dtype in columns:
+        data[name] = np.memmap(path, dtype=dtype, mode='r', offset=offset, shape=(count,)) if count else np.empty(0, dtype=dtype)
+        offset += count * np.dtype(dtype).itemsize
+
+    df = pd.DataFrame(data, copy=False)
+    if count:
+        df['start'] = df['start'] - df['start'].min()
+    df.attrs['file'] = os.path.basename(path)
+    df.attrs['threads'] = int(header['threads'])
+    # absolute time of the first call, in ns since the epoch
+    df.attrs['started'] = int(header['realtime']) - int(header['monotonic']) + int(data['start'].min()) if count else None
+    return df
+
+
+def plot_distribution(df, fmt):
+    import matplotlib.pyplot as plt
+
+    latency = df.loc[df['rc'] == 0, 'duration'] / 1e6
+    fig, (hist, ecdf) = plt.subplots(1, 2, figsize=(14, 5))
+
+    hist.hist(latency, bins=200, color='tab:blue')
+    hist.set_xlabel('latency (ms)')
+    hist.set_ylabel('calls')
+
+    values = np.sort(latency.to_numpy())
+    ecdf.plot(values, np.arange(1, len(values) + 1) / len(values), color='tab:blue')
+    for q, style in ((0.5, ':'), (0.95, '--'), (0.99, '-.')):
+        ecdf.axvline(latency.quantile(q), color='tab:red', linestyle=style, label=f"p{int(q * 100)}")
+    ecdf.set_xlabel('latency (ms)')
+    ecdf.set_ylabel('cumulative fraction of calls')
+    ecdf.legend()
+
+    name = os.path.splitext(df.attrs['file'])[0]
+    fig.suptitle(f"{name} ({df.attrs['threads']} thread(s), {len(latency)} calls)")
+    for ext in (['png', 'svg'] if fmt == 'all' else [fmt]):
+        fig.savefig(f"{name}.{ext}", format=ext)
+    plt.close(fig)
+
+
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(description='Summarize p11perftest raw samples files, and plot latency distributions')
+    parser.add_argument('input', metavar='FILE', help='Path to samples file(s)', nargs='+')
+    parser.add_argument('-g', '--graphs', help='Plot histogram and cumulative distribution of latency.', action='store_true')
+    parser.add_argument('-f', '--format', help='Output format. Defaults to all (png and svg).', choices=['png', 'svg', 'all'], default='all')
+    args = parser.parse_args()
+
+    for path in args.input:
+        try:
+            df = load(path)
+        except Exception as e:
+            print(f"*** got an error while processing {path}: \"{e}\", skipping that file")
+            continue
+
+        latency = df['duration'] / 1e6
+        print(f"{path}: {len(df)} calls, {df.attrs['threads']} thread(s), {int((df['rc'] != 0).sum())} error(s)")
+        if len(df):
+            print(latency.describe(percentiles=[.5, .95, .99]).to_string())
+        if args.graphs and len(df):
+            plot_distribution(df, args.format)
@@ -0,0 +1,189 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// checkpoint.cpp: persist the run plan and progress of a campaign
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <boost/property_tree/json_parser.hpp>
+#include "checkpoint.hpp"
+
+// test case names and key labels may contain dots, they are not to be taken as path separators
+static inline ptree::path_type key(const std::string &name)
+{
+    return ptree::path_type(name, '\0');
+}
+
+
+void merge_results(ptree &results, const std::string &testcase, const ptree &tree)
+{
+    auto existing = results.get_child_optional(key(testcase));
+    if(!existing) {
+	results.add_child(key(testcase), tree);
+	return;
+    }
+
+    for(auto &label: tree) {
+	auto target = existing->find(label.first);
+	if(target==existing->not_found()) {
+	    existing->push_back(label);
+	    continue;
+	}
+	for(auto &vector: label.second) {
+	    // a vector measured again replaces the former one
+	    target->second.erase(vector.first);
+	    target->second.push_back(vector);
+	}
+    }
+}
+
+
+Checkpoint::Checkpoint(const std::string &path, const ptree &parameters, bool resume) : m_path(path)
+{
+    std::ifstream existing(path);
+
+    if(!resume) {
+	if(existing) {
+	    throw std::runtime_error(path + " already exists, use --resume to continue that campaign, or remove it");
+	}
+	m_state.add_child("parameters", parameters);
+	m_state.add_child("plan", ptree());
+	m_state.add_child("results", ptree());
+	save();
+	return;
+    }
+
+    if(!existing) {
+	throw std::runtime_error("cannot open " + path);
+    }
+
+    read_json(existing, m_state);
+
+    if(m_state.get_child("parameters", ptree())!=parameters) {
+	throw std::runtime_error(path + " was created with different parameters, it cannot be resumed");
+    }
+}
+
+
+void Checkpoint::save() const
+{
+    // write to a temporary file, then rename it, so that the checkpoint is never left half written
+    auto tmp = m_path + ".tmp";
+    {
+	std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+	write_json(out, m_state);
+	out.flush();
+	if(!out) {
+	    throw std::runtime_error("cannot write " + tmp);
+	}
+    }
+
+    if(std::rename(tmp.c_str(), m_path.c_str())!=0) {
+	throw std::runtime_error("cannot rename " + tmp + " to " + m_path);
+    }
+}
+
+
+void Checkpoint::plan(const std::forward_list<std::tuple<std::string, std::string, std::forward_list<std::string> > > &cases)
+{
+    auto &plan = m_state.get_child("plan");
+
+    for(auto &c: cases) {
+	auto &testcase = std::get<0>(c);
+	if(plan.find(testcase)==plan.not_found()) {
+	    ptree entry;
+	    entry.put("label", std::get<1>(c));
+	    entry.add_child("vectors", ptree());
+	    plan.push_back(std::make_pair(testcase, entry));
+	}
+
+	auto &vectors = plan.find(testcase)->second.get_child("vectors");
+	for(auto &vector: std::get<2>(c)) {
+	    if(vectors.find(vector)==vectors.not_found()) {
+		vectors.push_back(std::make_pair(vector, ptree("pending")));
+	    }
+	}
+    }
+
+    save();
+}
+
+
+bool Checkpoint::completed(const std::string &testcase, const std::string &vector) const
+{
+    auto &plan = m_state.get_child("plan");
+    auto entry = plan.find(testcase);
+
+    if(entry==plan.not_found()) {
+	return false;
+    }
+
+    auto &vectors = entry->second.get_child("vectors");
+    auto status = vectors.find(vector);
+    return status!=vectors.not_found() && status->second.data()=="done";
+}
+
+
+void Checkpoint::complete(const std::string &testcase, const ptree &tree)
+{
+    auto &plan = m_state.get_child("plan");
+    auto entry = plan.find(testcase);
+
+    for(auto &label: tree) {
+	for(auto &vector: label.second) {
+	    // only successful measurements are valid, others will be run again
+	    if(entry!=plan.not_found() && vector.second.get<std::string>("errorcode", "")=="CKR_OK") {
+		entry->second.get_child("vectors").put(key(vector.first), "done");
+	    }
+	}
+    }
+
+    merge_results(m_state.get_child("results"), testcase, tree);
+    save();
+}
+
+
+std::set<std::string> Checkpoint::completed_labels() const
+{
+    std::set<std::string> done, pending;
+
+    for(auto &entry: m_state.get_child("plan")) {
+	auto label = entry.second.get<std::string>("label");
+	bool all_done = true;
+	for(auto &vector: entry.second.get_child("vectors")) {
+	    if(vector.second.data()!="done") {
+		all_done = false;
+	    }
+	}
+	(all_done ? done : pending).insert(label);
+    }
+
+    // a label shared with a pending case is still needed
+    for(auto &label: pending) {
+	done.erase(label);
+    }
+
+    return done;
+}
+
+
+const ptree &Checkpoint::results() const
+{
+    return m_state.get_child("results");
+}
@@ -0,0 +1,74 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// checkpoint.hpp: persist the run plan and progress of a campaign, so that it can be resumed
+//
+// The checkpoint file is a JSON document, rewritten after each completed case:
+// {
+//   "parameters": { ... },			  options the plan was made with
+//   "plan": {
+//     "<test case>": {
+//       "label": "<key label>",
+//       "vectors": { "testvec0032": "pending" | "done", ... }
+//     }, ...
+//   },
+//   "results": { ... }				  results of completed cases, as in JSON output
+// }
+
+#if !defined(CHECKPOINT_H)
+#define CHECKPOINT_H
+
+#include <forward_list>
+#include <set>
+#include <string>
+#include <tuple>
+#include <boost/property_tree/ptree.hpp>
+
+using namespace boost::property_tree;
+
+// merge_results(): add the results of a test case to a tree of results, merging key labels and vectors
+void merge_results(ptree &results, const std::string &testcase, const ptree &tree);
+
+class Checkpoint
+{
+    std::string m_path;
+    ptree m_state;
+
+    void save() const;
+
+public:
+    // when resume is false, a new checkpoint is started, and the file must not exist.
+    // when resume is true, the file is loaded, and parameters must match those it was created with.
+    // throws std::runtime_error otherwise.
+    Checkpoint(const std::string &path, const ptree &parameters, bool resume);
+
+    // plan(): add the vectors of a test case to the plan, unless already there. The plan is saved.
+    void plan(const std::forward_list<std::tuple<std::string, std::string, std::forward_list<std::string> > > &cases);
+
+    bool completed(const std::string &testcase, const std::string &vector) const;
+
+    // complete(): record results of a test case, and mark successful vectors as done
+    void complete(const std::string &testcase, const ptree &tree);
+
+    // completed_labels(): key labels for which all planned cases are done
+    std::set<std::string> completed_labels() const;
+
+    const ptree &results() const;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,62 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// counters.hpp: per-thread counters, updated while a test case runs, and read concurrently
+// by observers (live view, metrics exporter).
+//
+// Each set of counters is written by a single thread, without any locking: counters are atomic,
+// and are updated with relaxed loads and stores.
+
+#if !defined(COUNTERS_H)
+#define COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "histogram.hpp"
+
+// aligned, so that two threads never write to the same cache line
+struct alignas(64) LiveCounters {
+    static constexpr size_t error_slots = 8; // distinct return codes tracked, beyond that only errors is counted
+
+    Histogram latency;			    // successful calls
+    std::atomic<uint64_t> errors { 0 };	    // failed calls
+    std::atomic<uint32_t> inflight { 0 };    // 1 while a call is ongoing
+    std::array<std::atomic<uint64_t>, error_slots> error_codes {}; // 0 (CKR_OK) marks a free slot
+    std::array<std::atomic<uint64_t>, error_slots> error_counts {};
+
+    // error(): account for a failed call, by return code
+    inline void error(uint64_t rc) {
+	errors.store(errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	for(size_t i=0; i<error_slots; i++) {
+	    auto code = error_codes[i].load(std::memory_order_relaxed);
+	    if(code==rc) {
+		error_counts[i].store(error_counts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return;
+	    }
+	    if(code==0) {
+		// the count is published before the code, for readers to never see a code without count
+		error_counts[i].store(1, std::memory_order_relaxed);
+		error_codes[i].store(rc, std::memory_order_release);
+		return;
+	    }
+	}
+    }
+};
+
+#endif // COUNTERS_H
@@ -16,6 +16,11 @@
 // limitations under the License.
 //
 
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <map>
 #include <botan/p11.h>
 #include "errorcodes.hpp"
 
@@ -299,6 +304,48 @@ const std::string errorcode(int rc) {
 	return "CKR_FUNCTION_REJECTED";
 
     default:
+	if(static_cast<CK_RV>(static_cast<unsigned int>(rc)) >= CKR_VENDOR_DEFINED) {
+	    // vendor defined codes, shown as they are documented, and can be parsed back
+	    char hex[16];
+	    std::snprintf(hex, sizeof hex, "0x%08x", static_cast<unsigned int>(rc));
+	    return hex;
+	}
 	return std::to_string(rc);
     }
 }
+
+// reverse lookup: accepts either a CKR_xxx mnemonic, or a numeric value (decimal or 0x-prefixed)
+// the table is built once, by scanning the range of return values defined by the standard,
+// which all lie below 0x1000 (e.g. CKR_FUNCTION_REJECTED is 0x200)
+std::optional<CK_RV> errorcode(const std::string &name) {
+    static const std::map<const std::string, CK_RV> reverse = [] () {
+	std::map<const std::string, CK_RV> table;
+	for(int rc=CKR_OK; rc<0x1000; rc++) {
+	    auto mnemonic = errorcode(rc);
+	    if(mnemonic.rfind("CKR_",0)==0) {
+		table.emplace(mnemonic, static_cast<CK_RV>(rc));
+	    }
+	}
+	table.emplace("CKR_VENDOR_DEFINED", static_cast<CK_RV>(CKR_VENDOR_DEFINED));
+	return table;
+    }();
+
+    auto match = reverse.find(name);
+    if(match!=reverse.end()) {
+	return match->second;
+    }
+
+    // numeric value: vendor defined codes start at 0x80000000, and must fit in 32 bits
+    if(name.empty() || !std::isdigit(static_cast<unsigned char>(name[0]))) {
+	return std::nullopt;
+    }
+
+    char *endptr = nullptr;
+    errno = 0;
+    auto rc = std::strtoull(name.c_str(), &endptr, 0);
+    if(*endptr!='\0' || errno==ERANGE || rc>0xffffffffULL) {
+	return std::nullopt;	// unknown mnemonic
+    }
+
+    return static_cast<CK_RV>(rc);
+}
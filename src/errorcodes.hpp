@@ -20,8 +20,14 @@
 #define ERRORCODES_H
 
 #include <string>
+#include <optional>
+#include <botan/p11.h>
 #include "../config.h"
 
 const std::string errorcode(int rc);
 
+// errorcode(): a CKR_xxx mnemonic, or a numeric value (decimal or 0x-prefixed, up to the vendor defined range).
+// returns nothing if name is unknown
+std::optional<CK_RV> errorcode(const std::string &name);
+
 #endif // ERRORCODES_H
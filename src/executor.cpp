@@ -22,6 +22,7 @@
 #include <iomanip>
 #include <ios>
 #include <algorithm>
+#include <cctype>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -29,45 +30,198 @@
 #include <functional>
 #include <utility>
 #include <sstream>
+#include <array>
 #include <tuple>
 #include <vector>
+#include <map>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <sys/resource.h>
+#include <unistd.h>
 #include <boost/timer/timer.hpp>
-#include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/min.hpp>
-#include <boost/accumulators/statistics/max.hpp>
-#include <boost/accumulators/statistics/count.hpp>
-#include <boost/accumulators/statistics/variance.hpp>
 #include "ConsoleTable.h"
 #include "errorcodes.hpp"
 #include "p11benchmark.hpp"
 #include "measure.hpp"
 #include "executor.hpp"
+#include "lockprofile.hpp"
+#include "histogram.hpp"
+#include "statistics.hpp"
+#include "samples.hpp"
+#include "liveview.hpp"
+#include "functions.hpp"
+#include "mechanisms.hpp"
 
 // thread sync objects
 std::mutex greenlight_mtx;
 std::condition_variable greenlight_cond;
 bool greenlight = false;
 
-namespace bacc = boost::accumulators;
 constexpr double nano_to_milli = 1000000.0 ;
+constexpr double nano_to_micro = 1000.0 ;
 
 
-ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const size_t skipiter, const std::forward_list<std::string> shortlist )
+// serial correlation of latency samples. Samples of a given thread are consecutive calls,
+// which are correlated when the token queues or batches requests.
+struct SerialStats {
+    double lag1;		// lag-1 autocorrelation, pooled over threads
+    double batch_se;		// standard error on the mean, estimated with batch means (in ms)
+    size_t batches;		// number of batches
+};
+
+static std::optional<SerialStats> serial_stats( const std::vector<benchmark_result_t> &results, const RunningStats &latency )
+{
+    double num = 0.0;
+    RunningStats batch_means;
+
+    for(auto &result: results) {
+	num += result.serial.lag1_numerator(latency.mean());
+	batch_means.merge(result.serial.batch_means());
+    }
+
+    // below 10 batches, the variance of batch means is too uncertain to be of any use
+    if(latency.m2()==0.0 || batch_means.count()<10) {
+	return std::nullopt;
+    }
+
+    return SerialStats { num/latency.m2(), std::sqrt(batch_means.variance()/batch_means.count()) / nano_to_milli, batch_means.count() };
+}
+
+
+// reopen_session(): called from the thread owning the session.
+// the lost session is released rather than closed, as its handle may already be reused by the token.
+Session *Executor::reopen_session(size_t th)
+{
+    auto session = m_reopen();
+
+    {
+	std::lock_guard<std::mutex> lck(m_retired_mtx);
+	m_sessions[th]->release();
+	m_retired.push_back(std::move(m_sessions[th]));
+    }
+    m_sessions[th] = std::move(session);
+
+    return m_sessions[th].get();
+}
+
+
+// run(): execute a benchmark on all threads, synchronized on green light
+std::vector<benchmark_result_t> Executor::run( P11Benchmark &benchmark, const std::vector<uint8_t> &payload, const size_t iter, const size_t skipiter, nanosecond_type &wallclock_elapsed, nanosecond_type &process_cputime, const std::vector<SampleWriter *> &samples )
+{
+    size_t th;
+    std::vector<benchmark_result_t> elapsed_time_array(m_numthreads);
+    std::vector<std::future<benchmark_result_t> > future_array(m_numthreads);
+    std::vector<std::unique_ptr<P11Benchmark> > benchmark_array(m_numthreads);
+
+    boost::timer::cpu_timer wallclock_t;
+
+    // per-thread counters, read by the live view and the metrics exporter while threads write them
+    std::vector<std::unique_ptr<LiveCounters> > live_counters;
+    std::unique_ptr<LiveView> liveview;
+    if((m_live || m_metrics) && !m_calibrating) {
+	std::vector<LiveCounters *> counters;
+	for(th=0; th<m_numthreads; th++) {
+	    live_counters.emplace_back(new LiveCounters);
+	    counters.push_back(live_counters.back().get());
+	}
+	if(m_live) {
+	    std::ostringstream title;
+	    title << benchmark.name() << " with key " << benchmark.label() << ", " << payload.size() << " bytes";
+	    liveview.reset(new LiveView(title.str(), counters, iter));
+	}
+	if(m_metrics) {
+	    m_metrics->attach(benchmark.name(), benchmark.label(), payload.size(), counters);
+	}
+    }
+
+    // session recovery, one per thread
+    std::vector<recovery_t> recoveries;
+    if(m_reopen) {
+	for(th=0; th<m_numthreads; th++) {
+	    recoveries.push_back(recovery_t { [this, th] () { return reopen_session(th); }, m_recovery_timeout });
+	}
+    }
+
+    greenlight = false;	// prepare threads to sync on "green light"
+
+    for(th=0; th<m_numthreads;th++) {
+	// make a copy of the benchmark object, for each thread
+	benchmark_array[th].reset(benchmark.clone()); // get a "clone" of the object
+	benchmark_array[th]->keyset(m_keyset);
+
+	future_array[th] = std::async( std::launch::async,
+				       &P11Benchmark::execute,
+				       benchmark_array[th].get(),
+				       m_sessions[th].get(),
+				       payload,
+				       iter,
+				       skipiter,
+				       m_generate_session_keys ? std::optional<size_t>(th) : std::nullopt,
+				       m_keep_going,
+				       recoveries.empty() ? nullptr : &recoveries[th],
+				       samples.empty() ? nullptr : samples[th],
+				       live_counters.empty() ? nullptr : live_counters[th].get());
+    }
+
+    // start the wall clock, and take a snapshot of process CPU usage
+
+    struct rusage usage_started, usage_stopped;
+    getrusage(RUSAGE_SELF, &usage_started);
+    if(LockProfiler::instance().active()) {
+	LockProfiler::instance().reset();
+    }
+    wallclock_t.start();
+    // give start signal
+    {
+	std::lock_guard<std::mutex> greenlight_lck(greenlight_mtx);
+	greenlight = true;
+	greenlight_cond.notify_all();
+    }
+
+    if(liveview) {
+	liveview->start();
+    }
+
+    // recover futures
+    for(th=0;th<m_numthreads;th++) {
+	elapsed_time_array[th] = future_array[th].get();
+    }
+
+    // stop wallclock and measure elapsed time
+    wallclock_t.stop();
+    wallclock_elapsed = wallclock_t.elapsed().wall;
+    getrusage(RUSAGE_SELF, &usage_stopped);
+
+    // the final refresh of the live view is kept out of the measurement
+    if(liveview) {
+	liveview->stop();
+    }
+
+    if(!live_counters.empty() && m_metrics) {
+	m_metrics->detach();
+    }
+
+    // process CPU time, user and system, for all threads (including those of the PKCS#11 library)
+    auto tv2ns = [] (const struct timeval &tv) -> nanosecond_type { return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL; };
+    process_cputime = tv2ns(usage_stopped.ru_utime) - tv2ns(usage_started.ru_utime)
+	+ tv2ns(usage_stopped.ru_stime) - tv2ns(usage_started.ru_stime);
+
+    return elapsed_time_array;
+}
+
+
+ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const size_t skipiter, const std::forward_list<std::string> shortlist, P11Benchmark *baseline )
 {
 
     ptree rv;
 
     for(auto testcase: shortlist) {
-	size_t th;
-	std::vector<benchmark_result_t> elapsed_time_array(m_numthreads);
-	std::vector<std::future<benchmark_result_t> > future_array(m_numthreads);
-	std::vector<P11Benchmark *> benchmark_array(m_numthreads);
+	std::vector<benchmark_result_t> elapsed_time_array;
 	int last_errcode = CKR_OK;
 
-	boost::timer::cpu_timer wallclock_t;
 	nanosecond_type wallclock_elapsed { 0 }; // used to measure how much time in total was spent in executing the test
+	nanosecond_type process_cputime { 0 };	 // CPU time spent by the process during the test
 
 	// helper functions for ConsoleTable conversion of items to string
 	auto d2s = [] (double arg, int precision=-1) -> std::string {
@@ -94,6 +248,21 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	    { "total of iterations", "total iterations", i2s(iter*m_numthreads) }
 	};
 
+	if(m_keyset.count>1) {
+	    std::string pick;
+	    switch(m_keyset.pick) {
+	    case keyset_t::Pick::RoundRobin: pick = "round robin"; break;
+	    case keyset_t::Pick::Uniform:    pick = "uniform"; break;
+	    case keyset_t::Pick::Zipf:       pick = "zipf, exponent " + d2s(m_keyset.exponent); break;
+	    }
+	    fact_rows.emplace_back( "keys/thread", "keys.count", i2s(m_keyset.count) );
+	    fact_rows.emplace_back( "key pick", "keys.pick", pick );
+	}
+
+	if(m_keyset.shared>0) {
+	    fact_rows.emplace_back( "shared keys", "keys.shared", i2s(m_keyset.shared) );
+	}
+
 	std::vector<std::tuple<std::string, std::string, Measure<>>> result_rows;
 
 	ConsoleTable facts { "property", "value" };
@@ -108,85 +277,78 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 		  << "Test case facts:\n"
 		  << facts << std::endl;
 
-	greenlight = false;	// prepare threads to sync on "green light"
-
-	for(th=0; th<m_numthreads;th++) {
-	    // make a copy of the benchmark object, for each thread
-	    benchmark_array[th] = benchmark.clone(); // get a "clone" of the object
-
-	    if(m_generate_session_keys) {
-		future_array[th] = std::async( std::launch::async,
-					       &P11Benchmark::execute,
-					       benchmark_array[th],
-					       m_sessions[th].get(),
-					       m_vectors.at(testcase),
-					       iter,
-					       skipiter,
-					       std::optional<size_t>(th));
-	    } else {
-		future_array[th] = std::async( std::launch::async,
-					       &P11Benchmark::execute,
-					       benchmark_array[th],
-					       m_sessions[th].get(),
-					       m_vectors.at(testcase),
-					       iter,
-					       skipiter,
-					       std::nullopt);
+	// raw samples export: one writer per thread, assembled into a single file after the run
+	std::vector<std::unique_ptr<SampleWriter> > sample_writers;
+	std::vector<SampleWriter *> samples;
+	std::string samples_path;
+	if(m_samples_dir) {
+	    std::string filename { benchmark.name() + '_' + benchmark.label() + '_' + testcase + '_' + i2s(m_numthreads) + "th" };
+	    std::replace_if(filename.begin(), filename.end(), [] (char c) { return !std::isalnum(c) && c!='-' && c!='_'; }, '_');
+	    samples_path = *m_samples_dir + '/' + filename + ".samples";
+
+	    for(int th=0; th<m_numthreads; th++) {
+		sample_writers.emplace_back(new SampleWriter(samples_path + '.' + i2s(th)));
+		samples.push_back(sample_writers.back().get());
 	    }
 	}
 
-	// start the wall clock
+	elapsed_time_array = run( benchmark, m_vectors.at(testcase), iter, skipiter, wallclock_elapsed, process_cputime, samples );
 
-	wallclock_t.start();
-	// give start signal
-	{
-	    std::lock_guard<std::mutex> greenlight_lck(greenlight_mtx);
-	    greenlight = true;
-	    greenlight_cond.notify_all();
+	if(!samples.empty()) {
+	    auto count = assemble_samples(samples_path, samples);
+	    sample_writers.clear();	// temporary files are removed
+	    fact_rows.emplace_back("samples file", "samples.file", samples_path);
+	    std::cout << count << " samples written to " << samples_path << '\n' << std::endl;
 	}
 
-	// recover futures
-	for(th=0;th<m_numthreads;th++) {
-	    elapsed_time_array[th] = future_array[th].get();
+	// contention profile of the library-internal locks, if instrumented
+	std::vector<LockProfiler::MutexStats> lockstats;
+	if(LockProfiler::instance().active()) {
+	    lockstats = LockProfiler::instance().snapshot();
 	}
 
-	// stop wallclock and measure elapsed time
-	wallclock_t.stop();
-	wallclock_elapsed = wallclock_t.elapsed().wall;
-
-	bacc::accumulator_set< double, bacc::stats<
-	    bacc::tag::mean,
-	    bacc::tag::min,
-	    bacc::tag::max,
-	    bacc::tag::count,
-	    bacc::tag::variance > > acc;
+	// per-thread statistics, merged together (in ns)
+	RunningStats latency, cputime, failed, recovery;
+	Histogram histogram;
+	std::map<int, uint64_t> errors; // failed calls by return code, when keeping going
+	std::vector<uint64_t> timeline;	// successful calls per bin, over all threads, when recovering
 
 	// helper map table for statistics
 	std::map<std::string, std::function<double()> > stats {
-	    { "min",   [&acc] () { return bacc::min(acc);  }},
-	    { "mean",  [&acc] () { return bacc::mean(acc); }},
-	    { "max",   [&acc] () { return bacc::max(acc);  }},
-	    { "range", [&acc] () { return (bacc::max(acc) - bacc::min(acc)); }},
-	    { "svar",   [&acc] () {
-			   auto n = bacc::count(acc);
-			   double f = static_cast<double>(n) / (n - 1);
-			   return f * bacc::variance(acc); }},
+	    { "min",   [&latency] () { return latency.min() / nano_to_milli;  }},
+	    { "mean",  [&latency] () { return latency.mean() / nano_to_milli; }},
+	    { "max",   [&latency] () { return latency.max() / nano_to_milli;  }},
+	    { "range", [&latency] () { return (latency.max() - latency.min()) / nano_to_milli; }},
+	    { "svar",  [&latency] () { return latency.variance() / (nano_to_milli * nano_to_milli); }},
 	    { "sstddev", [&stats] () { return std::sqrt(stats["svar"]()); }},
 	    // note: for error, we take k=2 so 95% of measures are within interval
 	    { "error", [&stats] () { return std::sqrt(stats["svar"]()/static_cast<double>( stats["count"]() ))*2; }},
-	    { "count", [&acc] () { return bacc::count(acc); }},
+	    { "count", [&latency] () { return static_cast<double>(latency.count()); }},
 	};
 
 	// compute statistics
-	for(auto elapsed: elapsed_time_array) {
-	    if(elapsed.second != CKR_OK) {
-		last_errcode = elapsed.second;
+	for(auto &elapsed: elapsed_time_array) {
+	    if(elapsed.errcode != CKR_OK) {
+		last_errcode = elapsed.errcode;
 		wallclock_elapsed = 0;
 		break;		// something wrong happened, no need to carry on
 	    }
 
-	    for(auto it=elapsed.first.begin(); it!=elapsed.first.end(); ++it) {
-		acc(*it/nano_to_milli);
+	    latency.merge(elapsed.latency);
+	    cputime.merge(elapsed.cputime);
+	    histogram.add(*elapsed.histogram);
+	    failed.merge(elapsed.failed);
+	    for(auto &error: elapsed.errors) {
+		errors[error.first] += error.second;
+	    }
+	    for(auto ttr: elapsed.recoveries) {
+		recovery.add(ttr);
+	    }
+	    if(elapsed.timeline.size() > timeline.size()) {
+		timeline.resize(elapsed.timeline.size());
+	    }
+	    for(size_t bin=0; bin<elapsed.timeline.size(); bin++) {
+		timeline[bin] += elapsed.timeline[bin];
 	    }
 	}
 
@@ -209,7 +371,33 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	// as the measure is blurred by the resolution of the timer.
 	// In which case, the error on latency is topped to epsilon
 	auto latency_avg_val = stats["mean"]();
-	auto latency_avg_err = stats["error"]() < epsilon ? epsilon : stats["error"]();
+	auto latency_avg_err = stats["error"]();
+
+	// consecutive latencies are autocorrelated when the token queues or batches requests,
+	// in which case the error above is too optimistic. The standard error is then estimated
+	// with batch means, and the effective sample size derived from it.
+	std::vector<std::tuple<std::string, std::string, std::string>> serial_rows;
+	if(last_errcode==CKR_OK && stats_count>1) {
+	    auto serial = serial_stats(elapsed_time_array, latency);
+	    if(serial) {
+		auto iid_se = latency_avg_err / 2;
+		auto n_eff = serial->batch_se > 0 ? std::min(stats_count, stats["svar"]() / (serial->batch_se*serial->batch_se)) : stats_count;
+		auto inflation = iid_se > 0 ? std::max(1.0, serial->batch_se / iid_se) : 1.0;
+
+		latency_avg_err *= inflation;
+
+		serial_rows = {
+		    { "lag-1 autocorrelation", "latency.autocorrelation", d2s(serial->lag1, 4) },
+		    { "effective sample size", "samples.effective", d2s(std::floor(n_eff)) },
+		    { "number of batches", "samples.batches", i2s(serial->batches) },
+		    { "error inflation factor", "samples.inflation", d2s(inflation, 4) }
+		};
+	    }
+	}
+
+	if(latency_avg_err < epsilon) {
+	    latency_avg_err = epsilon;
+	}
 	Measure<> latency_avg(latency_avg_val, latency_avg_err, "ms");
 	result_rows.emplace_back(std::forward_as_tuple("latency, average", "latency.average", std::move(latency_avg)));
 	// minimum and maximum are measured directly. their error depends directly upon
@@ -223,6 +411,56 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	auto latency_max_err =  epsilon;
 	Measure<> latency_max(latency_max_val, latency_max_err, "ms");
 	result_rows.emplace_back(std::forward_as_tuple("latency, maximum", "latency.maximum", std::move(latency_max)));
+	// percentiles are taken from the histogram, and are known within half of a bucket width
+	const std::array<std::tuple<std::string, std::string, double>, 3> quantiles {
+	    { { "50th percentile", "p50", 0.50 },
+	      { "95th percentile", "p95", 0.95 },
+	      { "99th percentile", "p99", 0.99 } } };
+	std::vector<std::pair<double, double> > percentiles;
+
+	if(last_errcode==CKR_OK && histogram.count()>0) {
+	    for(auto &q: quantiles) {
+		auto percentile_val = histogram.quantile(std::get<2>(q)) / nano_to_milli;
+		auto percentile_err = histogram.quantile_error(std::get<2>(q)) / nano_to_milli;
+		if(percentile_err < epsilon) {
+		    percentile_err = epsilon;
+		}
+		percentiles.emplace_back(percentile_val, percentile_err);
+		Measure<> percentile(percentile_val, percentile_err, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("latency, " + std::get<0>(q), "latency." + std::get<1>(q), std::move(percentile)));
+	    }
+	}
+
+	// when a calibration was run, report the dispatch overhead measured with the null operation,
+	// and optionally the latency net of it. Errors are independent, they add up quadratically.
+	if(m_calibrating) {
+	    if(last_errcode==CKR_OK && stats_count>1) {
+		m_dispatch = Dispatch { latency_avg_val, latency_avg_err, stats["sstddev"](), static_cast<size_t>(stats_count), percentiles };
+	    }
+	} else if(m_dispatch) {
+	    Measure<> dispatch_avg(m_dispatch->average, m_dispatch->error, "ms");
+	    result_rows.emplace_back(std::forward_as_tuple("dispatch latency, average", "dispatch.average", std::move(dispatch_avg)));
+	    // standard error on the sample standard deviation is approximately s/sqrt(2(n-1))
+	    auto dispatch_sstddev_err = m_dispatch->sstddev / std::sqrt(2.0 * (m_dispatch->count - 1));
+	    Measure<> dispatch_sstddev(m_dispatch->sstddev, dispatch_sstddev_err < epsilon ? epsilon : dispatch_sstddev_err, "ms");
+	    result_rows.emplace_back(std::forward_as_tuple("dispatch latency, std. deviation", "dispatch.stddev", std::move(dispatch_sstddev)));
+	    // the distribution of the dispatch overhead, from the histogram of the calibration
+	    for(size_t i=0; i<m_dispatch->percentiles.size(); i++) {
+		Measure<> dispatch_percentile(m_dispatch->percentiles[i].first, m_dispatch->percentiles[i].second, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("dispatch latency, " + std::get<0>(quantiles[i]), "dispatch." + std::get<1>(quantiles[i]), std::move(dispatch_percentile)));
+	    }
+
+	    if(m_net_of_dispatch) {
+		auto latency_net_val = latency_avg_val - m_dispatch->average;
+		auto latency_net_err = std::sqrt(latency_avg_err*latency_avg_err + m_dispatch->error*m_dispatch->error);
+		if(latency_net_val > latency_net_err) {
+		    Measure<> latency_net(latency_net_val, latency_net_err, "ms");
+		    result_rows.emplace_back(std::forward_as_tuple("latency net of dispatch, average", "latency.net", std::move(latency_net)));
+		} else {
+		    std::cerr << "*** Warning: latency net of dispatch is not significant, not reported\n";
+		}
+	    }
+	}
 	// TPS is the number of "transactions" per second.
 	// the meaning of "transaction" depends upon the tested API/algorithm
 
@@ -252,6 +490,192 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	Measure<> wallclock_elapsed_ms( wallclock_elapsed/nano_to_milli, epsilon, "ms" );
 	result_rows.emplace_back(std::forward_as_tuple("wall clock", "wallclock", std::move(wallclock_elapsed_ms)));
 
+	// when keeping going, failed calls are accounted for apart from successful ones.
+	// - attempted TPS is derived from the average latency of all calls, successful or not,
+	//   in the same way as global TPS is derived from the latency of successful calls.
+	// - goodput is the share of attempted TPS that succeeded. The error on that share is binomial,
+	//   it adds up quadratically to the relative error on attempted TPS.
+	std::vector<std::tuple<std::string, std::string, std::string>> error_rows;
+	if(m_keep_going && last_errcode==CKR_OK) {
+	    RunningStats attempts;
+	    attempts.merge(latency);
+	    attempts.merge(failed);
+
+	    auto n = static_cast<double>(attempts.count());
+	    if(n>1) {
+		auto attempt_avg_val = attempts.mean() / nano_to_milli;
+		auto attempt_avg_err = std::sqrt(attempts.variance() / n) / nano_to_milli * 2;
+		if(attempt_avg_err < epsilon) {
+		    attempt_avg_err = epsilon;
+		}
+
+		auto tps_attempted_val = 1000 / attempt_avg_val * m_numthreads;
+		auto tps_attempted_relerr = attempt_avg_err / attempt_avg_val;
+		Measure<> tps_attempted(tps_attempted_val, tps_attempted_val * tps_attempted_relerr, "Tnx/s");
+		result_rows.emplace_back(std::forward_as_tuple("attempted global TPS, average", "tps.attempted", std::move(tps_attempted)));
+
+		auto success = latency.count() / n;
+		if(success>0) {
+		    auto success_relerr = std::sqrt(success * (1-success) / n) * 2 / success;
+		    auto goodput_val = tps_attempted_val * success;
+		    auto goodput_err = goodput_val * std::sqrt(tps_attempted_relerr*tps_attempted_relerr + success_relerr*success_relerr);
+		    Measure<> goodput(goodput_val, goodput_err, "Tnx/s");
+		    result_rows.emplace_back(std::forward_as_tuple("goodput, global TPS", "tps.goodput", std::move(goodput)));
+		}
+	    }
+
+	    if(failed.count()>0) {
+		auto failed_avg_val = failed.mean() / nano_to_milli;
+		auto failed_avg_err = failed.count()>1 ? std::sqrt(failed.variance() / failed.count()) / nano_to_milli * 2 : 0.0;
+		Measure<> failed_avg(failed_avg_val, failed_avg_err < epsilon ? epsilon : failed_avg_err, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("latency of failed calls, average", "latency.failed", std::move(failed_avg)));
+	    }
+
+	    error_rows.emplace_back("failed calls", "errors.total", i2s(failed.count()));
+	    error_rows.emplace_back("error rate", "errors.rate", d2s(n>0 ? failed.count() / n : 0.0, 4));
+	    for(auto &error: errors) {
+		error_rows.emplace_back(errorcode(error.first), "errors." + errorcode(error.first), i2s(error.second));
+	    }
+	}
+
+	// shared keys: throughput per key, from the threads using it (thread th uses key th % shared).
+	// as for global TPS, it is derived from the average latency of these threads.
+	std::vector<std::tuple<std::string, int, double, double> > key_rows; // label, threads, latency (ms), TPS
+	if(m_keyset.shared>0 && last_errcode==CKR_OK) {
+	    for(size_t k=0; k<m_keyset.shared && k<static_cast<size_t>(m_numthreads); k++) {
+		RunningStats keylatency;
+		int threads = 0;
+		for(size_t th=k; th<elapsed_time_array.size(); th+=m_keyset.shared) {
+		    keylatency.merge(elapsed_time_array[th].latency);
+		    threads++;
+		}
+
+		std::ostringstream keylabel;
+		keylabel << benchmark.label() << "-sh-" << std::setw(5) << std::setfill('0') << k;
+		auto avg = keylatency.mean() / nano_to_milli;
+		key_rows.emplace_back(keylabel.str(), threads, avg, avg>0 ? 1000 / avg * threads : 0.0);
+	    }
+	}
+
+	// session recovery: time to recover, and throughput dip.
+	// successful calls are counted per bin of 100ms; steady throughput is the median bin,
+	// and the dip is the relative drop of the lowest bin. the last bin is partial, it is not considered.
+	std::vector<std::tuple<std::string, std::string, std::string>> recovery_rows;
+	if(m_reopen && last_errcode==CKR_OK) {
+	    recovery_rows.emplace_back("session recoveries", "recovery.count", i2s(recovery.count()));
+
+	    if(recovery.count()>0) {
+		auto ttr_avg_val = recovery.mean() / nano_to_milli;
+		auto ttr_avg_err = recovery.count()>1 ? std::sqrt(recovery.variance() / recovery.count()) / nano_to_milli * 2 : 0.0;
+		Measure<> ttr_avg(ttr_avg_val, ttr_avg_err < epsilon ? epsilon : ttr_avg_err, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("time to recover, average", "recovery.average", std::move(ttr_avg)));
+		Measure<> ttr_max(recovery.max() / nano_to_milli, epsilon, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("time to recover, maximum", "recovery.maximum", std::move(ttr_max)));
+	    }
+
+	    if(timeline.size() > 3) {
+		std::vector<uint64_t> bins(timeline.begin(), timeline.end()-1);
+		auto lowest = *std::min_element(bins.begin(), bins.end());
+		std::nth_element(bins.begin(), bins.begin() + bins.size()/2, bins.end());
+		auto steady = bins[bins.size()/2];
+
+		if(steady>0) {
+		    auto bin_ms = benchmark_result_t::timeline_bin / nano_to_milli;
+		    auto below_half = std::count_if(timeline.begin(), timeline.end()-1, [steady] (uint64_t n) { return 2*n < steady; });
+		    recovery_rows.emplace_back("steady global TPS", "recovery.tps.steady", d2s(steady * 1000.0 / bin_ms, 6));
+		    recovery_rows.emplace_back("lowest global TPS", "recovery.tps.lowest", d2s(lowest * 1000.0 / bin_ms, 6));
+		    recovery_rows.emplace_back("throughput dip", "recovery.dip", d2s(1.0 - static_cast<double>(lowest) / steady, 4));
+		    recovery_rows.emplace_back("time below half throughput (ms)", "recovery.degraded", d2s(below_half * bin_ms));
+		}
+	    }
+	}
+
+	// client CPU cost per operation.
+	// - thread CPU time is measured around each call, in the calling thread.
+	// - process CPU time (user+system) covers all threads, including those the library may spawn
+	//   (e.g. for TLS to a network HSM), as well as skipped iterations. It is sampled by the kernel,
+	//   so its resolution is a clock tick.
+	if(last_errcode==CKR_OK && cputime.count()>1) {
+	    auto n = cputime.count();
+	    auto cpu_thread_val = cputime.mean() / nano_to_micro;
+	    auto cpu_thread_err = std::sqrt(cputime.variance() / n) / nano_to_micro * 2;
+	    if(cpu_thread_err < epsilon * 1000) {
+		cpu_thread_err = epsilon * 1000;
+	    }
+	    if(cpu_thread_val > 0) {
+		Measure<> cpu_thread(cpu_thread_val, cpu_thread_err, "us");
+		result_rows.emplace_back(std::forward_as_tuple("client CPU/op, thread", "cpu.thread", std::move(cpu_thread)));
+	    }
+
+	    auto total_ops = static_cast<double>(m_numthreads * (iter + skipiter));
+	    auto cpu_process_val = process_cputime / nano_to_micro / total_ops;
+	    auto cpu_process_err = 2 * 1000000.0 / sysconf(_SC_CLK_TCK) / total_ops;
+	    if(cpu_process_val > cpu_process_err) {
+		Measure<> cpu_process(cpu_process_val, cpu_process_err, "us");
+		result_rows.emplace_back(std::forward_as_tuple("client CPU/op, process", "cpu.process", std::move(cpu_process)));
+
+		// client utilization: how many client CPU cores are kept busy, at the measured global TPS
+		auto utilization_val = cpu_process_val * tps_global_avg_val / 1000000.0;
+		auto utilization_err = utilization_val * std::sqrt( std::pow(cpu_process_err/cpu_process_val, 2) + std::pow(tps_global_avg_err/tps_global_avg_val, 2) );
+		Measure<> utilization(utilization_val, utilization_err, "core");
+		result_rows.emplace_back(std::forward_as_tuple("client CPU utilization", "cpu.utilization", std::move(utilization)));
+	    }
+	}
+
+	// software baseline: the equivalent operation, executed on the host CPU,
+	// with the same number of threads and the same vector, when the token could process it
+	if(baseline && last_errcode==CKR_OK && baseline->accepts(m_vectors.at(testcase).size())) {
+	    nanosecond_type baseline_wallclock { 0 }, baseline_cputime { 0 };
+	    auto baseline_array = run( *baseline, m_vectors.at(testcase), iter, skipiter, baseline_wallclock, baseline_cputime );
+
+	    RunningStats baseline_latency;
+	    int baseline_errcode = CKR_OK;
+
+	    for(auto &elapsed: baseline_array) {
+		if(elapsed.errcode != CKR_OK) {
+		    baseline_errcode = elapsed.errcode;
+		    break;
+		}
+
+		baseline_latency.merge(elapsed.latency);
+	    }
+
+	    auto n = baseline_latency.count();
+
+	    if(baseline_errcode==CKR_OK && last_errcode==CKR_OK && n>1) {
+		auto sw_latency_val = baseline_latency.mean() / nano_to_milli;
+		auto sw_latency_err = std::sqrt(baseline_latency.variance() / n) / nano_to_milli * 2;
+		if(sw_latency_err < epsilon) {
+		    sw_latency_err = epsilon;
+		}
+		Measure<> sw_latency(sw_latency_val, sw_latency_err, "ms");
+		result_rows.emplace_back(std::forward_as_tuple("software latency, average", "swbaseline.latency", std::move(sw_latency)));
+
+		// as long as threads do not exceed CPU cores, TPS per thread is also TPS per core
+		auto sw_tps_thread_val = 1000 / sw_latency_val;
+		auto sw_tps_thread_err = 1000 * sw_latency_err / (sw_latency_val*sw_latency_val);
+		auto sw_tps_global_val = sw_tps_thread_val * m_numthreads;
+		auto sw_tps_global_err = sw_tps_thread_err * m_numthreads;
+		Measure<> sw_tps_global(sw_tps_global_val, sw_tps_global_err, "Tnx/s");
+		result_rows.emplace_back(std::forward_as_tuple("software global TPS, average", "swbaseline.tps.global", std::move(sw_tps_global)));
+
+		// relative errors add up quadratically for a ratio
+		auto ratio_relerr = std::sqrt( std::pow(tps_global_avg_err/tps_global_avg_val, 2) + std::pow(sw_tps_thread_err/sw_tps_thread_val, 2) );
+
+		// speedup: how many times the token is faster than the host, at the same number of threads
+		auto speedup_val = tps_global_avg_val / sw_tps_global_val;
+		Measure<> speedup(speedup_val, speedup_val * ratio_relerr, "x");
+		result_rows.emplace_back(std::forward_as_tuple("HSM vs CPU speedup", "swbaseline.speedup", std::move(speedup)));
+
+		// how many host CPU cores would be needed to match the global TPS of the token
+		auto cores_val = tps_global_avg_val / sw_tps_thread_val;
+		Measure<> cores(cores_val, cores_val * ratio_relerr, "core");
+		result_rows.emplace_back(std::forward_as_tuple("CPU cores needed to match", "swbaseline.cores", std::move(cores)));
+	    } else if(baseline_errcode!=CKR_OK) {
+		std::cerr << "*** Warning: software baseline failed (" << errorcode(baseline_errcode) << "), not reported\n";
+	    }
+	}
+
 	ConsoleTable results{"measure", "value", "error (+/-)", "unit", "rel. error" };
 	results.setStyle(1);
 
@@ -266,6 +690,76 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 
 	std::cout << "Test case results:\n" << results << std::endl;
 
+	if(!serial_rows.empty()) {
+	    ConsoleTable serial{ "sample statistics", "value" };
+	    serial.setStyle(1);
+	    for(auto &row: serial_rows) {
+		serial += { std::get<0>(row), std::get<2>(row) };
+	    }
+	    std::cout << serial << std::endl;
+	}
+
+	if(!recovery_rows.empty()) {
+	    ConsoleTable recoverytable{ "recovery", "value" };
+	    recoverytable.setStyle(1);
+	    for(auto &row: recovery_rows) {
+		recoverytable += { std::get<0>(row), std::get<2>(row) };
+	    }
+	    std::cout << recoverytable << std::endl;
+	}
+
+	if(!key_rows.empty()) {
+	    ConsoleTable keytable{ "shared key", "threads", "latency, average (ms)", "TPS" };
+	    keytable.setStyle(1);
+	    for(auto &row: key_rows) {
+		keytable += { std::get<0>(row), i2s(std::get<1>(row)), d2s(std::get<2>(row), 6), d2s(std::get<3>(row), 6) };
+	    }
+	    std::cout << keytable << std::endl;
+	}
+
+	if(!error_rows.empty()) {
+	    ConsoleTable errortable{ "errors", "count" };
+	    errortable.setStyle(1);
+	    for(auto &row: error_rows) {
+		errortable += { std::get<0>(row), std::get<2>(row) };
+	    }
+	    std::cout << errortable << std::endl;
+	}
+
+	// lock profile: aggregate, then the most waited for mutexes
+	constexpr size_t lockprofile_top = 5;
+	std::vector<std::pair<std::string, LockProfiler::MutexStats> > lockprofile_rows;
+
+	if(LockProfiler::instance().active()) {
+	    lockprofile_rows.emplace_back("total", LockProfiler::total(lockstats));
+	    for(size_t i=0; i<lockstats.size() && i<lockprofile_top && lockstats[i].acquisitions>0; i++) {
+		std::ostringstream mutex_name;
+		if(lockstats[i].id==0) {
+		    mutex_name << "destroyed";
+		} else {
+		    mutex_name << "mutex" << std::setw(4) << std::setfill('0') << lockstats[i].id;
+		}
+		lockprofile_rows.emplace_back(mutex_name.str(), lockstats[i]);
+	    }
+
+	    ConsoleTable lockprofile{"mutex", "acquisitions/op", "contended", "wait/op (us)", "hold/op (us)", "max wait (us)" };
+	    lockprofile.setStyle(1);
+
+	    auto total_ops = static_cast<double>(m_numthreads * (iter + skipiter));
+	    for(auto &row: lockprofile_rows) {
+		auto &stats = row.second;
+		lockprofile += {
+		    row.first,
+		    d2s(stats.acquisitions / total_ops, 4),
+		    d2s(stats.acquisitions ? 100.0 * stats.contended / stats.acquisitions : 0.0, 3)+'%',
+		    d2s(stats.wait / nano_to_micro / total_ops, 4),
+		    d2s(stats.hold / nano_to_micro / total_ops, 4),
+		    d2s(stats.max_wait / nano_to_micro, 4) };
+	    }
+
+	    std::cout << "Lock profile:\n" << lockprofile << std::endl;
+	}
+
 	// now create json output
 	std::string thistestcase { benchmark.label() + '.' + testcase + '.' };
 
@@ -274,6 +768,29 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	    rv.add(thistestcase + std::get<1>(row), std::get<2>(row) );
 	}
 
+	// adding sample statistics
+	for(auto &row: serial_rows) {
+	    rv.add(thistestcase + std::get<1>(row), std::get<2>(row) );
+	}
+
+	// adding error accounting
+	for(auto &row: error_rows) {
+	    rv.add(thistestcase + std::get<1>(row), std::get<2>(row) );
+	}
+
+	// adding session recovery
+	for(auto &row: recovery_rows) {
+	    rv.add(thistestcase + std::get<1>(row), std::get<2>(row) );
+	}
+
+	// adding per-key throughput, for shared keys
+	for(auto &row: key_rows) {
+	    std::string prefix { thistestcase + "keys." + std::get<0>(row) + '.' };
+	    rv.add<int>(prefix + "threads", std::get<1>(row));
+	    rv.add<double>(prefix + "latency", std::get<2>(row));
+	    rv.add<double>(prefix + "tps", std::get<3>(row));
+	}
+
 	// adding results information
 	for(auto &row: result_rows) {
 	    rv.add<double>(thistestcase + std::get<1>(row) + ".value",  std::get<2>(row).value());
@@ -282,9 +799,373 @@ ptree Executor::benchmark( P11Benchmark &benchmark, const size_t iter, const siz
 	    rv.add(thistestcase + std::get<1>(row) + ".relerr", d2s(std::get<2>(row).relerr()));
 	}
 
+	// adding lock profile information
+	for(auto &row: lockprofile_rows) {
+	    auto &stats = row.second;
+	    std::string prefix { thistestcase + "lockprofile." + row.first + '.' };
+	    rv.add<uint64_t>(prefix + "acquisitions", stats.acquisitions);
+	    rv.add<uint64_t>(prefix + "contended", stats.contended);
+	    rv.add<double>(prefix + "wait_us", stats.wait / nano_to_micro);
+	    rv.add<double>(prefix + "hold_us", stats.hold / nano_to_micro);
+	    rv.add<double>(prefix + "maxwait_us", stats.max_wait / nano_to_micro);
+	}
+
 	// last error code, useful to identify when something crashes
 	rv.add(thistestcase + "errorcode", errorcode(last_errcode));
     }
 
     return rv;
 }
+
+
+ptree Executor::calibrate( P11Benchmark &nullbenchmark, const size_t iter, const size_t skipiter, const std::string testcase, bool net_of_dispatch )
+{
+    m_calibrating = true;
+    auto rv = benchmark( nullbenchmark, iter, skipiter, { testcase } );
+    m_calibrating = false;
+    m_net_of_dispatch = net_of_dispatch;
+
+    if(m_dispatch) {
+	std::cout << "dispatch overhead (ms): " << m_dispatch->average << " +/- " << m_dispatch->error << "\n\n";
+    }
+
+    return rv;
+}
+
+
+ptree Executor::replay( const std::forward_list<P11Benchmark *> &benchmarks, const TraceReader &trace, double speed )
+{
+    ptree rv;
+    std::vector<P11Benchmark *> candidates(benchmarks.begin(), benchmarks.end());
+
+    // a target is a test case and a payload size, that traced calls are mapped to
+    struct Target {
+	size_t benchmark;
+	size_t payload;
+    };
+
+    // a call to be made by a thread, at a given time
+    struct Planned {
+	uint64_t timestamp;
+	size_t target;
+    };
+
+    std::vector<Target> targets;
+    std::map<std::pair<size_t, size_t>, size_t> target_index;
+    std::vector<std::vector<Planned> > plans(m_numthreads);
+
+    // mapping is cached, as traces hold many identical calls
+    std::map<std::tuple<uint8_t, uint32_t, uint16_t, uint32_t>, std::optional<size_t> > mapping;
+    std::map<std::string, uint64_t> unmatched;
+    uint64_t failed_in_trace = 0, not_replayed = 0;
+    uint64_t first_ts = std::numeric_limits<uint64_t>::max(), last_ts = 0;
+
+    for(auto &record: trace) {
+	if(record.function >= function_descriptors.size()) {
+	    continue;		// corrupted record
+	}
+
+	auto &desc = function_descriptors[record.function];
+	auto key = std::make_tuple(record.function, record.mechanism, record.keybits, record.payload);
+	auto mapped = mapping.find(key);
+
+	if(mapped==mapping.end()) {
+	    std::optional<size_t> target;
+	    std::optional<size_t> best, best_payload;
+
+	    // among test cases that can replay the call, prefer the one with the same key size
+	    for(size_t i=0; i<candidates.size(); i++) {
+		auto payload = candidates[i]->replays(desc.name, record.mechanism, record.payload);
+		if(payload && (!best || (candidates[i]->keybits().value_or(0)==record.keybits
+					 && candidates[*best]->keybits().value_or(0)!=record.keybits))) {
+		    best = i;
+		    best_payload = payload;
+		}
+	    }
+
+	    if(best) {
+		auto index = std::make_pair(*best, *best_payload);
+		auto it = target_index.find(index);
+		if(it==target_index.end()) {
+		    it = target_index.emplace(index, targets.size()).first;
+		    targets.push_back(Target { *best, *best_payload });
+		}
+		target = it->second;
+	    }
+	    mapped = mapping.emplace(key, target).first;
+	}
+
+	if(!mapped->second) {
+	    // C_xxxInit() calls are replayed as part of the operation, other calls are just not replayed
+	    if(record.mechanism!=trace_no_mechanism && !desc.init) {
+		unmatched[std::string(desc.name) + " using " + mechanism(record.mechanism)]++;
+	    } else {
+		not_replayed++;
+	    }
+	    continue;
+	}
+
+	if(record.flags & trace_flag_error) {
+	    failed_in_trace++;	// calls that failed in production are not replayed
+	    continue;
+	}
+
+	plans[record.thread % m_numthreads].push_back(Planned { record.timestamp, *mapped->second });
+	first_ts = std::min(first_ts, record.timestamp);
+	last_ts = std::max(last_ts, record.timestamp);
+    }
+
+    for(auto &item: unmatched) {
+	std::cerr << "*** Warning: " << item.second << " call(s) to " << item.first << " cannot be replayed with the current coverage\n";
+    }
+
+    // records are claimed concurrently in the trace, they may be slightly out of order
+    for(auto &plan: plans) {
+	std::stable_sort(plan.begin(), plan.end(), [] (const Planned &a, const Planned &b) { return a.timestamp < b.timestamp; });
+    }
+
+    // per thread and per target outcome
+    struct Outcome {
+	std::unique_ptr<Histogram> service { new Histogram };	// latency of the call
+	std::unique_ptr<Histogram> response { new Histogram };	// completion time, from scheduled arrival
+	uint64_t errors { 0 };
+	int lasterror { CKR_OK };
+    };
+
+    std::mutex ready_mtx;
+    std::condition_variable ready_cond;
+    size_t ready = 0;
+    std::chrono::steady_clock::time_point started;
+
+    auto worker = [&] (size_t th) -> std::pair<std::vector<Outcome>, uint64_t> {
+	std::vector<Outcome> outcomes(targets.size());
+	std::vector<std::unique_ptr<P11Benchmark> > clones(targets.size());
+	std::vector<bool> usable(targets.size(), false);
+	uint64_t maxlag = 0;
+	auto &session = *m_sessions[th];
+
+	// prepare a test case for each target this thread will replay
+	for(auto &planned: plans[th]) {
+	    auto t = planned.target;
+	    if(!clones[t]) {
+		clones[t].reset(candidates[targets[t].benchmark]->clone());
+		// whatever happens, this thread must report ready below, or the main thread would wait forever
+		try {
+		    usable[t] = clones[t]->setup(&session, std::vector<uint8_t>(targets[t].payload, 0),
+						 m_generate_session_keys ? std::optional<size_t>(th) : std::nullopt);
+		} catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+		    outcomes[t].lasterror = bexc.error_code();
+		} catch (std::exception &e) {
+		    std::cerr << "*** Warning: " << clones[t]->name() << " using " << clones[t]->label()
+			      << " cannot be prepared for replay: " << e.what() << '\n';
+		    outcomes[t].lasterror = CKR_GENERAL_ERROR;
+		} catch (...) {
+		    outcomes[t].lasterror = CKR_GENERAL_ERROR;
+		}
+	    }
+	}
+
+	{
+	    std::lock_guard<std::mutex> lck(ready_mtx);
+	    ready++;
+	    ready_cond.notify_all();
+	}
+
+	// wait for green light - all threads are starting together
+	{
+	    std::unique_lock<std::mutex> greenlight_lck(greenlight_mtx);
+	    greenlight_cond.wait(greenlight_lck,[]{ return greenlight; });
+	}
+
+	for(auto &planned: plans[th]) {
+	    auto t = planned.target;
+	    auto &outcome = outcomes[t];
+
+	    if(!usable[t]) {
+		outcome.errors++;
+		continue;
+	    }
+
+	    auto scheduled = started;
+	    if(speed>0) {
+		scheduled += std::chrono::nanoseconds(static_cast<uint64_t>((planned.timestamp - first_ts) / speed));
+		std::this_thread::sleep_until(scheduled);
+	    }
+
+	    auto begin = std::chrono::steady_clock::now();
+	    try {
+		auto service = clones[t]->timed_call(session);
+		outcome.service->record(service);
+		if(speed>0) {
+		    auto end = std::chrono::steady_clock::now();
+		    outcome.response->record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - scheduled).count());
+		    maxlag = std::max<uint64_t>(maxlag, std::chrono::duration_cast<std::chrono::nanoseconds>(begin - scheduled).count());
+		}
+	    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+		outcome.errors++;
+		outcome.lasterror = bexc.error_code();
+	    }
+	}
+
+	return std::make_pair(std::move(outcomes), maxlag);
+    };
+
+    std::vector<std::future<std::pair<std::vector<Outcome>, uint64_t> > > future_array(m_numthreads);
+    boost::timer::cpu_timer wallclock_t;
+
+    greenlight = false;
+    for(size_t th=0; th<m_numthreads; th++) {
+	future_array[th] = std::async( std::launch::async, worker, th );
+    }
+
+    // wait for all threads to be ready, so that the schedule is not delayed by preparation
+    {
+	std::unique_lock<std::mutex> lck(ready_mtx);
+	ready_cond.wait(lck, [&] { return ready==static_cast<size_t>(m_numthreads); });
+    }
+
+    {
+	std::lock_guard<std::mutex> greenlight_lck(greenlight_mtx);
+	started = std::chrono::steady_clock::now();
+	wallclock_t.start();
+	greenlight = true;
+	greenlight_cond.notify_all();
+    }
+
+    // aggregate outcomes from all threads
+    std::vector<Outcome> outcomes(targets.size());
+    uint64_t maxlag = 0;
+
+    for(auto &future: future_array) {
+	auto result = future.get();
+	for(size_t t=0; t<targets.size(); t++) {
+	    outcomes[t].service->add(*result.first[t].service);
+	    outcomes[t].response->add(*result.first[t].response);
+	    outcomes[t].errors += result.first[t].errors;
+	    if(result.first[t].lasterror!=CKR_OK) outcomes[t].lasterror = result.first[t].lasterror;
+	}
+	maxlag = std::max(maxlag, result.second);
+    }
+
+    wallclock_t.stop();
+    auto wallclock_elapsed = wallclock_t.elapsed().wall;
+
+    auto d2s = [] (double arg, int precision=-1) -> std::string {
+		   std::ostringstream stream;
+		   if(precision>=0) stream << std::setprecision(precision);
+		   stream << arg;
+		   return stream.str();
+	       };
+
+    auto epsilon = 2 * (m_timer_res + m_timer_res_err ) / nano_to_milli;
+    auto trace_duration = last_ts > first_ts ? (last_ts - first_ts) / nano_to_milli : 0.0;
+
+    ConsoleTable facts { "property", "value" };
+    facts.setStyle(1);
+    facts += { "records in trace", d2s(trace.size()) };
+    facts += { "calls replayed", d2s(std::accumulate(plans.begin(), plans.end(), size_t(0), [] (size_t n, auto &p) { return n + p.size(); })) };
+    facts += { "calls failed in trace (not replayed)", d2s(failed_in_trace) };
+    facts += { "calls without equivalent (not replayed)", d2s(std::accumulate(unmatched.begin(), unmatched.end(), uint64_t(0), [] (uint64_t n, auto &u) { return n + u.second; })) };
+    facts += { "other calls (not replayed)", d2s(not_replayed) };
+    facts += { "speed", speed>0 ? d2s(speed) + "x" : "as fast as possible" };
+    facts += { "number of threads", d2s(m_numthreads) };
+    facts += { "trace duration (ms)", d2s(trace_duration) };
+    facts += { "replay duration (ms)", d2s(wallclock_elapsed / nano_to_milli) };
+    if(speed>0) {
+	facts += { "maximum lag on schedule (ms)", d2s(maxlag / nano_to_milli) };
+    }
+
+    std::cout << "Trace replay\n"
+	      << "================================================================================\n"
+	      << facts << std::endl;
+
+    ConsoleTable results { "test case", "key label", "vector size", "calls", "errors", "latency avg (ms)", "latency p99 (ms)", "response p99 (ms)" };
+    results.setStyle(1);
+
+    for(size_t t=0; t<targets.size(); t++) {
+	auto &benchmark = *candidates[targets[t].benchmark];
+	auto &outcome = outcomes[t];
+	auto n = outcome.service->count();
+
+	std::stringstream vectorname;
+	vectorname << "testvec" << std::setfill('0') << std::setw(4) << targets[t].payload;
+	std::string thistestcase { benchmark.label() + '.' + vectorname.str() + '.' };
+	ptree tc;
+
+	results += {
+	    benchmark.name(),
+	    benchmark.label(),
+	    d2s(targets[t].payload),
+	    d2s(n),
+	    d2s(outcome.errors),
+	    d2s(outcome.service->mean() / nano_to_milli, 6),
+	    d2s(outcome.service->quantile(0.99) / nano_to_milli, 6),
+	    speed>0 ? d2s(outcome.response->quantile(0.99) / nano_to_milli, 6) : "n/a" };
+
+	tc.add(thistestcase + "algorithm", benchmark.name());
+	tc.add(thistestcase + "vector.size", targets[t].payload);
+	tc.add(thistestcase + "vector.unit", "Byte");
+	tc.add(thistestcase + "label", benchmark.label());
+	tc.add(thistestcase + "threads", m_numthreads);
+	tc.add(thistestcase + "total iterations", n);
+	tc.add(thistestcase + "errors", outcome.errors);
+	tc.add(thistestcase + "speed", speed>0 ? d2s(speed) : "max");
+
+	std::vector<std::tuple<std::string, Measure<> > > result_rows;
+	auto add_measure = [&result_rows] (const std::string &key, double value, double error, const std::string &unit) {
+	    if(value > 0 && error > 0) {
+		result_rows.emplace_back(key, Measure<>(value, error, unit));
+	    }
+	};
+
+	// latency and response time are taken from histograms, percentiles are known within a bucket width
+	auto add_histogram = [&add_measure, &epsilon] (const std::string &prefix, const Histogram &h) {
+	    auto n = h.count();
+	    auto avg_err = n>1 ? std::sqrt(h.variance() / n) * 2 / nano_to_milli : epsilon;
+	    add_measure(prefix + ".average", h.mean() / nano_to_milli, std::max(avg_err, epsilon), "ms");
+	    add_measure(prefix + ".minimum", h.min() / nano_to_milli, epsilon, "ms");
+	    add_measure(prefix + ".maximum", h.max() / nano_to_milli, epsilon, "ms");
+	    for(auto q: { std::make_pair("p95", 0.95), std::make_pair("p98", 0.98), std::make_pair("p99", 0.99) }) {
+		add_measure(prefix + '.' + q.first, h.quantile(q.second) / nano_to_milli, std::max(h.quantile_error(q.second) / nano_to_milli, epsilon), "ms");
+	    }
+	};
+
+	if(n>0) {
+	    add_histogram("latency", *outcome.service);
+	    if(speed>0) {
+		add_histogram("response", *outcome.response);
+	    }
+
+	    // the count of calls follows a Poisson law, so its relative error is 1/sqrt(n)
+	    auto tps_global_val = n * 1000.0 / (wallclock_elapsed / nano_to_milli);
+	    add_measure("tps.global", tps_global_val, tps_global_val * 2 / std::sqrt(n), "Tnx/s");
+	    add_measure("wallclock", wallclock_elapsed / nano_to_milli, epsilon, "ms");
+	}
+
+	for(auto &row: result_rows) {
+	    tc.add<double>(thistestcase + std::get<0>(row) + ".value",  std::get<1>(row).value());
+	    tc.add(thistestcase + std::get<0>(row) + ".unit",   std::get<1>(row).unit());
+	    tc.add(thistestcase + std::get<0>(row) + ".error",  d2s(std::get<1>(row).error()));
+	    tc.add(thistestcase + std::get<0>(row) + ".relerr", d2s(std::get<1>(row).relerr()));
+	}
+
+	tc.add(thistestcase + "errorcode", errorcode(outcome.lasterror));
+
+	// several targets may share the same test case, with different vectors
+	ptree::path_type testcase(benchmark.name() + " using " + benchmark.label(), '\0');
+	auto existing = rv.get_child_optional(testcase);
+	if(existing) {
+	    for(auto &label: tc) {
+		for(auto &vector: label.second) {
+		    existing->get_child(ptree::path_type(label.first, '\0')).push_back(vector);
+		}
+	    }
+	} else {
+	    rv.add_child(testcase, tc);
+	}
+    }
+
+    std::cout << "Replay results:\n" << results << std::endl;
+
+    return rv;
+}
@@ -22,9 +22,15 @@
 #define EXECUTOR_H
 
 #include <forward_list>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <optional>
 #include <botan/p11_types.h>
 #include <boost/property_tree/ptree.hpp>
 #include "p11benchmark.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
 #include "../config.h"
 
 using namespace Botan::PKCS11;
@@ -38,6 +44,37 @@ class Executor
     double m_timer_res;
     double m_timer_res_err;
     bool m_generate_session_keys;
+    bool m_keep_going { false };		// carry on when calls return an error
+    keyset_t m_keyset;				// keys per thread, and how they are picked
+
+    // session recovery: sessions replaced by reopen() are retired, but kept until the end,
+    // as objects created by test cases may still refer to them
+    std::function<std::unique_ptr<Session>()> m_reopen;
+    std::chrono::milliseconds m_recovery_timeout { 0 };
+    std::mutex m_retired_mtx;
+    std::vector<std::unique_ptr<Session> > m_retired;
+
+    // reopen_session(): replace the session of a thread, and return it
+    Session *reopen_session(size_t th);
+    std::optional<std::string> m_samples_dir;	// where to export raw samples, if any
+    bool m_live { false };			// live view while running
+    MetricsExporter *m_metrics { nullptr };	// metrics exporter, if any
+
+    // dispatch overhead, as measured by calibrate()
+    struct Dispatch {
+	double average;		// in ms
+	double error;		// in ms
+	double sstddev;		// in ms
+	size_t count;
+	std::vector<std::pair<double, double> > percentiles; // p50, p95 and p99, value and error in ms
+    };
+
+    std::optional<Dispatch> m_dispatch;
+    bool m_calibrating { false };
+    bool m_net_of_dispatch { false };
+
+    // run(): when samples is not empty, it holds one writer per thread
+    std::vector<benchmark_result_t> run( P11Benchmark &benchmark, const std::vector<uint8_t> &payload, const size_t iter, const size_t skipiter, nanosecond_type &wallclock_elapsed, nanosecond_type &process_cputime, const std::vector<SampleWriter *> &samples = {} );
 
 public:
     Executor( const std::map<const std::string,
@@ -63,7 +100,38 @@ public:
 
     double precision() { return m_timer_res + m_timer_res_err; }
 
-    ptree benchmark( P11Benchmark &benchmark, const size_t iter, const size_t skipiter, const std::forward_list<std::string> shortlist );
+    // samples_out(): export raw samples of every test case and vector to a file, in the given directory
+    void samples_out(const std::string &dir) { m_samples_dir = dir; }
+
+    // keyset(): use several keys per thread, picked for each iteration
+    void keyset(const keyset_t &keyset) { m_keyset = keyset; }
+
+    // keep_going(): account for errors returned by calls, instead of stopping the test case
+    void keep_going(bool enable) { m_keep_going = enable; }
+
+    // recovery(): when a session is lost (e.g. upon HSM failover), replace it with a session obtained from reopen(),
+    // and carry on. Time to recover and throughput dip are reported.
+    void recovery(std::function<std::unique_ptr<Session>()> reopen, std::chrono::milliseconds timeout) {
+	m_reopen = reopen;
+	m_recovery_timeout = timeout;
+    }
+
+    // live(): show a live view of progress, while test cases run
+    void live(bool enable) { m_live = enable; }
+
+    // metrics(): feed the exporter with counters of running test cases
+    void metrics(MetricsExporter *exporter) { m_metrics = exporter; }
+
+    // benchmark(): when baseline is given, it is run for every vector under the same conditions, and compared.
+    ptree benchmark( P11Benchmark &benchmark, const size_t iter, const size_t skipiter, const std::forward_list<std::string> shortlist, P11Benchmark *baseline = nullptr );
+
+    // calibrate(): run a null operation, under the same conditions as benchmarks.
+    // subsequent calls to benchmark() report the dispatch overhead, and optionally latency net of it.
+    ptree calibrate( P11Benchmark &nullbenchmark, const size_t iter, const size_t skipiter, const std::string testcase, bool net_of_dispatch );
+
+    // replay(): drive test cases according to a trace, at the given speed (0 means as fast as possible).
+    // traced threads are mapped onto the executor threads.
+    ptree replay( const std::forward_list<P11Benchmark *> &benchmarks, const TraceReader &trace, double speed );
 
 };
 
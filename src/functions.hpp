@@ -0,0 +1,128 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// functions.hpp: the functions of the PKCS#11 API, as listed in CK_FUNCTION_LIST
+
+#if !defined(FUNCTIONS_H)
+#define FUNCTIONS_H
+
+#include <array>
+#include <cstddef>
+#include <botan/p11.h>
+
+// the operation a function belongs to, to relate calls to the mechanism given at initialization time
+enum class OperationKind {
+    none,
+    encrypt,
+    decrypt,
+    digest,
+    sign,
+    verify,
+    signrecover,
+    verifyrecover,
+    count			// number of operations, must be last
+};
+
+struct FunctionDescriptor {
+    const char *name;
+    OperationKind operation;
+    bool init;			// C_xxxInit(), the mechanism is given as argument
+};
+
+// functions, in the order of CK_FUNCTION_LIST
+inline constexpr std::array<FunctionDescriptor,68> function_descriptors { {
+	    { "C_Initialize", OperationKind::none, false },
+	    { "C_Finalize", OperationKind::none, false },
+	    { "C_GetInfo", OperationKind::none, false },
+	    { "C_GetFunctionList", OperationKind::none, false },
+	    { "C_GetSlotList", OperationKind::none, false },
+	    { "C_GetSlotInfo", OperationKind::none, false },
+	    { "C_GetTokenInfo", OperationKind::none, false },
+	    { "C_GetMechanismList", OperationKind::none, false },
+	    { "C_GetMechanismInfo", OperationKind::none, false },
+	    { "C_InitToken", OperationKind::none, false },
+	    { "C_InitPIN", OperationKind::none, false },
+	    { "C_SetPIN", OperationKind::none, false },
+	    { "C_OpenSession", OperationKind::none, false },
+	    { "C_CloseSession", OperationKind::none, false },
+	    { "C_CloseAllSessions", OperationKind::none, false },
+	    { "C_GetSessionInfo", OperationKind::none, false },
+	    { "C_GetOperationState", OperationKind::none, false },
+	    { "C_SetOperationState", OperationKind::none, false },
+	    { "C_Login", OperationKind::none, false },
+	    { "C_Logout", OperationKind::none, false },
+	    { "C_CreateObject", OperationKind::none, false },
+	    { "C_CopyObject", OperationKind::none, false },
+	    { "C_DestroyObject", OperationKind::none, false },
+	    { "C_GetObjectSize", OperationKind::none, false },
+	    { "C_GetAttributeValue", OperationKind::none, false },
+	    { "C_SetAttributeValue", OperationKind::none, false },
+	    { "C_FindObjectsInit", OperationKind::none, false },
+	    { "C_FindObjects", OperationKind::none, false },
+	    { "C_FindObjectsFinal", OperationKind::none, false },
+	    { "C_EncryptInit", OperationKind::encrypt, true },
+	    { "C_Encrypt", OperationKind::encrypt, false },
+	    { "C_EncryptUpdate", OperationKind::encrypt, false },
+	    { "C_EncryptFinal", OperationKind::encrypt, false },
+	    { "C_DecryptInit", OperationKind::decrypt, true },
+	    { "C_Decrypt", OperationKind::decrypt, false },
+	    { "C_DecryptUpdate", OperationKind::decrypt, false },
+	    { "C_DecryptFinal", OperationKind::decrypt, false },
+	    { "C_DigestInit", OperationKind::digest, true },
+	    { "C_Digest", OperationKind::digest, false },
+	    { "C_DigestUpdate", OperationKind::digest, false },
+	    { "C_DigestKey", OperationKind::digest, false },
+	    { "C_DigestFinal", OperationKind::digest, false },
+	    { "C_SignInit", OperationKind::sign, true },
+	    { "C_Sign", OperationKind::sign, false },
+	    { "C_SignUpdate", OperationKind::sign, false },
+	    { "C_SignFinal", OperationKind::sign, false },
+	    { "C_SignRecoverInit", OperationKind::signrecover, true },
+	    { "C_SignRecover", OperationKind::signrecover, false },
+	    { "C_VerifyInit", OperationKind::verify, true },
+	    { "C_Verify", OperationKind::verify, false },
+	    { "C_VerifyUpdate", OperationKind::verify, false },
+	    { "C_VerifyFinal", OperationKind::verify, false },
+	    { "C_VerifyRecoverInit", OperationKind::verifyrecover, true },
+	    { "C_VerifyRecover", OperationKind::verifyrecover, false },
+	    { "C_DigestEncryptUpdate", OperationKind::none, false },
+	    { "C_DecryptDigestUpdate", OperationKind::none, false },
+	    { "C_SignEncryptUpdate", OperationKind::none, false },
+	    { "C_DecryptVerifyUpdate", OperationKind::none, false },
+	    { "C_GenerateKey", OperationKind::none, false },
+	    { "C_GenerateKeyPair", OperationKind::none, false },
+	    { "C_WrapKey", OperationKind::none, false },
+	    { "C_UnwrapKey", OperationKind::none, false },
+	    { "C_DeriveKey", OperationKind::none, false },
+	    { "C_SeedRandom", OperationKind::none, false },
+	    { "C_GenerateRandom", OperationKind::none, false },
+	    { "C_GetFunctionStatus", OperationKind::none, false },
+	    { "C_CancelFunction", OperationKind::none, false },
+	    { "C_WaitForSlotEvent", OperationKind::none, false },
+	} };
+
+static_assert(function_descriptors.size() == (sizeof(CK_FUNCTION_LIST) - offsetof(CK_FUNCTION_LIST, C_Initialize)) / sizeof(CK_VOID_PTR),
+		  "function descriptors do not match CK_FUNCTION_LIST");
+
+// position of a function in CK_FUNCTION_LIST, from its offset
+constexpr size_t function_slot(size_t offset)
+{
+    return (offset - offsetof(CK_FUNCTION_LIST, C_Initialize)) / sizeof(CK_VOID_PTR);
+}
+
+#endif // FUNCTIONS_H
@@ -0,0 +1,159 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Histogram: a log-linear histogram of latencies, expressed in nanoseconds.
+//
+// Every power of two is split into 2^subbucket_bits linear sub-buckets, so that any value
+// is known with a relative error below 2^-subbucket_bits (about 6%), over the whole 64 bits range,
+// within a fixed amount of memory.
+//
+// Recording is meant to be done by a single thread. Counters are atomic, so that another thread
+// can read the histogram (e.g. to aggregate it) while recording is ongoing, without locking.
+
+#if !defined(HISTOGRAM_HPP)
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+class Histogram
+{
+public:
+    static constexpr unsigned subbucket_bits = 4;
+    static constexpr size_t subbuckets = size_t(1) << subbucket_bits;
+    static constexpr size_t buckets = (64 - subbucket_bits + 1) * subbuckets;
+
+private:
+    std::array<std::atomic<uint64_t>, buckets> m_counts {};
+    std::atomic<uint64_t> m_count { 0 };
+    std::atomic<uint64_t> m_sum { 0 };
+    std::atomic<double> m_sumsq { 0.0 };
+    std::atomic<uint64_t> m_min { std::numeric_limits<uint64_t>::max() };
+    std::atomic<uint64_t> m_max { 0 };
+
+    // single writer: a plain load/store pair is enough, and cheaper than a read-modify-write
+    template<typename T>
+    static inline void bump(std::atomic<T> &counter, T increment) {
+	counter.store(counter.load(std::memory_order_relaxed) + increment, std::memory_order_relaxed);
+    }
+
+public:
+    Histogram() = default;
+    Histogram(const Histogram &) = delete;
+    Histogram& operator=(const Histogram &) = delete;
+
+    // bucket index of a value
+    static inline size_t index(uint64_t value) {
+	if(value < subbuckets) {
+	    return value;
+	}
+	unsigned exponent = 63 - __builtin_clzll(value); // floor(log2(value)), at least subbucket_bits
+	return ((exponent - subbucket_bits + 1) << subbucket_bits) + ((value >> (exponent - subbucket_bits)) & (subbuckets - 1));
+    }
+
+    // smallest value falling into a bucket
+    static inline uint64_t lower(size_t index) {
+	if(index < subbuckets) {
+	    return index;
+	}
+	unsigned shift = (index >> subbucket_bits) - 1;
+	return (subbuckets + (index & (subbuckets - 1))) << shift;
+    }
+
+    // width of a bucket
+    static inline uint64_t width(size_t index) {
+	return index < subbuckets ? 1 : uint64_t(1) << ((index >> subbucket_bits) - 1);
+    }
+
+    inline void record(uint64_t value) {
+	bump(m_counts[index(value)], uint64_t(1));
+	bump(m_count, uint64_t(1));
+	bump(m_sum, value);
+	bump(m_sumsq, static_cast<double>(value) * value);
+	if(value < m_min.load(std::memory_order_relaxed)) m_min.store(value, std::memory_order_relaxed);
+	if(value > m_max.load(std::memory_order_relaxed)) m_max.store(value, std::memory_order_relaxed);
+    }
+
+    // add the content of another histogram to this one
+    void add(const Histogram &other) {
+	for(size_t i=0; i<buckets; i++) {
+	    auto c = other.m_counts[i].load(std::memory_order_relaxed);
+	    if(c) bump(m_counts[i], c);
+	}
+	bump(m_count, other.m_count.load(std::memory_order_relaxed));
+	bump(m_sum, other.m_sum.load(std::memory_order_relaxed));
+	bump(m_sumsq, other.m_sumsq.load(std::memory_order_relaxed));
+	if(other.min() < min()) m_min.store(other.min(), std::memory_order_relaxed);
+	if(other.max() > max()) m_max.store(other.max(), std::memory_order_relaxed);
+    }
+
+    void reset() {
+	for(auto &c: m_counts) c.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_sumsq.store(0.0, std::memory_order_relaxed);
+	m_min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+    }
+
+    inline uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    inline uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    inline uint64_t min() const { return m_min.load(std::memory_order_relaxed); }
+    inline uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    inline uint64_t bucket(size_t index) const { return m_counts[index].load(std::memory_order_relaxed); }
+
+    inline double mean() const { return count() ? static_cast<double>(sum()) / count() : 0.0; }
+
+    // sample variance
+    double variance() const {
+	auto n = count();
+	if(n<2) return 0.0;
+	double m = mean();
+	double v = (m_sumsq.load(std::memory_order_relaxed) - n * m * m) / (n - 1);
+	return v > 0.0 ? v : 0.0;
+    }
+
+    // value at quantile q (0<=q<=1), taken at the middle of its bucket, and clamped to [min,max].
+    // the error on the returned value is half of the bucket width, see quantile_error()
+    uint64_t quantile(double q) const {
+	auto n = count();
+	if(n==0) return 0;
+	uint64_t rank = static_cast<uint64_t>(std::ceil(q * n));
+	if(rank==0) rank = 1;
+
+	uint64_t seen = 0;
+	for(size_t i=0; i<buckets; i++) {
+	    seen += bucket(i);
+	    if(seen >= rank) {
+		uint64_t value = lower(i) + width(i) / 2;
+		return value < min() ? min() : value > max() ? max() : value;
+	    }
+	}
+	return max();
+    }
+
+    uint64_t quantile_error(double q) const {
+	auto w = width(index(quantile(q)));
+	return w > 1 ? w / 2 : 1;
+    }
+};
+
+#endif // HISTOGRAM_HPP
@@ -17,7 +17,13 @@
 //
 
 #include <iostream>
+#include <array>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cctype>
 #include <boost/tokenizer.hpp>
+#include <botan/p11_object.h>
 #include "stringhash.hpp"
 #include "implementation.hpp"
 
@@ -55,3 +61,144 @@ Implementation::Implementation(std::string vendor)
 inline bool Implementation::operator==(const Implementation& other) {
     return m_vendor==other.m_vendor;
 }
+
+std::string Implementation::name(Vendor vendor)
+{
+    switch(vendor) {
+    case Vendor::generic: return "generic";
+    case Vendor::luna: return "luna";
+    case Vendor::utimaco: return "utimaco";
+    case Vendor::entrust: return "entrust";
+    case Vendor::marvell: return "marvell";
+    }
+    return "unknown";
+}
+
+Implementation::Vendor Implementation::detect(const std::string &library_manufacturer, const std::string &token_manufacturer, const std::string &token_model)
+{
+    // keywords are searched in all fields, case insensitive.
+    // nShield keywords come first, as former nCipher products were branded Thales.
+    static const std::array<std::pair<const char *, Vendor>,12> keywords { {
+	    { "ncipher", Vendor::entrust },
+	    { "nshield", Vendor::entrust },
+	    { "entrust", Vendor::entrust },
+	    { "safenet", Vendor::luna },
+	    { "gemalto", Vendor::luna },
+	    { "luna", Vendor::luna },
+	    { "thales", Vendor::luna },
+	    { "utimaco", Vendor::utimaco },
+	    { "cryptoserver", Vendor::utimaco },
+	    { "marvell", Vendor::marvell },
+	    { "cavium", Vendor::marvell },
+	    { "liquidsecurity", Vendor::marvell },
+	} };
+
+    std::string metadata = library_manufacturer + ' ' + token_manufacturer + ' ' + token_model;
+    std::transform(metadata.begin(), metadata.end(), metadata.begin(), [] (unsigned char c) { return std::tolower(c); });
+
+    for(auto &keyword: keywords) {
+	if(metadata.find(keyword.first)!=std::string::npos) {
+	    return keyword.second;
+	}
+    }
+
+    return Vendor::generic;
+}
+
+std::optional<Implementation::Vendor> Implementation::probe_gcm(Botan::PKCS11::Session &session)
+{
+    using namespace Botan::PKCS11;
+
+    Byte btrue = CK_TRUE;
+    Byte bfalse = CK_FALSE;
+    Ulong keylen = 16;
+    Mechanism mech_aes_key_gen { CKM_AES_KEY_GEN, nullptr, 0 };
+    ObjectHandle key;
+    ReturnValue rv;
+
+    std::array<Attribute,3> keytemplate {
+	{
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), &bfalse, sizeof(Byte) },
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Encrypt), &btrue, sizeof(Byte) },
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::ValueLen), &keylen, sizeof(Ulong) }
+	}
+    };
+
+    if(!session.module()->C_GenerateKey(session.handle(), &mech_aes_key_gen, keytemplate.data(), keytemplate.size(), &key, &rv)) {
+	return std::nullopt;
+    }
+
+    // a random IV, an IV of zeroes, and no IV (the token generates it, and appends it to the output)
+    const std::array<Vendor,3> candidates { Vendor::generic, Vendor::utimaco, Vendor::luna };
+    std::optional<Vendor> found;
+    std::vector<uint8_t> payload(16, 0);
+
+    for(auto candidate: candidates) {
+	std::vector<uint8_t> iv;
+	CK_GCM_PARAMS gcm_params { nullptr, 0, 0, nullptr, 0, 128 };
+	Mechanism mech_aes_gcm { CKM_AES_GCM, &gcm_params, sizeof gcm_params };
+
+	switch(candidate) {
+	case Vendor::generic: {
+	    std::random_device rd;
+	    iv.resize(12);
+	    std::generate(iv.begin(), iv.end(), [&rd] () { return static_cast<uint8_t>(rd()); });
+	    break;
+	}
+
+	case Vendor::luna:
+	    break;
+
+	default:
+	    iv.resize(12, 0);
+	    break;
+	}
+
+	if(!iv.empty()) {
+	    gcm_params.pIv = iv.data();
+	    gcm_params.ulIvLen = iv.size();
+	    gcm_params.ulIvBits = iv.size() << 3;
+	}
+
+	std::vector<uint8_t> encrypted(payload.size() + 32);
+	Ulong returned_len = encrypted.size();
+
+	if(session.module()->C_EncryptInit(session.handle(), &mech_aes_gcm, key, &rv)
+	   && session.module()->C_Encrypt(session.handle(), payload.data(), payload.size(), encrypted.data(), &returned_len, &rv)
+	   && returned_len >= payload.size()
+	   && gcm_overhead(candidate).count(returned_len - payload.size())) {
+	    found = candidate;
+	    break;
+	}
+    }
+
+    session.module()->C_DestroyObject(session.handle(), key, &rv);
+
+    return found;
+}
+
+bool Implementation::same_gcm_layout(Vendor a, Vendor b)
+{
+    // utimaco, entrust and marvell all expect an IV of zeroes
+    auto layout = [] (Vendor vendor) {
+	switch(vendor) {
+	case Vendor::entrust:
+	case Vendor::marvell:
+	    return Vendor::utimaco;
+	default:
+	    return vendor;
+	}
+    };
+
+    return layout(a)==layout(b);
+}
+
+std::set<size_t> Implementation::gcm_overhead(Vendor vendor)
+{
+    switch(vendor) {
+    case Vendor::luna:
+	return { 16, 32 };	// on Safenet in FIPS mode, the IV (16 bytes) is returned after the tag
+    default:
+	return { 16 };
+    }
+}
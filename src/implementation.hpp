@@ -23,6 +23,8 @@
 
 #include <set>
 #include <string>
+#include <optional>
+#include <botan/p11_types.h>
 
 using namespace std::literals;
 
@@ -41,6 +43,21 @@ struct Implementation {
     inline Vendor vendor() { return m_vendor; }
 
     static auto choices() { return "generic, luna, utimaco, entrust, marvell"s; }
+    static std::string name(Vendor vendor);
+
+    // detect(): infer the flavour from the manufacturer of the library, and the manufacturer and model of the token.
+    // generic is returned when none of them is recognized.
+    static Vendor detect(const std::string &library_manufacturer, const std::string &token_manufacturer, const std::string &token_model);
+
+    // probe_gcm(): encrypt with CKM_AES_GCM and a session key, following the IV conventions of each flavour in turn,
+    // and return the first flavour whose output layout matches (generic, utimaco for an IV of zeroes, or luna), if any
+    static std::optional<Vendor> probe_gcm(Botan::PKCS11::Session &session);
+
+    // same_gcm_layout(): true when both flavours follow the same IV conventions with CKM_AES_GCM
+    static bool same_gcm_layout(Vendor a, Vendor b);
+
+    // gcm_overhead(): sizes that C_Encrypt() may add to the payload with CKM_AES_GCM, i.e. the tag, and the IV when appended
+    static std::set<size_t> gcm_overhead(Vendor vendor);
 
 private:
     Vendor m_vendor;
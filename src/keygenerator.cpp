@@ -23,11 +23,16 @@
 #include <iomanip>
 #include <future>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include <boost/timer/timer.hpp>
 #include <botan/p11_rsa.h>
 #include <botan/p11_ecdsa.h>
 #include <botan/p11_ecdh.h>
 #include "implementation.hpp"
 #include "keygenerator.hpp"
+#include "p11benchmark.hpp"
 #include "errorcodes.hpp"
 
 using namespace Botan::PKCS11;
@@ -36,9 +41,11 @@ using namespace Botan::PKCS11;
 bool KeyGenerator::generate_rsa_keypair(std::string alias, unsigned int bits, std::string param, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::RSA, bits, param);
     try {
 	Botan::PKCS11::RSA_PrivateKeyGenerationProperties priv_generate_props;
-	priv_generate_props.set_token( false );
+	priv_generate_props.set_token( m_persistent );
+	if(m_persistent) { priv_generate_props.set_id( id ); } // fingerprint, see reuse()
 	priv_generate_props.set_sign( true );
 	priv_generate_props.set_unwrap( true ); // needed by JWE
 	priv_generate_props.set_decrypt( true ); // needed by PKCS#1 OAEP Decrypt
@@ -48,7 +55,8 @@ bool KeyGenerator::generate_rsa_keypair(std::string alias, unsigned int bits, st
 	Botan::PKCS11::RSA_PublicKeyGenerationProperties pub_generate_props( bits );
 	pub_generate_props.set_pub_exponent(65537);
 	pub_generate_props.set_label( alias );
-	pub_generate_props.set_token( false );
+	pub_generate_props.set_token( m_persistent );
+	if(m_persistent) { pub_generate_props.set_id( id ); }
 	pub_generate_props.set_verify( true );
 	pub_generate_props.set_wrap( true ); // needed by JWE
 	pub_generate_props.set_encrypt( true ); // needed by PKCS#11 OAEP Decrypt
@@ -73,6 +81,7 @@ bool KeyGenerator::generate_rsa_keypair(std::string alias, unsigned int bits, st
 bool KeyGenerator::generate_des_key(std::string alias, unsigned int bits, std::string param, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::DES, bits, param);
     Byte btrue = CK_TRUE;
     Byte bfalse = CK_FALSE;
     Ulong len = bits >> 3;
@@ -100,18 +109,24 @@ bool KeyGenerator::generate_des_key(std::string alias, unsigned int bits, std::s
     std::array<Attribute,5> keytemplate {
 	{
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Label), const_cast< char* >(alias.c_str()), alias.size() },
-	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), &bfalse, sizeof(Byte) },
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), m_persistent ? &btrue : &bfalse, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Encrypt), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Decrypt), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Private), &btrue, sizeof(Byte) }  // not well supported on Marvell
 	}
     };
 
+    // the fingerprint is only set on persistent keys, see reuse()
+    std::vector<Attribute> attributes( keytemplate.begin(), m_vendor==Implementation::Vendor::marvell ? keytemplate.end()-1 : keytemplate.end() );
+    if(m_persistent) {
+	attributes.push_back( { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Id), id.data(), id.size() } );
+    }
+
     try {
 	session->module()->C_GenerateKey( session->handle(), 
 					  &mechanism, 
-					  keytemplate.data(), 
-					  m_vendor==Implementation::Vendor::marvell ? keytemplate.size()-1 : keytemplate.size(), 
+					  attributes.data(),
+					  attributes.size(),
 					  &handle );
 	rv = true;
 
@@ -132,6 +147,7 @@ bool KeyGenerator::generate_des_key(std::string alias, unsigned int bits, std::s
 bool KeyGenerator::generate_aes_key(std::string alias, unsigned int bits, std::string param, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::AES, bits, param);
     Byte btrue = CK_TRUE;
     Byte bfalse = CK_FALSE;
     Ulong len = bits >> 3;
@@ -146,7 +162,7 @@ bool KeyGenerator::generate_aes_key(std::string alias, unsigned int bits, std::s
     std::array<Attribute,6> keytemplate {
 	{
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Label), const_cast< char* >(alias.c_str()), alias.size() },
-	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), &bfalse, sizeof(Byte) },
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), m_persistent ? &btrue : &bfalse, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Encrypt), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Decrypt), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::ValueLen), &len, sizeof(Ulong) },
@@ -154,11 +170,17 @@ bool KeyGenerator::generate_aes_key(std::string alias, unsigned int bits, std::s
 	}
     };
 
+    // the fingerprint is only set on persistent keys, see reuse()
+    std::vector<Attribute> attributes( keytemplate.begin(), m_vendor==Implementation::Vendor::marvell ? keytemplate.end()-1 : keytemplate.end() );
+    if(m_persistent) {
+	attributes.push_back( { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Id), id.data(), id.size() } );
+    }
+
     try {
 	session->module()->C_GenerateKey( session->handle(), 
 					  &mech_aes_key_gen, 
-					  keytemplate.data(), 
-					  m_vendor==Implementation::Vendor::marvell ? keytemplate.size()-1 : keytemplate.size(),
+					  attributes.data(),
+					  attributes.size(),
 					  &handle );
 	rv = true;
 
@@ -179,6 +201,7 @@ bool KeyGenerator::generate_aes_key(std::string alias, unsigned int bits, std::s
 bool KeyGenerator::generate_generic_key(std::string alias, unsigned int bits, std::string param, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::GENERIC, bits, param);
     Byte btrue = CK_TRUE;
     Byte bfalse = CK_FALSE;
     Ulong len = bits >> 3;
@@ -188,7 +211,7 @@ bool KeyGenerator::generate_generic_key(std::string alias, unsigned int bits, st
     std::array<Attribute,7> keytemplate {
 	{
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Label), const_cast< char* >(alias.c_str()), alias.size() },
-	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), &bfalse, sizeof(Byte) },
+	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), m_persistent ? &btrue : &bfalse, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Sign), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Verify), &btrue, sizeof(Byte) },
 	    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Derive), &btrue, sizeof(Byte) }, // needed for CKM_XOR_BASE_AND_DATA
@@ -197,11 +220,17 @@ bool KeyGenerator::generate_generic_key(std::string alias, unsigned int bits, st
 	}
     };
 
+    // the fingerprint is only set on persistent keys, see reuse()
+    std::vector<Attribute> attributes( keytemplate.begin(), m_vendor==Implementation::Vendor::marvell ? keytemplate.end()-1 : keytemplate.end() );
+    if(m_persistent) {
+	attributes.push_back( { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Id), id.data(), id.size() } );
+    }
+
     try {
 	session->module()->C_GenerateKey( session->handle(), 
 					  &mech_generic_secret_key_gen, 
-					  keytemplate.data(), 
-					  m_vendor==Implementation::Vendor::marvell ? keytemplate.size()-1 : keytemplate.size(), 
+					  attributes.data(),
+					  attributes.size(),
 					  &handle );
 	rv = true;
 
@@ -222,9 +251,11 @@ bool KeyGenerator::generate_generic_key(std::string alias, unsigned int bits, st
 bool KeyGenerator::generate_ecdsa_keypair(std::string alias, unsigned int unused, std::string curve, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::ECDSA, unused, curve);
     try {
 	Botan::PKCS11::EC_PrivateKeyGenerationProperties priv_generate_props;
-	priv_generate_props.set_token( false );
+	priv_generate_props.set_token( m_persistent );
+	if(m_persistent) { priv_generate_props.set_id( id ); } // fingerprint, see reuse()
 	priv_generate_props.set_sign( true );
 	priv_generate_props.set_label( alias );
 	if(m_vendor!=Implementation::Vendor::marvell) { priv_generate_props.set_private( true ); } // not well supported on Marvell
@@ -233,7 +264,8 @@ bool KeyGenerator::generate_ecdsa_keypair(std::string alias, unsigned int unused
 	    Botan::EC_Group( curve ).DER_encode(Botan::EC_Group_Encoding::EC_DOMPAR_ENC_OID ) );
 
 	pub_generate_props.set_label( alias );
-	pub_generate_props.set_token( false );
+	pub_generate_props.set_token( m_persistent );
+	if(m_persistent) { pub_generate_props.set_id( id ); }
 	pub_generate_props.set_verify( true );
 	if(m_vendor!=Implementation::Vendor::marvell) { pub_generate_props.set_private( false ); } // not well supported on Marvell
 
@@ -257,9 +289,11 @@ bool KeyGenerator::generate_ecdsa_keypair(std::string alias, unsigned int unused
 bool KeyGenerator::generate_ecdh_keypair(std::string alias, unsigned int unused, std::string curve, Session *session)
 {
     bool rv;
+    auto id = fingerprint(KeyType::ECDH, unused, curve);
     try {
 	Botan::PKCS11::EC_PrivateKeyGenerationProperties priv_generate_props;
-	priv_generate_props.set_token( false );
+	priv_generate_props.set_token( m_persistent );
+	if(m_persistent) { priv_generate_props.set_id( id ); } // fingerprint, see reuse()
 	priv_generate_props.set_derive( true );
 	priv_generate_props.set_label( alias );
 	if(m_vendor!=Implementation::Vendor::marvell) { priv_generate_props.set_private( true ); } // not well supported on Marvell
@@ -268,7 +302,8 @@ bool KeyGenerator::generate_ecdh_keypair(std::string alias, unsigned int unused,
 	    Botan::EC_Group( curve ).DER_encode(Botan::EC_Group_Encoding::EC_DOMPAR_ENC_OID ) );
 
 	pub_generate_props.set_label( alias );
-	pub_generate_props.set_token( false );
+	pub_generate_props.set_token( m_persistent );
+	if(m_persistent) { pub_generate_props.set_id( id ); }
 	pub_generate_props.set_derive( true );
 	if(m_vendor!=Implementation::Vendor::marvell) { pub_generate_props.set_private( false ); } // not well supported on Marvell
 
@@ -289,12 +324,118 @@ bool KeyGenerator::generate_ecdh_keypair(std::string alias, unsigned int unused,
 }
 
 
+// fingerprint(): CKA_ID of generated keys, derived from the generation parameters.
+// a persistent key is reused only when its fingerprint matches, i.e. when it was generated the same way.
+std::vector<uint8_t> KeyGenerator::fingerprint(KeyGenerator::KeyType keytype, unsigned int bits, std::string curve) const
+{
+    std::stringstream parameters;
+    parameters << "v1/" << static_cast<int>(keytype) << '/' << bits << '/' << curve << '/' << static_cast<int>(m_vendor);
+
+    // FNV-1a, 64 bits: stable across runs and platforms
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(auto c: parameters.str()) {
+	hash ^= static_cast<uint8_t>(c);
+	hash *= 0x100000001b3ULL;
+    }
+
+    std::stringstream id;
+    id << fingerprint_prefix << std::hex << std::setw(16) << std::setfill('0') << hash;
+    auto str = id.str();
+    return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+
+// reuse(): look for a persistent key generated earlier with the same parameters.
+// keys with the same label, but generated with other parameters, are destroyed.
+// objects with the same label that were not generated by us are reported, and left in place.
+KeyGenerator::Reuse KeyGenerator::reuse(const job_t &job, Session *session)
+{
+    auto id = fingerprint(job.keytype, job.bits, job.curve);
+    size_t expected = (job.keytype==KeyType::RSA || job.keytype==KeyType::ECDSA || job.keytype==KeyType::ECDH) ? 2 : 1;
+    std::vector<Object> matching;
+    size_t foreign = 0;
+
+    try {
+	AttributeContainer search_template;
+	search_template.add_string( AttributeType::Label, job.alias );
+
+	for(auto &obj: Object::search<Object>( *session, search_template.attributes() )) {
+	    auto objid = obj.get_attribute_value( AttributeType::Id );
+	    if(objid.size()==id.size() && std::equal(objid.begin(), objid.end(), id.begin())) {
+		matching.push_back(obj);
+	    } else if(objid.size()>=fingerprint_prefix.size()
+		      && std::equal(fingerprint_prefix.begin(), fingerprint_prefix.end(), objid.begin())) {
+		obj.destroy();	// ours, but stale
+	    } else {
+		foreign++;
+	    }
+	}
+
+	if(foreign>0) {
+	    std::cerr << "ERROR:: " << foreign << " object(s) labelled '" << job.alias
+		      << "' were not generated by p11perftest, remove them first" << std::endl;
+	    return Reuse::conflict;
+	}
+
+	if(matching.size()==expected) {
+	    return Reuse::reused;
+	}
+
+	// incomplete (e.g. interrupted generation): start over
+	for(auto &obj: matching) {
+	    obj.destroy();
+	}
+    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	std::cerr << "ERROR:: " << bexc.what()
+		  << " (" << errorcode(bexc.error_code()) << ")" << std::endl;
+    }
+
+    return Reuse::generate;
+}
+
+
 void KeyGenerator::generate_key_generic(KeyGenerator::KeyType keytype, std::string alias, unsigned int bits, std::string curve)
 {
-    int th;
-    bool rv = true;
-    std::vector<std::future<bool> > future_array(m_numthreads);
+    if(m_skipped.count(alias)) {
+	std::cout << "skipping key generation for " << alias << ", not needed\n";
+	return;
+    }
 
+    // persistent keys have labels of their own (see keyset_t)
+    if(m_persistent) {
+	alias = keyset_t::persistent_prefix + alias;
+    }
+
+    // keys are only scheduled here, they are generated by generate()
+    if(m_shared>0) {
+	for(size_t k=0; k<m_shared; k++) {
+	    std::stringstream shared_alias;
+	    shared_alias << alias << "-sh-" << std::setw(5) << std::setfill('0') << k;
+	    m_jobs.push_back( { keytype, shared_alias.str(), bits, curve } );
+	}
+	return;
+    }
+
+    for(int th=0; th<m_numthreads; th++) {
+	std::stringstream thread_specific_alias;
+
+	thread_specific_alias << alias << "-th-" << std::setw(5) << std::setfill('0') << th;
+
+	if(m_keys_per_thread<=1) {
+	    m_jobs.push_back( { keytype, thread_specific_alias.str(), bits, curve } );
+	} else {
+	    for(size_t k=0; k<m_keys_per_thread; k++) {
+		std::stringstream key_specific_alias;
+		key_specific_alias << thread_specific_alias.str() << "-key-" << std::setw(5) << std::setfill('0') << k;
+		m_jobs.push_back( { keytype, key_specific_alias.str(), bits, curve } );
+	    }
+	}
+    }
+}
+
+
+void KeyGenerator::generate()
+{
     // because I'm lazy, let's use decltype() to define the function pointer...
     using fnptr = decltype( &KeyGenerator::generate_rsa_keypair );
 
@@ -307,30 +448,61 @@ void KeyGenerator::generate_key_generic(KeyGenerator::KeyType keytype, std::stri
 	{ KeyType::GENERIC, &KeyGenerator::generate_generic_key }
     };
 
-    auto chooser = [&fnmap](KeyGenerator::KeyType kt) { return fnmap.at(kt);  };
+    // longest jobs first, so that they do not end up last on a single session.
+    // RSA key generation time grows roughly with the cube of the modulus size.
+    auto cost = [] (const job_t &job) -> double {
+		    switch(job.keytype) {
+		    case KeyType::RSA:
+			return std::pow(job.bits / 1024.0, 3) * 100;
+		    case KeyType::ECDSA:
+		    case KeyType::ECDH:
+			return 10;
+		    default:
+			return 1;
+		    }
+		};
+    std::stable_sort(m_jobs.begin(), m_jobs.end(), [&cost] (const job_t &a, const job_t &b) { return cost(a) > cost(b); });
+
+    // all jobs are pulled from the same queue, by one worker per session
+    std::atomic<size_t> next { 0 };
+    std::atomic<size_t> reused { 0 };
+    std::atomic<bool> failed { false };
+    std::vector<std::future<void> > future_array;
+    boost::timer::cpu_timer t;
+
+    for(int th=0; th<m_numthreads && static_cast<size_t>(th)<m_jobs.size(); th++) {
+	future_array.push_back( std::async( std::launch::async,
+					    [this, &fnmap, &next, &reused, &failed, session=m_sessions[th].get()] () {
+						for(size_t j=next++; j<m_jobs.size() && !failed; j=next++) {
+						    auto &job = m_jobs[j];
+						    auto outcome = m_persistent ? reuse(job, session) : Reuse::generate;
+						    if(outcome==Reuse::reused) {
+							reused++;
+						    } else if(outcome==Reuse::conflict) {
+							failed = true;
+						    } else if((this->*fnmap.at(job.keytype))(job.alias, job.bits, job.curve, session) == false) {
+							failed = true;
+						    }
+						}
+					    } ) );
+    }
 
-    for(th=0; th<m_numthreads;th++) {
-	std::stringstream thread_specific_alias(alias);
+    for(auto &f: future_array) {
+	f.get();
+    }
 
-	thread_specific_alias << alias << "-th-" << std::setw(5) << std::setfill('0') << th;
+    auto count = m_jobs.size();
+    m_jobs.clear();
 
-	future_array[th] = std::async( std::launch::async,
-				       chooser(keytype),
-				       this,
-				       thread_specific_alias.str(),
-				       bits,
-				       curve,
-				       m_sessions[th].get());
+    if(failed) {
+	throw KeyGenerationException{"could not generate key"};
     }
 
-    // recover futures. If one is false, return false
-    // TODO: replace with exception
-
-    for(th=0;th<m_numthreads;th++) {
-	if(future_array[th].get() == false) {
-	    throw KeyGenerationException{"could not generate key"};
-	}
+    std::cout << count << " key(s) provisioned";
+    if(m_persistent) {
+	std::cout << " (" << count - reused << " generated, " << reused << " reused)";
     }
+    std::cout << " in " << t.format(3, "%w") << "s\n";
 }
 
 
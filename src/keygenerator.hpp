@@ -22,6 +22,10 @@
 #define KEYGENERATOR_H
 
 #include <stdexcept>
+#include <set>
+#include <vector>
+#include <memory>
+#include <string>
 #include <botan/p11_types.h>
 #include "../config.h"
 #include "implementation.hpp"
@@ -49,6 +53,27 @@ private:
     std::vector<std::unique_ptr<Session> > &m_sessions;
     const int m_numthreads;
     const Implementation::Vendor m_vendor;
+    std::set<std::string> m_skipped; // aliases for which no key is generated
+    size_t m_keys_per_thread { 1 };
+    size_t m_shared { 0 };
+    bool m_persistent { false };	// token keys, reused across runs
+
+    // a key to generate
+    struct job_t {
+	KeyType keytype;
+	std::string alias;
+	unsigned int bits;
+	std::string curve;
+    };
+    std::vector<job_t> m_jobs;
+
+    static inline const std::string fingerprint_prefix { "p11perftest-" };
+
+    // outcome of reuse(): a matching key was found, it must be generated, or a foreign object has its label
+    enum class Reuse { reused, generate, conflict };
+
+    std::vector<uint8_t> fingerprint(KeyGenerator::KeyType keytype, unsigned int bits, std::string curve) const;
+    Reuse reuse(const job_t &job, Session *session);
 
     bool generate_rsa_keypair(std::string alias, unsigned int bits, std::string unused, Session *session);
     bool generate_aes_key(std::string alias, unsigned int bits, std::string unused, Session *session);
@@ -72,8 +97,26 @@ public:
     KeyGenerator( KeyGenerator &&) = delete;
     KeyGenerator& operator=( KeyGenerator &&) = delete;
 
+    // skip(): do not generate keys for these aliases (e.g. when all test cases using them are completed). may be called several times
+    void skip(const std::set<std::string> &aliases) { m_skipped.insert(aliases.begin(), aliases.end()); }
+
+    // keys_per_thread(): generate several keys per thread, suffixed with -key-<index>
+    void keys_per_thread(size_t count) { m_keys_per_thread = count; }
+
+    // shared(): instead of keys per thread, generate count keys suffixed with -sh-<index>, shared by all threads
+    void shared(size_t count) { m_shared = count; }
+
+    // persistent(): generate token keys, labelled with keyset_t::persistent_prefix, tagged with a fingerprint
+    // of their parameters in CKA_ID, and reuse those generated by previous runs
+    void persistent(bool enable) { m_persistent = enable; }
+
+    // generate_key(): schedule the generation of a key (one per thread, several per thread, or shared)
     void generate_key( KeyGenerator::KeyType keytype, std::string alias, unsigned int bits);
     void generate_key( KeyGenerator::KeyType keytype, std::string alias, std::string curve);
+
+    // generate(): generate all scheduled keys, concurrently over all sessions.
+    // KeyGenerationException is thrown if one could not be generated.
+    void generate();
 };
 
 
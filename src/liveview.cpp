@@ -0,0 +1,150 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// liveview.cpp: a live console view of a running test case
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+#include "liveview.hpp"
+
+// threads are displayed as a grid
+static constexpr size_t threads_per_line = 6;
+
+
+LiveView::LiveView(const std::string &title, const std::vector<LiveCounters *> &counters, size_t iterations)
+    : m_title(title), m_counters(counters), m_iterations(iterations), m_tty(isatty(STDERR_FILENO)),
+      m_last_counts(counters.size(), 0)
+{ }
+
+LiveView::~LiveView()
+{
+    stop();
+}
+
+void LiveView::start()
+{
+    m_started = m_last = std::chrono::steady_clock::now();
+    m_thread = std::thread(&LiveView::loop, this);
+}
+
+void LiveView::stop()
+{
+    if(!m_thread.joinable()) {
+	return;
+    }
+
+    {
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+    refresh();
+    std::cerr << std::endl;
+}
+
+void LiveView::loop()
+{
+    std::unique_lock<std::mutex> lck(m_mtx);
+    while(!m_cond.wait_for(lck, std::chrono::seconds(1), [this] { return m_stop; })) {
+	refresh();
+    }
+}
+
+void LiveView::refresh()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto interval = std::chrono::duration<double>(now - m_last).count();
+    auto elapsed = std::chrono::duration<double>(now - m_started).count();
+    m_last = now;
+
+    // aggregate the histograms of all threads, and take the difference with the last refresh
+    std::array<uint64_t, Histogram::buckets> buckets {};
+    uint64_t total = 0, errors = 0, window = 0;
+    std::vector<double> thread_tps(m_counters.size());
+
+    for(size_t th=0; th<m_counters.size(); th++) {
+	auto &counters = *m_counters[th];
+	auto count = counters.latency.count();
+	thread_tps[th] = interval>0 ? (count - m_last_counts[th]) / interval : 0.0;
+	m_last_counts[th] = count;
+	total += count;
+	errors += counters.errors.load(std::memory_order_relaxed);
+	for(size_t i=0; i<Histogram::buckets; i++) {
+	    buckets[i] += counters.latency.bucket(i);
+	}
+    }
+
+    // rolling 99th percentile, over the last interval
+    uint64_t p99 = 0;
+    for(size_t i=0; i<Histogram::buckets; i++) {
+	window += buckets[i] - m_last_buckets[i];
+    }
+    if(window>0) {
+	uint64_t rank = (window * 99 + 99) / 100, seen = 0;
+	for(size_t i=0; i<Histogram::buckets; i++) {
+	    seen += buckets[i] - m_last_buckets[i];
+	    if(seen >= rank) {
+		p99 = Histogram::lower(i) + Histogram::width(i) / 2;
+		break;
+	    }
+	}
+    }
+    m_last_buckets = buckets;
+
+    double tps = 0.0;
+    for(auto t: thread_tps) tps += t;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+	<< "[live] " << m_title << " - " << elapsed << "s"
+	<< " - TPS " << tps
+	<< " - p99 " << std::setprecision(3) << (window>0 ? p99 / 1000000.0 : 0.0) << "ms"
+	<< " - done " << total << '/' << m_iterations * m_counters.size()
+	<< " - errors " << errors;
+
+    if(!m_tty) {
+	// not a terminal: one line per refresh, without per-thread details
+	std::cerr << out.str() << '\n';
+	return;
+    }
+
+    out << "\033[K\n";
+    size_t lines = 1;
+    for(size_t th=0; th<m_counters.size(); th++) {
+	auto count = m_last_counts[th];
+	out << std::setprecision(0)
+	    << "  " << std::setw(3) << th << ':'
+	    << std::setw(4) << (m_iterations ? 100.0 * count / m_iterations : 0.0) << '%'
+	    << std::setw(7) << thread_tps[th] << "/s"
+	    << (m_counters[th]->errors.load(std::memory_order_relaxed) ? " E" : "  ");
+	if((th+1) % threads_per_line==0 || th+1==m_counters.size()) {
+	    out << "\033[K\n";
+	    lines++;
+	}
+    }
+
+    // move back to the top of the previous view, and overwrite it
+    if(m_lines>0) {
+	std::cerr << "\033[" << m_lines << 'A';
+    }
+    std::cerr << '\r' << out.str() << std::flush;
+    m_lines = lines;
+}
@@ -0,0 +1,71 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// liveview.hpp: a live console view of a running test case, refreshed about once a second.
+//
+// Each thread updates its own counters (see counters.hpp), and the view reads them from a separate thread.
+
+#if !defined(LIVEVIEW_H)
+#define LIVEVIEW_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "counters.hpp"
+
+class LiveView
+{
+    std::string m_title;
+    std::vector<LiveCounters *> m_counters;
+    size_t m_iterations;	// per thread
+    bool m_tty;
+    size_t m_lines { 0 };	// lines printed by last refresh, to be overwritten
+
+    std::thread m_thread;
+    std::mutex m_mtx;
+    std::condition_variable m_cond;
+    bool m_stop { false };
+
+    // state of the previous refresh, to compute rates and rolling percentiles
+    std::chrono::steady_clock::time_point m_started;
+    std::chrono::steady_clock::time_point m_last;
+    std::vector<uint64_t> m_last_counts;
+    std::array<uint64_t, Histogram::buckets> m_last_buckets {};
+
+    void loop();
+    void refresh();
+
+public:
+    LiveView(const std::string &title, const std::vector<LiveCounters *> &counters, size_t iterations);
+    ~LiveView();
+
+    LiveView(const LiveView &) = delete;
+    LiveView& operator=(const LiveView &) = delete;
+
+    // start(): start refreshing, to be called when threads get green light
+    void start();
+
+    // stop(): stop refreshing, and print a last view
+    void stop();
+};
+
+#endif // LIVEVIEW_H
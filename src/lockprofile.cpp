@@ -0,0 +1,196 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// lockprofile.cpp: instrumented mutex callbacks, supplied to the PKCS#11 library through C_Initialize()
+
+#include <chrono>
+#include <algorithm>
+#include "lockprofile.hpp"
+
+static inline nanosecond_type now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+LockProfiler &LockProfiler::instance()
+{
+    static LockProfiler profiler;
+    return profiler;
+}
+
+C_InitializeArgs LockProfiler::init_args()
+{
+    m_active = true;
+
+    // flags are left to 0: the library must use the supplied callbacks, and not its own locking primitives
+    return C_InitializeArgs {
+	&LockProfiler::create_mutex,
+	&LockProfiler::destroy_mutex,
+	&LockProfiler::lock_mutex,
+	&LockProfiler::unlock_mutex,
+	0,
+	nullptr
+    };
+}
+
+LockProfiler::MutexStats LockProfiler::InstrumentedMutex::stats() const
+{
+    return MutexStats { id, acquisitions, contended, wait, hold, max_wait };
+}
+
+void LockProfiler::InstrumentedMutex::reset()
+{
+    acquisitions = 0;
+    contended = 0;
+    wait = 0;
+    hold = 0;
+    max_wait = 0;
+}
+
+CK_RV LockProfiler::create_mutex(VoidPtr *ppMutex)
+{
+    if(!ppMutex) {
+	return CKR_ARGUMENTS_BAD;
+    }
+
+    auto &profiler = instance();
+    std::lock_guard<std::mutex> lck(profiler.m_registry_mtx);
+
+    auto mutex = new InstrumentedMutex(profiler.m_next_id++);
+    profiler.m_mutexes.push_back(mutex);
+    *ppMutex = mutex;
+
+    return CKR_OK;
+}
+
+CK_RV LockProfiler::destroy_mutex(VoidPtr pMutex)
+{
+    auto mutex = static_cast<InstrumentedMutex *>(pMutex);
+    if(!mutex) {
+	return CKR_MUTEX_BAD;
+    }
+
+    auto &profiler = instance();
+    std::lock_guard<std::mutex> lck(profiler.m_registry_mtx);
+
+    auto found = std::find(profiler.m_mutexes.begin(), profiler.m_mutexes.end(), mutex);
+    if(found==profiler.m_mutexes.end()) {
+	return CKR_MUTEX_BAD;
+    }
+
+    // keep statistics of the mutex we destroy
+    auto stats = mutex->stats();
+    profiler.m_retired.acquisitions += stats.acquisitions;
+    profiler.m_retired.contended += stats.contended;
+    profiler.m_retired.wait += stats.wait;
+    profiler.m_retired.hold += stats.hold;
+    profiler.m_retired.max_wait = std::max(profiler.m_retired.max_wait, stats.max_wait);
+
+    profiler.m_mutexes.erase(found);
+    delete mutex;
+
+    return CKR_OK;
+}
+
+CK_RV LockProfiler::lock_mutex(VoidPtr pMutex)
+{
+    auto mutex = static_cast<InstrumentedMutex *>(pMutex);
+    if(!mutex) {
+	return CKR_MUTEX_BAD;
+    }
+
+    // try first without waiting, so that uncontended acquisitions cost a single clock read
+    if(!mutex->mtx.try_lock()) {
+	auto started = now();
+	mutex->mtx.lock();
+	auto waited = now() - started;
+
+	mutex->contended++;
+	mutex->wait += waited;
+
+	auto max_wait = mutex->max_wait.load();
+	while(waited > max_wait && !mutex->max_wait.compare_exchange_weak(max_wait, waited)) {
+	    // retry
+	}
+    }
+
+    mutex->acquisitions++;
+    mutex->locked_at = now();
+
+    return CKR_OK;
+}
+
+CK_RV LockProfiler::unlock_mutex(VoidPtr pMutex)
+{
+    auto mutex = static_cast<InstrumentedMutex *>(pMutex);
+    if(!mutex) {
+	return CKR_MUTEX_BAD;
+    }
+
+    mutex->hold += now() - mutex->locked_at;
+    mutex->mtx.unlock();
+
+    return CKR_OK;
+}
+
+void LockProfiler::reset()
+{
+    std::lock_guard<std::mutex> lck(m_registry_mtx);
+
+    for(auto mutex: m_mutexes) {
+	mutex->reset();
+    }
+    m_retired = MutexStats { 0, 0, 0, 0, 0, 0 };
+}
+
+std::vector<LockProfiler::MutexStats> LockProfiler::snapshot() const
+{
+    std::vector<MutexStats> rv;
+
+    {
+	std::lock_guard<std::mutex> lck(m_registry_mtx);
+
+	for(auto mutex: m_mutexes) {
+	    rv.push_back(mutex->stats());
+	}
+
+	if(m_retired.acquisitions>0) {
+	    rv.push_back(m_retired);
+	}
+    }
+
+    std::sort(rv.begin(), rv.end(), [] (const MutexStats &a, const MutexStats &b) { return a.wait > b.wait; });
+
+    return rv;
+}
+
+LockProfiler::MutexStats LockProfiler::total(const std::vector<MutexStats> &stats)
+{
+    MutexStats rv { 0, 0, 0, 0, 0, 0 };
+
+    for(auto &item: stats) {
+	rv.acquisitions += item.acquisitions;
+	rv.contended += item.contended;
+	rv.wait += item.wait;
+	rv.hold += item.hold;
+	rv.max_wait = std::max(rv.max_wait, item.max_wait);
+    }
+
+    return rv;
+}
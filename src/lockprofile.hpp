@@ -0,0 +1,98 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// lockprofile.hpp: instrumented mutex callbacks, supplied to the PKCS#11 library through C_Initialize(),
+// to measure contention on the locks internal to the library.
+
+#if !defined(LOCKPROFILE_H)
+#define LOCKPROFILE_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <botan/p11.h>
+#include <boost/timer/timer.hpp>
+
+using namespace Botan::PKCS11;
+using boost::timer::nanosecond_type;
+
+class LockProfiler
+{
+public:
+    struct MutexStats {
+	size_t id;		      // creation order, 0 for the aggregate of destroyed mutexes
+	uint64_t acquisitions;
+	uint64_t contended;	      // acquisitions that had to wait
+	nanosecond_type wait;	      // total time spent waiting to acquire
+	nanosecond_type hold;	      // total time held
+	nanosecond_type max_wait;     // longest wait
+    };
+
+private:
+    struct InstrumentedMutex {
+	size_t id;
+	std::mutex mtx;
+	std::atomic<uint64_t> acquisitions { 0 };
+	std::atomic<uint64_t> contended { 0 };
+	std::atomic<nanosecond_type> wait { 0 };
+	std::atomic<nanosecond_type> hold { 0 };
+	std::atomic<nanosecond_type> max_wait { 0 };
+	nanosecond_type locked_at { 0 }; // only accessed by the holder
+
+	InstrumentedMutex(size_t mutex_id) : id(mutex_id) { }
+	MutexStats stats() const;
+	void reset();
+    };
+
+    mutable std::mutex m_registry_mtx;
+    std::vector<InstrumentedMutex *> m_mutexes;
+    MutexStats m_retired { 0, 0, 0, 0, 0, 0 }; // statistics of destroyed mutexes
+    size_t m_next_id { 1 };
+    bool m_active { false };
+
+    LockProfiler() = default;
+
+    static CK_RV create_mutex(VoidPtr *ppMutex);
+    static CK_RV destroy_mutex(VoidPtr pMutex);
+    static CK_RV lock_mutex(VoidPtr pMutex);
+    static CK_RV unlock_mutex(VoidPtr pMutex);
+
+public:
+    LockProfiler(const LockProfiler &) = delete;
+    LockProfiler& operator=(const LockProfiler &) = delete;
+
+    static LockProfiler &instance();
+
+    // init_args(): arguments for C_Initialize(), that force the library to use our callbacks
+    C_InitializeArgs init_args();
+
+    // active(): true once init_args() has been handed out
+    inline bool active() const { return m_active; }
+
+    // reset(): zero all counters, e.g. at the start of a test case
+    void reset();
+
+    // snapshot(): statistics for all mutexes, sorted by decreasing wait time
+    std::vector<MutexStats> snapshot() const;
+
+    // total(): statistics aggregated over all mutexes
+    static MutexStats total(const std::vector<MutexStats> &stats);
+};
+
+#endif // LOCKPROFILE_H
@@ -0,0 +1,83 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include "mechanisms.hpp"
+
+#define MECHANISM_ENTRY(mech) { mech, #mech }
+
+const std::string mechanism(CK_MECHANISM_TYPE mech) {
+    static const std::map<CK_MECHANISM_TYPE, const std::string> mnemonics {
+	MECHANISM_ENTRY(CKM_RSA_PKCS_KEY_PAIR_GEN),
+	MECHANISM_ENTRY(CKM_RSA_PKCS),
+	MECHANISM_ENTRY(CKM_RSA_X_509),
+	MECHANISM_ENTRY(CKM_SHA1_RSA_PKCS),
+	MECHANISM_ENTRY(CKM_RSA_PKCS_OAEP),
+	MECHANISM_ENTRY(CKM_RSA_PKCS_PSS),
+	MECHANISM_ENTRY(CKM_SHA1_RSA_PKCS_PSS),
+	MECHANISM_ENTRY(CKM_SHA256_RSA_PKCS),
+	MECHANISM_ENTRY(CKM_SHA384_RSA_PKCS),
+	MECHANISM_ENTRY(CKM_SHA512_RSA_PKCS),
+	MECHANISM_ENTRY(CKM_SHA256_RSA_PKCS_PSS),
+	MECHANISM_ENTRY(CKM_SHA384_RSA_PKCS_PSS),
+	MECHANISM_ENTRY(CKM_SHA512_RSA_PKCS_PSS),
+	MECHANISM_ENTRY(CKM_DES2_KEY_GEN),
+	MECHANISM_ENTRY(CKM_DES3_KEY_GEN),
+	MECHANISM_ENTRY(CKM_DES3_ECB),
+	MECHANISM_ENTRY(CKM_DES3_CBC),
+	MECHANISM_ENTRY(CKM_DES3_MAC),
+	MECHANISM_ENTRY(CKM_DES3_CBC_PAD),
+	MECHANISM_ENTRY(CKM_SHA_1),
+	MECHANISM_ENTRY(CKM_SHA_1_HMAC),
+	MECHANISM_ENTRY(CKM_SHA256),
+	MECHANISM_ENTRY(CKM_SHA256_HMAC),
+	MECHANISM_ENTRY(CKM_SHA384),
+	MECHANISM_ENTRY(CKM_SHA384_HMAC),
+	MECHANISM_ENTRY(CKM_SHA512),
+	MECHANISM_ENTRY(CKM_SHA512_HMAC),
+	MECHANISM_ENTRY(CKM_GENERIC_SECRET_KEY_GEN),
+	MECHANISM_ENTRY(CKM_XOR_BASE_AND_DATA),
+	MECHANISM_ENTRY(CKM_EC_KEY_PAIR_GEN),
+	MECHANISM_ENTRY(CKM_ECDSA),
+	MECHANISM_ENTRY(CKM_ECDSA_SHA1),
+	MECHANISM_ENTRY(CKM_ECDH1_DERIVE),
+	MECHANISM_ENTRY(CKM_ECDH1_COFACTOR_DERIVE),
+	MECHANISM_ENTRY(CKM_AES_KEY_GEN),
+	MECHANISM_ENTRY(CKM_AES_ECB),
+	MECHANISM_ENTRY(CKM_AES_CBC),
+	MECHANISM_ENTRY(CKM_AES_MAC),
+	MECHANISM_ENTRY(CKM_AES_CBC_PAD),
+	MECHANISM_ENTRY(CKM_AES_CTR),
+	MECHANISM_ENTRY(CKM_AES_GCM),
+	MECHANISM_ENTRY(CKM_AES_CCM),
+	MECHANISM_ENTRY(CKM_AES_CMAC),
+	MECHANISM_ENTRY(CKM_AES_KEY_WRAP),
+	MECHANISM_ENTRY(CKM_AES_KEY_WRAP_PAD),
+    };
+
+    auto match = mnemonics.find(mech);
+    if(match!=mnemonics.end()) {
+	return match->second;
+    }
+
+    std::ostringstream stream;
+    stream << "0x" << std::hex << std::setw(8) << std::setfill('0') << mech;
+    return stream.str();
+}
@@ -0,0 +1,370 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// metrics.cpp: expose running statistics in the Prometheus text format
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "metrics.hpp"
+#include "errorcodes.hpp"
+
+// the textfile is rewritten that often
+static constexpr auto file_interval = std::chrono::seconds(5);
+
+// upper bounds of exported latency buckets, in seconds and in ns.
+// as values are taken from the log-linear histogram, bucket boundaries are known within 6%
+static const std::vector<std::pair<std::string, uint64_t> > bounds {
+    { "0.00001", 10000ULL },
+    { "0.000025", 25000ULL },
+    { "0.00005", 50000ULL },
+    { "0.0001", 100000ULL },
+    { "0.00025", 250000ULL },
+    { "0.0005", 500000ULL },
+    { "0.001", 1000000ULL },
+    { "0.0025", 2500000ULL },
+    { "0.005", 5000000ULL },
+    { "0.01", 10000000ULL },
+    { "0.025", 25000000ULL },
+    { "0.05", 50000000ULL },
+    { "0.1", 100000000ULL },
+    { "0.25", 250000000ULL },
+    { "0.5", 500000000ULL },
+    { "1.0", 1000000000ULL },
+    { "2.5", 2500000000ULL },
+    { "5.0", 5000000000ULL },
+    { "10.0", 10000000000ULL },
+};
+
+static std::string escape(const std::string &value)
+{
+    std::string escaped;
+    for(auto c: value) {
+	switch(c) {
+	case '\\': escaped += "\\\\"; break;
+	case '"':  escaped += "\\\""; break;
+	case '\n': escaped += "\\n"; break;
+	default:   escaped += c;
+	}
+    }
+    return escaped;
+}
+
+
+MetricsExporter::MetricsExporter(std::optional<uint16_t> port, std::optional<std::string> file)
+    : m_file(file)
+{
+    if(port) {
+	m_listen = socket(AF_INET, SOCK_STREAM, 0);
+	if(m_listen<0) {
+	    throw std::runtime_error(std::string("cannot create socket: ") + std::strerror(errno));
+	}
+
+	int on = 1;
+	setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+
+	struct sockaddr_in addr {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(*port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // never exposed beyond the host
+
+	if(bind(m_listen, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr)!=0 || listen(m_listen, 8)!=0) {
+	    auto reason = std::strerror(errno);
+	    close(m_listen);
+	    throw std::runtime_error("cannot listen on 127.0.0.1:" + std::to_string(*port) + ": " + reason);
+	}
+    }
+
+    if(port || file) {
+	m_thread = std::thread(&MetricsExporter::loop, this);
+    }
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    m_stop = true;
+    if(m_thread.joinable()) {
+	m_thread.join();
+    }
+    if(m_listen>=0) {
+	close(m_listen);
+    }
+    if(m_file) {
+	write_file();		// last values
+    }
+}
+
+void MetricsExporter::attach(const std::string &testcase, const std::string &label, size_t payload, const std::vector<LiveCounters *> &counters)
+{
+    std::lock_guard<std::mutex> lck(m_mtx);
+    m_current = Key { testcase, label, payload };
+    m_counters = counters;
+}
+
+void MetricsExporter::detach()
+{
+    std::lock_guard<std::mutex> lck(m_mtx);
+    if(!m_current) {
+	return;
+    }
+
+    auto &series = m_totals[*m_current];
+    if(!series) {
+	series.reset(new Series);
+    }
+
+    for(auto counters: m_counters) {
+	series->latency.add(counters->latency);
+	series->errors += counters->errors.load(std::memory_order_relaxed);
+	for(size_t i=0; i<LiveCounters::error_slots; i++) {
+	    auto code = counters->error_codes[i].load(std::memory_order_acquire);
+	    if(code!=0) {
+		series->error_codes[code] += counters->error_counts[i].load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    m_current.reset();
+    m_counters.clear();
+}
+
+std::string MetricsExporter::render(bool openmetrics)
+{
+    std::lock_guard<std::mutex> lck(m_mtx);
+
+    // snapshot of every series, with the running test case added to its totals
+    struct Snapshot {
+	std::vector<uint64_t> buckets; // cumulative, one per bound
+	uint64_t count { 0 };
+	uint64_t sum { 0 };
+	uint64_t errors { 0 };
+	std::map<uint64_t, uint64_t> error_codes;
+	uint32_t inflight { 0 };
+    };
+
+    std::map<Key, Snapshot> snapshots;
+
+    auto add_histogram = [](Snapshot &snapshot, const Histogram &histogram) {
+	size_t bound = 0;
+	for(size_t i=0; i<Histogram::buckets; i++) {
+	    auto c = histogram.bucket(i);
+	    if(c==0) {
+		continue;
+	    }
+	    // highest value of the bucket
+	    auto upper = Histogram::lower(i) + Histogram::width(i) - 1;
+	    while(bound<bounds.size() && bounds[bound].second < upper) {
+		bound++;
+	    }
+	    if(bound<bounds.size()) {
+		snapshot.buckets[bound] += c;
+	    }
+	    snapshot.count += c;	// taken from buckets, for +Inf to match _count
+	}
+	snapshot.sum += histogram.sum();
+    };
+
+    for(auto &[key, series]: m_totals) {
+	auto &snapshot = snapshots[key];
+	snapshot.buckets.resize(bounds.size());
+	add_histogram(snapshot, series->latency);
+	snapshot.errors = series->errors;
+	snapshot.error_codes = series->error_codes;
+    }
+
+    if(m_current) {
+	auto &snapshot = snapshots[*m_current];
+	snapshot.buckets.resize(bounds.size());
+	for(auto counters: m_counters) {
+	    add_histogram(snapshot, counters->latency);
+	    snapshot.errors += counters->errors.load(std::memory_order_relaxed);
+	    for(size_t i=0; i<LiveCounters::error_slots; i++) {
+		auto code = counters->error_codes[i].load(std::memory_order_acquire);
+		if(code!=0) {
+		    snapshot.error_codes[code] += counters->error_counts[i].load(std::memory_order_relaxed);
+		}
+	    }
+	    snapshot.inflight += counters->inflight.load(std::memory_order_relaxed);
+	}
+    }
+
+    // labels common to all samples of a series
+    auto labels = [](const Key &key) {
+	std::ostringstream out;
+	out << "testcase=\"" << escape(std::get<0>(key)) << "\",label=\"" << escape(std::get<1>(key))
+	    << "\",payload=\"" << std::get<2>(key) << '"';
+	return out.str();
+    };
+
+    // counters are named without their _total suffix in OpenMetrics metadata
+    auto family = [openmetrics](const std::string &name, const std::string &type, const std::string &help) {
+	auto metadata = openmetrics && type=="counter" ? name.substr(0, name.size() - 6) : name;
+	return "# HELP " + metadata + ' ' + help + "\n# TYPE " + metadata + ' ' + type + '\n';
+    };
+
+    std::ostringstream out;
+
+    out << family("p11perftest_operations_total", "counter", "Successful PKCS#11 calls measured.");
+    for(auto &[key, snapshot]: snapshots) {
+	out << "p11perftest_operations_total{" << labels(key) << "} " << snapshot.count << '\n';
+    }
+
+    out << family("p11perftest_errors_total", "counter", "Failed PKCS#11 calls, by return code.");
+    for(auto &[key, snapshot]: snapshots) {
+	uint64_t other = snapshot.errors;
+	for(auto &[code, count]: snapshot.error_codes) {
+	    out << "p11perftest_errors_total{" << labels(key) << ",code=\"" << errorcode(static_cast<int>(code)) << "\"} " << count << '\n';
+	    other -= count < other ? count : other;
+	}
+	// codes beyond the tracked ones, if any
+	if(other>0) {
+	    out << "p11perftest_errors_total{" << labels(key) << ",code=\"other\"} " << other << '\n';
+	}
+    }
+
+    out << family("p11perftest_latency_seconds", "histogram", "Latency of successful PKCS#11 calls.");
+    for(auto &[key, snapshot]: snapshots) {
+	uint64_t cumulative = 0;
+	for(size_t b=0; b<bounds.size(); b++) {
+	    cumulative += snapshot.buckets[b];
+	    out << "p11perftest_latency_seconds_bucket{" << labels(key) << ",le=\"" << bounds[b].first << "\"} " << cumulative << '\n';
+	}
+	out << "p11perftest_latency_seconds_bucket{" << labels(key) << ",le=\"+Inf\"} " << snapshot.count << '\n'
+	    << "p11perftest_latency_seconds_sum{" << labels(key) << "} " << std::setprecision(9) << snapshot.sum / 1e9 << '\n'
+	    << "p11perftest_latency_seconds_count{" << labels(key) << "} " << snapshot.count << '\n';
+    }
+
+    out << family("p11perftest_inflight", "gauge", "PKCS#11 calls in progress.");
+    for(auto &[key, snapshot]: snapshots) {
+	out << "p11perftest_inflight{" << labels(key) << "} " << snapshot.inflight << '\n';
+    }
+
+    if(openmetrics) {
+	out << "# EOF\n";
+    }
+
+    return out.str();
+}
+
+void MetricsExporter::loop()
+{
+    auto next_write = std::chrono::steady_clock::now();
+
+    while(!m_stop) {
+	if(m_listen>=0) {
+	    struct pollfd pfd { m_listen, POLLIN, 0 };
+	    if(poll(&pfd, 1, 500)>0) {
+		int fd = accept(m_listen, nullptr, nullptr);
+		if(fd>=0) {
+		    serve(fd);
+		    close(fd);
+		}
+	    }
+	} else {
+	    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+
+	if(m_file && std::chrono::steady_clock::now() >= next_write) {
+	    write_file();
+	    next_write = std::chrono::steady_clock::now() + file_interval;
+	}
+    }
+}
+
+// serve(): answer a single HTTP request, then close the connection
+void MetricsExporter::serve(int fd)
+{
+    // do not let a stuck client block the exporter
+    struct timeval timeout { 2, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+
+    std::string request;
+    char buffer[1024];
+    while(request.find("\r\n\r\n")==std::string::npos && request.size() < 8192) {
+	auto received = recv(fd, buffer, sizeof buffer, 0);
+	if(received<=0) {
+	    return;
+	}
+	request.append(buffer, received);
+    }
+
+    std::istringstream lines(request);
+    std::string method, path;
+    lines >> method >> path;
+
+    std::string status, content_type, body;
+    if(method!="GET") {
+	status = "405 Method Not Allowed";
+    } else if(path!="/metrics" && path!="/") {
+	status = "404 Not Found";
+    } else {
+	// OpenMetrics when the scraper asks for it, as Prometheus does
+	bool openmetrics = request.find("application/openmetrics-text")!=std::string::npos;
+	status = "200 OK";
+	content_type = openmetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain; version=0.0.4; charset=utf-8";
+	body = render(openmetrics);
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n";
+    if(!content_type.empty()) {
+	response << "Content-Type: " << content_type << "\r\n";
+    }
+    response << "Content-Length: " << body.size() << "\r\n"
+	     << "Connection: close\r\n\r\n"
+	     << body;
+
+    auto data = response.str();
+    size_t sent = 0;
+    while(sent < data.size()) {
+	auto written = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+	if(written<=0) {
+	    return;
+	}
+	sent += written;
+    }
+}
+
+// write_file(): write to a temporary file, then rename it, so that the collector never reads a partial file
+void MetricsExporter::write_file()
+{
+    auto tmp = *m_file + ".tmp";
+    {
+	std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+	out << render();
+	if(!out) {
+	    std::cerr << "Warning: cannot write metrics to " << tmp << std::endl;
+	    return;
+	}
+    }
+    if(std::rename(tmp.c_str(), m_file->c_str())!=0) {
+	std::cerr << "Warning: cannot rename " << tmp << " to " << *m_file << std::endl;
+    }
+}
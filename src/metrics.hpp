@@ -0,0 +1,83 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// metrics.hpp: expose running statistics in the Prometheus text format (or OpenMetrics),
+// over HTTP on localhost, and/or in a file for the textfile collector of node_exporter.
+//
+// Series are labelled by test case, key label and payload size. Totals of completed runs are kept,
+// and the counters of the running test case are added to them whenever metrics are rendered.
+
+#if !defined(METRICS_H)
+#define METRICS_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "counters.hpp"
+
+class MetricsExporter
+{
+    using Key = std::tuple<std::string, std::string, size_t>; // test case, key label, payload size
+
+    struct Series {
+	Histogram latency;
+	uint64_t errors { 0 };
+	std::map<uint64_t, uint64_t> error_codes;
+    };
+
+    std::optional<std::string> m_file;
+    int m_listen { -1 };		// listening socket, if any
+
+    std::mutex m_mtx;
+    std::map<Key, std::unique_ptr<Series> > m_totals;
+    std::optional<Key> m_current;
+    std::vector<LiveCounters *> m_counters; // of the running test case
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop { false };
+
+    void loop();
+    void serve(int fd);
+    void write_file();
+
+public:
+    // port: TCP port to listen to, on 127.0.0.1. file: path of a file refreshed every few seconds.
+    // throws std::runtime_error if the port cannot be bound.
+    MetricsExporter(std::optional<uint16_t> port, std::optional<std::string> file);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter& operator=(const MetricsExporter &) = delete;
+
+    // attach(): counters of a test case about to run, they must stay valid until detach()
+    void attach(const std::string &testcase, const std::string &label, size_t payload, const std::vector<LiveCounters *> &counters);
+
+    // detach(): add counters of the test case that just ran to totals, and forget them
+    void detach();
+
+    // render(): metrics in the Prometheus text format (version 0.0.4), or OpenMetrics 1.0.0
+    std::string render(bool openmetrics = false);
+};
+
+#endif // METRICS_H
@@ -17,6 +17,7 @@
 //
 
 #include "p11aescbc.hpp"
+#include "swbaseline.hpp"
 
 
 P11AESCBCBenchmark::P11AESCBCBenchmark(const std::string &label) :
@@ -31,6 +32,21 @@ inline P11AESCBCBenchmark *P11AESCBCBenchmark::clone() const {
     return new P11AESCBCBenchmark{*this};
 }
 
+P11Benchmark *P11AESCBCBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::AESCBC, label() );
+}
+
+std::optional<size_t> P11AESCBCBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // decryption is replayed as encryption
+    if((function=="C_Encrypt" || function=="C_Decrypt") && mechanism==CKM_AES_CBC) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11AESCBCBenchmark::requirements() const {
+    return { { CKM_AES_CBC, CKF_ENCRYPT, keybytes() },
+	     { CKM_AES_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 
 void P11AESCBCBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
@@ -31,6 +31,9 @@ class P11AESCBCBenchmark : public P11Benchmark
     virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
     virtual void crashtestdummy( Session &session) override;
     virtual P11AESCBCBenchmark *clone() const override;
+    virtual P11Benchmark *swbaseline() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+    virtual std::vector<requirement_t> requirements() const override;
 
 public:
 
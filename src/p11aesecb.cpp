@@ -17,6 +17,7 @@
 //
 
 #include "p11aesecb.hpp"
+#include "swbaseline.hpp"
 
 
 P11AESECBBenchmark::P11AESECBBenchmark(const std::string &label) :
@@ -27,6 +28,21 @@ inline P11AESECBBenchmark *P11AESECBBenchmark::clone() const {
 	return new P11AESECBBenchmark{*this};
 }
 
+P11Benchmark *P11AESECBBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::AESECB, label() );
+}
+
+std::optional<size_t> P11AESECBBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // decryption is replayed as encryption
+    if((function=="C_Encrypt" || function=="C_Decrypt") && mechanism==CKM_AES_ECB) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11AESECBBenchmark::requirements() const {
+    return { { CKM_AES_ECB, CKF_ENCRYPT, keybytes() },
+	     { CKM_AES_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 
 void P11AESECBBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
@@ -19,6 +19,7 @@
 // p11aesgcm: AES Gallois Counter Mode
 
 #include "p11aesgcm.hpp"
+#include "swbaseline.hpp"
 #include <iostream>
 #include <random>
 #include <algorithm>
@@ -35,6 +36,22 @@ inline P11AESGCMBenchmark *P11AESGCMBenchmark::clone() const {
     return new P11AESGCMBenchmark{*this};
 }
 
+P11Benchmark *P11AESGCMBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::AESGCM, label() );
+}
+
+std::optional<size_t> P11AESGCMBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // decryption is replayed as encryption, of the ciphertext without its tag
+    if(function=="C_Encrypt" && mechanism==CKM_AES_GCM) return payload;
+    if(function=="C_Decrypt" && mechanism==CKM_AES_GCM) return payload > 16 ? payload - 16 : payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11AESGCMBenchmark::requirements() const {
+    return { { CKM_AES_GCM, CKF_ENCRYPT, keybytes() },
+	     { CKM_AES_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 
 void P11AESGCMBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
@@ -104,12 +121,23 @@ void P11AESGCMBenchmark::prepare(Session &session, Object &obj, std::optional<si
     }
 
     m_objhandle = obj.handle();
+
+    // check the output layout once, before the timed loop: with the wrong flavour,
+    // the buffer would be sized for another layout, and measures would be silently wrong
+    crashtestdummy(session);
+
+    if(m_returned_len < m_payload.size()
+       || Implementation::gcm_overhead(flavour()).count(m_returned_len - m_payload.size())==0) {
+	std::cerr << "Error: CKM_AES_GCM returned " << m_returned_len << " bytes for a payload of " << m_payload.size()
+		  << " bytes, which does not match the " << Implementation::name(flavour()) << " flavour (check --flavour)\n";
+	throw Botan::PKCS11::PKCS11_ReturnError(ReturnValue::FunctionFailed); // reported as a failure of this test case only
+    }
 }
 
 void P11AESGCMBenchmark::crashtestdummy(Session &session)
 {
-    Ulong returned_len=m_encrypted.size();
-    
+    m_returned_len = m_encrypted.size();
+
     switch(flavour()) {
     case Implementation::Vendor::utimaco:
     case Implementation::Vendor::entrust:
@@ -122,5 +150,5 @@ void P11AESGCMBenchmark::crashtestdummy(Session &session)
     }
 
     session.module()->C_EncryptInit(session.handle(), &m_mech_aes_gcm, m_objhandle);
-    session.module()->C_Encrypt( session.handle(), m_payload.data(), m_payload.size(), m_encrypted.data(), &returned_len);
+    session.module()->C_Encrypt( session.handle(), m_payload.data(), m_payload.size(), m_encrypted.data(), &m_returned_len);
 }
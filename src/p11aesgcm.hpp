@@ -39,11 +39,15 @@ class P11AESGCMBenchmark : public P11Benchmark
     Mechanism m_mech_aes_gcm { CKM_AES_GCM, &m_gcm_params, sizeof m_gcm_params };
 
     std::vector<uint8_t> m_encrypted;
+    Ulong m_returned_len { 0 };	// returned by the last call to C_Encrypt()
     ObjectHandle  m_objhandle;
 
     virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
     virtual void crashtestdummy( Session &session) override;
     virtual P11AESGCMBenchmark *clone() const override;
+    virtual P11Benchmark *swbaseline() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+    virtual std::vector<requirement_t> requirements() const override;
 
 public:
 
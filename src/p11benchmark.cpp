@@ -24,6 +24,11 @@
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+#include <ctime>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/mean.hpp>
@@ -39,13 +44,21 @@ extern bool greenlight;
 
 static std::mutex display_mtx;
 
+// CPU time consumed by the calling thread
+static nanosecond_type thread_cputime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<nanosecond_type>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
 
 P11Benchmark::P11Benchmark(const std::string &name, const std::string &label, ObjectClass objectclass, const Implementation::Vendor vendor)
     : m_name(name), m_label(label), m_objectclass(objectclass), m_implementation(Implementation(vendor))
 { }
 
 P11Benchmark::P11Benchmark(const P11Benchmark& other)
-    : m_name(other.m_name), m_label(other.m_label), m_objectclass(other.m_objectclass), m_implementation(other.m_implementation)
+    : m_name(other.m_name), m_label(other.m_label), m_objectclass(other.m_objectclass), m_implementation(other.m_implementation), m_keyset(other.m_keyset)
 {
     // std::cout << "copy constructor invoked for " << m_name << std::endl;
 }
@@ -56,6 +69,7 @@ P11Benchmark& P11Benchmark::operator=(const P11Benchmark& other)
     m_name = other.m_name;
     m_label = other.m_label;
     m_objectclass = other.m_objectclass;
+    m_keyset = other.m_keyset;
     return *this;
 }
 
@@ -69,9 +83,13 @@ std::string P11Benchmark::features() const
 std::string P11Benchmark::build_threaded_label(std::optional<size_t> threadindex) {
     std::string label;
 
-    // if threadindex has a value, it means we have generated session keys (one per thread)
+    // if threadindex has a value, it means we have generated session keys (one per thread, or shared)
     // in which case we need to recreate the thread-specific key label
-    if(threadindex) {
+    if(threadindex && m_keyset.shared>0) {
+	std::stringstream shared_label;
+	shared_label << this->label() << "-sh-" << std::setw(5) << std::setfill('0') << threadindex.value() % m_keyset.shared;
+	label = shared_label.str();
+    } else if(threadindex) {
 	std::stringstream thread_specific_label;
 	thread_specific_label << this->label() << "-th-" << std::setw(5) << std::setfill('0') << threadindex.value();
 	label = thread_specific_label.str();
@@ -79,61 +97,327 @@ std::string P11Benchmark::build_threaded_label(std::optional<size_t> threadindex
 	label = this->label();
     }
 
+    // a key of the keyset
+    if(m_keyindex) {
+	std::stringstream key_specific_label;
+	key_specific_label << label << "-key-" << std::setw(5) << std::setfill('0') << m_keyindex.value();
+	label = key_specific_label.str();
+    }
+
+    // generated as a persistent key
+    if(threadindex && m_keyset.persistent) {
+	label = keyset_t::persistent_prefix + label;
+    }
+
     return label;
 }
 
 
-benchmark_result_t P11Benchmark::execute(Session *session, const std::vector<uint8_t> &payload, size_t iterations, size_t skipiterations, std::optional<size_t> threadindex)
+// keybits(): key size or curve size found in the label, i.e. the first number with 3 digits or more
+std::optional<Ulong> P11Benchmark::keybits() const
 {
-    int return_code = CKR_OK;
-    std::vector<nanosecond_type> records(iterations);
+    auto &label = m_label;
 
-    try {
-	auto label = build_threaded_label(threadindex); // build threaded label (if needed)
+    for(size_t i=0; i<label.size(); ) {
+	if(!std::isdigit(static_cast<unsigned char>(label[i]))) {
+	    i++;
+	    continue;
+	}
+	auto j = i;
+	while(j<label.size() && std::isdigit(static_cast<unsigned char>(label[j]))) {
+	    j++;
+	}
+	if(j-i>=3) {
+	    return static_cast<Ulong>(std::stoul(label.substr(i, j-i)));
+	}
+	i = j;
+    }
+
+    return std::nullopt;
+}
 
-	m_payload = payload;	// remember the payload
 
-	AttributeContainer search_template;
-	search_template.add_string( AttributeType::Label, label );
-	search_template.add_class( m_objectclass );
+// session_lost(): return codes after which the session must be reopened
+static bool session_lost(int rc)
+{
+    switch(rc) {
+    case CKR_SESSION_HANDLE_INVALID:
+    case CKR_SESSION_CLOSED:
+    case CKR_DEVICE_REMOVED:
+    case CKR_TOKEN_NOT_PRESENT:
+    case CKR_USER_NOT_LOGGED_IN:
+	return true;
 
-	auto found_objs = Object::search<Object>( *session, search_template.attributes() );
+    default:
+	return false;
+    }
+}
 
-	if( found_objs.size()==0 ) {
-	    std::cerr << "Error: no object found for label '" << label << "'" << std::endl;
-	} else	if( found_objs.size()>1 ) {
-	    std::cerr << "Error: more than one object found for label '" << label << "'" << std::endl;
-	} else {
-	    for (auto &obj: found_objs) {
 
-		prepare(*session, obj, threadindex);
+void P11Benchmark::timed_loop(Session *session, benchmark_result_t &result, size_t iterations, size_t skipiterations, bool keep_going, const recovery_t *recovery, SampleWriter *samples, LiveCounters *live)
+{
+    boost::timer::cpu_times started;
 
-		boost::timer::cpu_times started;
+    started.clear();
 
-		started.clear();
+    // wait for green light - all threads are starting together
+    {
+	std::unique_lock<std::mutex> greenlight_lck(greenlight_mtx);
+	greenlight_cond.wait(greenlight_lck,[]{ return greenlight; });
+    }
 
-		// wait for green light - all threads are starting together
-		{
-		    std::unique_lock<std::mutex> greenlight_lck(greenlight_mtx);
-		    greenlight_cond.wait(greenlight_lck,[]{ return greenlight; });
-		}
+    // ok go now!
 
-		// ok go now!
+    // first run iterations that are skipped, i.e. not taken into account for stats
+    for (size_t i=0; i<skipiterations; i++) {
+	auto &target = pick_key();
+	try {
+	    target.crashtestdummy(*session);
+	} catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	    if(recovery && session_lost(bexc.error_code())) {
+		auto recovered = recover(*recovery);
+		if(!recovered) throw;
+		session = recovered;
+		continue;
+	    }
+	    if(!keep_going) throw;
+	    target.cleanup_failed(*session);
+	    continue;		// not accounted for, like any skipped iteration
+	}
+	target.cleanup(*session); // cleanup any created object (e.g. unwrapped or derived keys)
+    }
 
-		// first run iterations that are skipped, i.e. not taken into account for stats
-		for (size_t i=0; i<skipiterations; i++) {
-		    crashtestdummy(*session);
-		    cleanup(*session); // cleanup any created object (e.g. unwrapped or derived keys)
-		}
-		for (size_t i=0; i<iterations; i++) {
-		    m_t.start(); // start timer
-		    started.wall = m_t.elapsed().wall; // remember wall clock
-		    crashtestdummy(*session);
-		    m_t.stop(); // stop timer
-		    cleanup(*session); // cleanup any created object (e.g. unwrapped or derived keys)
-		    records.at(i) = m_t.elapsed().wall - started.wall;
+    auto origin = std::chrono::steady_clock::now(); // start of the timeline
+
+    for (size_t i=0; i<iterations; i++) {
+	// thread CPU time and start timestamp are sampled outside of the wall clock window, not to inflate latency
+	auto cpu_started = thread_cputime();
+	auto timestamp = samples ? monotonic_ns() : 0;
+	auto &target = pick_key();
+	if(live) {
+	    live->inflight.store(1, std::memory_order_relaxed);
+	}
+	m_t.start(); // start timer
+	started.wall = m_t.elapsed().wall; // remember wall clock
+	try {
+	    target.crashtestdummy(*session);
+	} catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	    m_t.stop();
+	    auto lost = std::chrono::steady_clock::now();
+	    auto elapsed = m_t.elapsed().wall - started.wall;
+	    if(samples) {
+		samples->record(timestamp, elapsed, bexc.error_code());
+	    }
+	    if(live) {
+		live->error(bexc.error_code());
+		live->inflight.store(0, std::memory_order_relaxed);
+	    }
+	    if(recovery && session_lost(bexc.error_code())) {
+		// time to recover spans from the start of the failed call, until calls can be made again
+		auto recovered = recover(*recovery);
+		if(!recovered) throw;
+		session = recovered;
+		result.recoveries.push_back(elapsed + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - lost).count());
+	    } else if(!keep_going) {
+		throw;
+	    }
+	    if(keep_going) {
+		// the failed call is accounted for separately, and we move on.
+		// objects created before the failure are released, unless the session was lost with them
+		result.failed.add(elapsed);
+		result.errors[bexc.error_code()]++;
+		if(!session_lost(bexc.error_code())) {
+		    target.cleanup_failed(*session);
 		}
 	    }
+	    continue;
+	}
+	m_t.stop(); // stop timer
+	auto cputime = thread_cputime() - cpu_started;
+	target.cleanup(*session); // cleanup any created object (e.g. unwrapped or derived keys)
+	auto elapsed = m_t.elapsed().wall - started.wall;
+
+	result.latency.add(elapsed);
+	result.cputime.add(cputime);
+	result.serial.add(elapsed);
+	result.histogram->record(elapsed);
+	if(samples) {
+	    samples->record(timestamp, elapsed, CKR_OK);
+	}
+	if(live) {
+	    live->latency.record(elapsed);
+	    live->inflight.store(0, std::memory_order_relaxed);
+	}
+	if(recovery) {
+	    size_t bin = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count() / benchmark_result_t::timeline_bin;
+	    if(bin >= result.timeline.size()) {
+		result.timeline.resize(bin+1);
+	    }
+	    result.timeline[bin]++;
+	}
+    }
+}
+
+
+// cleanup_failed(): cleanup() after a failed call, when keeping going. errors are ignored,
+// as the objects to destroy may not have been created
+void P11Benchmark::cleanup_failed(Session &session)
+{
+    try {
+	cleanup(session);
+    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	// nothing to do
+    }
+}
+
+
+Session *P11Benchmark::recover(const recovery_t &recovery)
+{
+    auto deadline = std::chrono::steady_clock::now() + recovery.timeout;
+    auto backoff = std::chrono::milliseconds(10);
+
+    for(;;) {
+	try {
+	    auto session = recovery.reopen();
+	    // if the key cannot be found, there is no point in trying again
+	    return setup(session, m_payload, m_threadindex) ? session : nullptr;
+	} catch (Botan::PKCS11::PKCS11_ReturnError &) {
+	    // the token is still unreachable, wait and retry
+	}
+
+	if(std::chrono::steady_clock::now() + backoff > deadline) {
+	    std::lock_guard<std::mutex> lg{display_mtx};
+	    std::cerr << "ERROR: could not recover session within " << recovery.timeout.count() << "ms" << std::endl;
+	    return nullptr;
+	}
+	std::this_thread::sleep_for(backoff);
+	backoff = std::min(backoff * 2, std::chrono::milliseconds(1000));
+    }
+}
+
+
+bool P11Benchmark::prepare_key(Session *session, P11Benchmark &target, std::optional<size_t> threadindex)
+{
+    if(!target.requires_key()) {
+	Object nokey(*session, CK_INVALID_HANDLE);
+
+	target.prepare(*session, nokey, threadindex);
+	return true;
+    }
+
+    auto label = target.build_threaded_label(threadindex); // build threaded label (if needed)
+
+    AttributeContainer search_template;
+    search_template.add_string( AttributeType::Label, label );
+    search_template.add_class( target.m_objectclass );
+
+    auto found_objs = Object::search<Object>( *session, search_template.attributes() );
+
+    if( found_objs.size()==0 ) {
+	std::cerr << "Error: no object found for label '" << label << "'" << std::endl;
+    } else	if( found_objs.size()>1 ) {
+	std::cerr << "Error: more than one object found for label '" << label << "'" << std::endl;
+    } else {
+	target.prepare(*session, found_objs.front(), threadindex);
+	return true;
+    }
+
+    return false;
+}
+
+
+bool P11Benchmark::setup(Session *session, const std::vector<uint8_t> &payload, std::optional<size_t> threadindex)
+{
+    m_payload = payload;	// remember the payload
+    m_threadindex = threadindex;
+    m_keys.clear();
+
+    if(!requires_key() || m_keyset.count<=1) {
+	return prepare_key(session, *this, threadindex);
+    }
+
+    // several keys per thread: each key is prepared on its own clone, timed with our timer
+    for(size_t k=0; k<m_keyset.count; k++) {
+	std::unique_ptr<P11Benchmark> key { clone() };
+
+	key->m_payload = payload;
+	key->m_keyindex = k;
+	key->m_timer = &m_t;
+	if(!prepare_key(session, *key, threadindex)) {
+	    m_keys.clear();
+	    return false;
+	}
+	m_keys.push_back(std::move(key));
+    }
+
+    m_pick_rng.seed(threadindex.value_or(0));
+    m_pick_next = 0;
+
+    if(m_keyset.pick==keyset_t::Pick::Zipf) {
+	double sum = 0.0;
+	m_zipf_cdf.resize(m_keys.size());
+	for(size_t k=0; k<m_keys.size(); k++) {
+	    sum += 1.0 / std::pow(static_cast<double>(k+1), m_keyset.exponent);
+	    m_zipf_cdf[k] = sum;
+	}
+	for(auto &p: m_zipf_cdf) {
+	    p /= sum;
+	}
+    }
+
+    return true;
+}
+
+
+P11Benchmark &P11Benchmark::pick_key()
+{
+    if(m_keys.empty()) {
+	return *this;
+    }
+
+    size_t k = 0;
+    switch(m_keyset.pick) {
+    case keyset_t::Pick::RoundRobin:
+	k = m_pick_next++ % m_keys.size();
+	break;
+
+    case keyset_t::Pick::Uniform:
+	k = std::uniform_int_distribution<size_t>(0, m_keys.size()-1)(m_pick_rng);
+	break;
+
+    case keyset_t::Pick::Zipf: {
+	auto u = std::uniform_real_distribution<double>(0.0, 1.0)(m_pick_rng);
+	k = std::min(static_cast<size_t>(std::lower_bound(m_zipf_cdf.begin(), m_zipf_cdf.end(), u) - m_zipf_cdf.begin()), m_keys.size()-1);
+	break;
+    }
+    }
+
+    return *m_keys[k];
+}
+
+
+nanosecond_type P11Benchmark::timed_call(Session &session)
+{
+    auto &target = pick_key();
+    m_t.start();
+    auto started = m_t.elapsed().wall;
+    target.crashtestdummy(session);
+    m_t.stop();
+    target.cleanup(session);
+    return m_t.elapsed().wall - started;
+}
+
+
+benchmark_result_t P11Benchmark::execute(Session *session, const std::vector<uint8_t> &payload, size_t iterations, size_t skipiterations, std::optional<size_t> threadindex, bool keep_going, const recovery_t *recovery, SampleWriter *samples, LiveCounters *live)
+{
+    benchmark_result_t result;
+
+    // consecutive samples are grouped in batches of sqrt(iterations), to estimate serial correlation
+    result.serial = SerialAccumulator(static_cast<size_t>(std::sqrt(static_cast<double>(iterations))));
+
+    try {
+	if(setup(session, payload, threadindex)) {
+	    timed_loop(session, result, iterations, skipiterations, keep_going, recovery, samples, live);
 	}
     } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
 	{
@@ -141,7 +425,7 @@ benchmark_result_t P11Benchmark::execute(Session *session, const std::vector<uin
 	    std::cerr << "ERROR:: " << bexc.what()
 		      << " (" << errorcode(bexc.error_code()) << ")" << std::endl;
 	}
-	return_code = bexc.error_code();
+	result.errcode = bexc.error_code();
 	// we print the exception, and move on
     } catch (...) {
 	{
@@ -152,5 +436,5 @@ benchmark_result_t P11Benchmark::execute(Session *session, const std::vector<uin
 	throw;
     }
 
-    return std::make_pair( std::move(records), return_code );
+    return result;
 }
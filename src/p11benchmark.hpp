@@ -20,8 +20,13 @@
 #define P11BENCHMARK_H
 
 #include <forward_list>
+#include <map>
+#include <chrono>
+#include <functional>
 #include <optional>
 #include <utility>
+#include <memory>
+#include <random>
 #include <botan/auto_rng.h>
 #include <botan/p11_types.h>
 #include <botan/p11_object.h>
@@ -30,12 +35,62 @@
 #include <botan/pubkey.h>
 #include <boost/timer/timer.hpp>
 #include "implementation.hpp"
+#include "statistics.hpp"
+#include "histogram.hpp"
+#include "samples.hpp"
+#include "counters.hpp"
 #include "../config.h"
 
 
 using namespace Botan::PKCS11;
 using namespace boost::timer;
-using benchmark_result_t = std::pair<std::vector<nanosecond_type>,int>;
+
+// result of execute(), for one thread. Statistics are accumulated online, in ns.
+struct benchmark_result_t {
+    RunningStats latency;		   // wall clock time
+    RunningStats cputime;		   // thread CPU time (CLOCK_THREAD_CPUTIME_ID)
+    SerialAccumulator serial;		   // serial correlation of wall clock time
+    std::unique_ptr<Histogram> histogram { new Histogram }; // wall clock time, for percentiles
+    RunningStats failed;		   // wall clock time of failed calls, when keeping going
+    std::map<int, uint64_t> errors;	   // failed calls by return code, when keeping going
+    std::vector<nanosecond_type> recoveries; // time to recover from each session loss
+    std::vector<uint64_t> timeline;	   // successful calls per timeline_bin since start, when recovering
+    int errcode { CKR_OK };		   // error that stopped the thread, if any
+
+    static constexpr nanosecond_type timeline_bin { 100000000LL }; // 100 ms
+};
+
+// recovery from the loss of a session (e.g. network HSM failover).
+// reopen() opens a new session, logs in, and returns it. it is attempted again until timeout.
+struct recovery_t {
+    std::function<Session *()> reopen;
+    std::chrono::milliseconds timeout;
+};
+
+// several keys per thread: count keys are used in turn, or picked at random for each iteration,
+// to defeat key caches of the token. key k of a thread is labelled <label>-th-<thread>-key-<k>.
+// shared keys: instead of a key of its own, thread th uses key th % shared, labelled <label>-sh-<key>.
+// persistent keys: labels are prefixed with persistent_prefix, e.g. p11perftest-<label>-th-<thread>.
+struct keyset_t {
+    enum class Pick { RoundRobin, Uniform, Zipf };
+
+    size_t count { 1 };		// keys per thread
+    Pick pick { Pick::RoundRobin };
+    double exponent { 1.0 };	// for Zipf: the probability of key k is proportional to 1/(k+1)^exponent
+    size_t shared { 0 };	// keys shared by all threads, 0 when each thread has its own
+    bool persistent { false };	// persistent token keys, whose labels start with persistent_prefix
+
+    // persistent keys have labels of their own, so that they never clash with session keys, or token keys used with -n
+    static inline const std::string persistent_prefix { "p11perftest-" };
+};
+
+// a mechanism required by a test case, checked before running it (see Preflight)
+struct requirement_t {
+    CK_MECHANISM_TYPE mechanism;
+    CK_FLAGS flags;			// CKF_xxx flags the mechanism must support (e.g. CKF_SIGN)
+    std::optional<Ulong> keysize;	// key size, in the unit of the mechanism, when it can be checked
+    bool keygen { false };		// only required when keys are generated
+};
 
 class P11Benchmark
 {
@@ -44,6 +99,15 @@ class P11Benchmark
     ObjectClass m_objectclass;
     Implementation m_implementation;
     boost::timer::cpu_timer m_t; // the timer can be stopped and resumed by crash test dummy
+    boost::timer::cpu_timer *m_timer { &m_t }; // timer of suspend_timer()/resume_timer(): for a key of the keyset, the one of the owner
+    std::optional<size_t> m_threadindex; // as given to setup(), to prepare calls again after recovery
+
+    keyset_t m_keyset;
+    std::optional<size_t> m_keyindex;	 // when this object is a key of the keyset of another one, its index
+    std::vector<std::unique_ptr<P11Benchmark> > m_keys; // one clone per key, prepared, when there are several keys per thread
+    std::vector<double> m_zipf_cdf;	 // cumulative distribution of keys, for Zipf
+    std::mt19937_64 m_pick_rng;
+    size_t m_pick_next { 0 };
 
 protected:
     std::vector<uint8_t> m_payload;
@@ -57,6 +121,9 @@ protected:
     // cleanup(): perform cleanup after each call of crashtestdummy(), if needed
     virtual void cleanup(Session &session) { };
 
+    // requires_key(): when false, no key is searched, and prepare() receives an object with an invalid handle
+    virtual bool requires_key() const { return true; };
+
     // rename(): change the name of the class after creation
     inline void rename(std::string newname) { m_name = newname; };
 
@@ -67,8 +134,24 @@ protected:
     inline Implementation::Vendor flavour() {return m_implementation.vendor(); };
 
     // timer primitives for the use of derived class
-    inline void suspend_timer() { m_t.stop(); }
-    inline void resume_timer()  { m_t.resume(); }
+    inline void suspend_timer() { m_timer->stop(); }
+    inline void resume_timer()  { m_timer->resume(); }
+
+private:
+    // timed_loop(): wait for green light, then run and time iterations
+    void timed_loop(Session *session, benchmark_result_t &result, size_t iterations, size_t skipiterations, bool keep_going, const recovery_t *recovery, SampleWriter *samples, LiveCounters *live);
+
+    // prepare_key(): search the key of target, and prepare it. returns false when the key was not found.
+    bool prepare_key(Session *session, P11Benchmark &target, std::optional<size_t> threadindex);
+
+    // pick_key(): the object whose crashtestdummy() runs the next iteration, i.e. this one, or one of its keys
+    P11Benchmark &pick_key();
+
+    // cleanup_failed(): cleanup() after a failed call, ignoring errors
+    void cleanup_failed(Session &session);
+
+    // recover(): open a new session, and prepare calls again. returns nullptr when it could not be done in time
+    Session *recover(const recovery_t &recovery);
 
 public:
     P11Benchmark(const std::string &name,
@@ -85,12 +168,49 @@ public:
     // clone() is used by assignment operator to allow copy of the object
     virtual P11Benchmark *clone() const = 0;
 
+    // swbaseline() returns a software equivalent of the test case, or nullptr if there is none.
+    // the caller owns the returned object.
+    virtual P11Benchmark *swbaseline() const { return nullptr; }
+
+    // replays(): when a traced call can be replayed by this test case, returns the payload size to use.
+    // function is the name of the PKCS#11 function, and payload the size of its input data.
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const { return std::nullopt; }
+
+    // accepts(): whether a payload of that size can be processed, e.g. a multiple of the block size for ciphers without padding
+    virtual bool accepts(size_t payload) const { return true; }
+
+    // requirements(): mechanisms needed to run the test case, and to generate its keys
+    virtual std::vector<requirement_t> requirements() const { return {}; }
+
+    // population(): number of objects the token must hold while the test case runs, if any (see Population)
+    virtual std::optional<size_t> population() const { return std::nullopt; }
+
     inline std::string name() const { return m_name; }
     inline std::string label() const { return m_label; }
 
+    // keybits(): key size or curve size found in the label (e.g. 2048 for rsa-2048, 256 for ecdsa-secp256r1), if any
+    std::optional<Ulong> keybits() const;
+
+    // keybytes(): key size found in the label, in bytes, the unit of secret key mechanisms
+    inline std::optional<Ulong> keybytes() const { auto bits = keybits(); return bits ? std::optional<Ulong>(*bits/8) : std::nullopt; }
+
     virtual std::string features() const;
 
-    benchmark_result_t execute(Session* session, const std::vector<uint8_t> &payload, size_t iterations, size_t skipiterations, std::optional<size_t> threadindex);
+    // keyset(): use several keys per thread, picked for each iteration. must be called before setup().
+    inline void keyset(const keyset_t &keyset) { m_keyset = keyset; }
+
+    // execute(): statistics are returned, and memory usage does not depend upon iterations.
+    // when keep_going is true, calls returning an error are accounted for, and iterations continue.
+    // when recovery is not null, a lost session is replaced, and iterations continue.
+    // when samples is not null, every measured call is also recorded to it.
+    // when live is not null, counters are updated as calls complete, for a live view.
+    benchmark_result_t execute(Session* session, const std::vector<uint8_t> &payload, size_t iterations, size_t skipiterations, std::optional<size_t> threadindex, bool keep_going, const recovery_t *recovery, SampleWriter *samples, LiveCounters *live);
+
+    // setup(): search the key and prepare calls, without running them. returns false when the key was not found.
+    bool setup(Session* session, const std::vector<uint8_t> &payload, std::optional<size_t> threadindex);
+
+    // timed_call(): run one iteration, once setup() was successful. returns the elapsed wall clock time.
+    nanosecond_type timed_call(Session &session);
 
 };
 
@@ -0,0 +1,63 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdexcept>
+#include "p11calibration.hpp"
+
+
+P11CalibrationBenchmark::P11CalibrationBenchmark(const Call call) :
+    P11Benchmark( call==Call::GetInfo ? "Calibration (C_GetInfo())" : "Calibration (C_GetSessionInfo())",
+		  "calibration",
+		  ObjectClass::Data ),
+    m_call(call) { }
+
+
+P11CalibrationBenchmark::P11CalibrationBenchmark(const P11CalibrationBenchmark &other) :
+    P11Benchmark(other),
+    m_call(other.m_call) { }
+
+
+inline P11CalibrationBenchmark *P11CalibrationBenchmark::clone() const {
+    return new P11CalibrationBenchmark{*this};
+}
+
+P11CalibrationBenchmark::Call P11CalibrationBenchmark::call(const std::string &name)
+{
+    if(name=="getsessioninfo") return Call::GetSessionInfo;
+    if(name=="getinfo") return Call::GetInfo;
+
+    throw std::invalid_argument("unknown calibration call: " + name);
+}
+
+void P11CalibrationBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
+{
+    // nothing to prepare: no key is used
+}
+
+void P11CalibrationBenchmark::crashtestdummy(Session &session)
+{
+    switch(m_call) {
+    case Call::GetSessionInfo:
+	session.module()->C_GetSessionInfo( session.handle(), &m_sessioninfo );
+	break;
+
+    case Call::GetInfo:
+	session.module()->C_GetInfo( &m_info );
+	break;
+    }
+}
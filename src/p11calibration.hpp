@@ -0,0 +1,53 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11calibration: a null operation, to measure the overhead of the harness and of the library dispatch
+
+#if !defined P11CALIBRATION_HPP
+#define P11CALIBRATION_HPP
+
+#include "p11benchmark.hpp"
+
+class P11CalibrationBenchmark : public P11Benchmark
+{
+public:
+    enum class Call : size_t {
+	GetSessionInfo,		// C_GetSessionInfo(), usually reaches the device on network HSMs
+	GetInfo			// C_GetInfo(), usually local to the library
+    };
+
+private:
+    Call m_call;
+    SessionInfo m_sessioninfo;
+    Info m_info;
+
+    virtual bool requires_key() const override { return false; };
+    virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
+    virtual void crashtestdummy(Session &session) override;
+    virtual P11CalibrationBenchmark *clone() const override;
+
+public:
+
+    P11CalibrationBenchmark(const Call call = Call::GetSessionInfo);
+    P11CalibrationBenchmark(const P11CalibrationBenchmark & other);
+
+    // parse a call name, as given on the command line. throws std::invalid_argument if unknown
+    static Call call(const std::string &name);
+};
+
+#endif // P11CALIBRATION_HPP
@@ -17,6 +17,7 @@
 //
 
 #include "p11des3cbc.hpp"
+#include "swbaseline.hpp"
 
 
 P11DES3CBCBenchmark::P11DES3CBCBenchmark(const std::string &label) :
@@ -31,6 +32,21 @@ inline P11DES3CBCBenchmark *P11DES3CBCBenchmark::clone() const {
     return new P11DES3CBCBenchmark{*this};
 }
 
+P11Benchmark *P11DES3CBCBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::DES3CBC, label() );
+}
+
+std::optional<size_t> P11DES3CBCBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // decryption is replayed as encryption
+    if((function=="C_Encrypt" || function=="C_Decrypt") && mechanism==CKM_DES3_CBC) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11DES3CBCBenchmark::requirements() const {
+    return { { CKM_DES3_CBC, CKF_ENCRYPT, keybytes() },
+	     { keybits()==128 ? CKM_DES2_KEY_GEN : CKM_DES3_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 
 void P11DES3CBCBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
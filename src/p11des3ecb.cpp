@@ -17,6 +17,7 @@
 //
 
 #include "p11des3ecb.hpp"
+#include "swbaseline.hpp"
 
 P11DES3ECBBenchmark::P11DES3ECBBenchmark(const std::string &label) :
     P11Benchmark("DES3 Encryption (CKM_DES3_ECB)", label, ObjectClass::SecretKey ) { }
@@ -27,6 +28,21 @@ inline P11DES3ECBBenchmark *P11DES3ECBBenchmark::clone() const {
     return new P11DES3ECBBenchmark{*this};
 }
 
+P11Benchmark *P11DES3ECBBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::DES3ECB, label() );
+}
+
+std::optional<size_t> P11DES3ECBBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // decryption is replayed as encryption
+    if((function=="C_Encrypt" || function=="C_Decrypt") && mechanism==CKM_DES3_ECB) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11DES3ECBBenchmark::requirements() const {
+    return { { CKM_DES3_ECB, CKF_ENCRYPT, keybytes() },
+	     { keybits()==128 ? CKM_DES2_KEY_GEN : CKM_DES3_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 
 void P11DES3ECBBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
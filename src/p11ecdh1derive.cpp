@@ -21,6 +21,7 @@
 #include <botan/asn1_obj.h>
 #include <botan/ec_group.h>
 #include "p11ecdh1derive.hpp"
+#include "swbaseline.hpp"
 
 namespace P11ECDH1 {
 
@@ -94,6 +95,21 @@ inline P11ECDH1DeriveBenchmark *P11ECDH1DeriveBenchmark::clone() const {
     return new P11ECDH1DeriveBenchmark{*this};
 }
 
+P11Benchmark *P11ECDH1DeriveBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::ECDH, label() );
+}
+
+std::optional<size_t> P11ECDH1DeriveBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // the derived secret is assumed to be 256 bits long
+    if(function=="C_DeriveKey" && mechanism==CKM_ECDH1_DERIVE) return 32;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11ECDH1DeriveBenchmark::requirements() const {
+    return { { CKM_ECDH1_DERIVE, CKF_DERIVE, keybits() },
+	     { CKM_EC_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11ECDH1DeriveBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
 
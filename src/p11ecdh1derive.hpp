@@ -47,6 +47,9 @@ class P11ECDH1DeriveBenchmark : public P11Benchmark
     virtual void crashtestdummy(Session &session) override;
     virtual void cleanup(Session &session) override;
     virtual P11ECDH1DeriveBenchmark *clone() const override;
+    virtual P11Benchmark *swbaseline() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+    virtual std::vector<requirement_t> requirements() const override;
 
 public:
 
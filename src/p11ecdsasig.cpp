@@ -17,6 +17,7 @@
 //
 
 #include "p11ecdsasig.hpp"
+#include "swbaseline.hpp"
 #include <botan/hash.h>
 
 P11ECDSASigBenchmark::P11ECDSASigBenchmark(const std::string &label) :
@@ -39,6 +40,21 @@ inline P11ECDSASigBenchmark *P11ECDSASigBenchmark::clone() const {
     return new P11ECDSASigBenchmark{*this};
 }
 
+P11Benchmark *P11ECDSASigBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::ECDSA, label() );
+}
+
+std::optional<size_t> P11ECDSASigBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // payload is hashed in software, any size will do
+    if(function=="C_Sign" && mechanism==CKM_ECDSA) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11ECDSASigBenchmark::requirements() const {
+    return { { CKM_ECDSA, CKF_SIGN, keybits() },
+	     { CKM_EC_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11ECDSASigBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     m_ecdsakey = std::unique_ptr<PKCS11_ECDSA_PrivateKey>(new PKCS11_ECDSA_PrivateKey(session, obj.handle()));
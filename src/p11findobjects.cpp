@@ -0,0 +1,95 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <array>
+#include "p11findobjects.hpp"
+#include "population.hpp"
+
+static std::string template_name(P11FindObjectsBenchmark::Template tmpl)
+{
+    switch(tmpl) {
+    case P11FindObjectsBenchmark::Template::Label:
+	return "Object search by label (C_FindObjects())";
+
+    case P11FindObjectsBenchmark::Template::Id:
+	return "Object search by ID (C_FindObjects())";
+
+    case P11FindObjectsBenchmark::Template::Class:
+    default:
+	return "Object search by class (C_FindObjects())";
+    }
+}
+
+
+P11FindObjectsBenchmark::P11FindObjectsBenchmark(const Template tmpl, const size_t population) :
+    P11Benchmark( template_name(tmpl), std::to_string(population) + "-objects", ObjectClass::SecretKey ),
+    m_template(tmpl),
+    m_population(population) { }
+
+
+P11FindObjectsBenchmark::P11FindObjectsBenchmark(const P11FindObjectsBenchmark &other) :
+    P11Benchmark(other),
+    m_template(other.m_template),
+    m_population(other.m_population) { }
+
+
+inline P11FindObjectsBenchmark *P11FindObjectsBenchmark::clone() const {
+    return new P11FindObjectsBenchmark{*this};
+}
+
+void P11FindObjectsBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
+{
+    // each thread searches a different object, spread over the population
+    size_t index = (threadindex.value_or(0) * 7919 + m_population / 2) % m_population;
+    auto target = Population::label(index);
+
+    m_search.reset(new AttributeContainer);
+    switch(m_template) {
+    case Template::Label:
+	m_search->add_string( AttributeType::Label, target );
+	break;
+
+    case Template::Id:
+	m_search->add_binary( AttributeType::Id, reinterpret_cast<const uint8_t *>(target.data()), target.size() );
+	break;
+
+    case Template::Class:
+	m_search->add_class( ObjectClass::SecretKey );
+	m_search->add_numeric( AttributeType::KeyType, static_cast<Ulong>(KeyType::Aes) );
+	break;
+    }
+}
+
+void P11FindObjectsBenchmark::crashtestdummy(Session &session)
+{
+    std::array<ObjectHandle,64> found;
+    Ulong count = 0;
+
+    session.module()->C_FindObjectsInit( session.handle(), m_search->data(), static_cast<Ulong>(m_search->count()) );
+    try {
+	// retrieve all matching objects, by batches
+	do {
+	    session.module()->C_FindObjects( session.handle(), found.data(), found.size(), &count );
+	} while(count==found.size());
+    } catch (Botan::PKCS11::PKCS11_ReturnError &) {
+	// the search must be finalized, or the next one fails with CKR_OPERATION_ACTIVE
+	session.module()->C_FindObjectsFinal( session.handle(), nullptr );
+	throw;
+    }
+    session.module()->C_FindObjectsFinal( session.handle() );
+}
@@ -0,0 +1,54 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11findobjects: object search test cases, against a token populated with many objects
+
+#if !defined P11FINDOBJECTS_HPP
+#define P11FINDOBJECTS_HPP
+
+#include <memory>
+#include "p11benchmark.hpp"
+
+class P11FindObjectsBenchmark : public P11Benchmark
+{
+public:
+    enum class Template : size_t {
+	Label,			// search one object by CKA_LABEL
+	Id,			// search one object by CKA_ID
+	Class			// enumerate all AES secret keys, population included
+    };
+
+private:
+    Template m_template;
+    size_t m_population;
+    std::unique_ptr<AttributeContainer> m_search;
+
+    virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
+    virtual void crashtestdummy(Session &session) override;
+    virtual bool requires_key() const override { return false; }
+    virtual P11FindObjectsBenchmark *clone() const override;
+
+public:
+
+    P11FindObjectsBenchmark(const Template tmpl, const size_t population);
+    P11FindObjectsBenchmark(const P11FindObjectsBenchmark & other);
+
+    virtual std::optional<size_t> population() const override { return m_population; }
+};
+
+#endif // P11FINDOBJECTS_HPP
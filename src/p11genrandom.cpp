@@ -34,6 +34,11 @@ inline P11GenerateRandomBenchmark *P11GenerateRandomBenchmark::clone() const {
     return new P11GenerateRandomBenchmark{*this};
 }
 
+std::optional<size_t> P11GenerateRandomBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    if(function=="C_GenerateRandom") return payload;
+    return std::nullopt;
+}
+
 void P11GenerateRandomBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
 
@@ -0,0 +1,138 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "p11getattribute.hpp"
+
+// attribute mostly fetched by applications, for each key type
+static AttributeType hot_attribute(P11GetAttributeBenchmark::Key key)
+{
+    switch(key) {
+    case P11GetAttributeBenchmark::Key::RSA:
+	return AttributeType::Modulus;
+
+    case P11GetAttributeBenchmark::Key::EC:
+	return AttributeType::EcPoint;
+
+    case P11GetAttributeBenchmark::Key::AES:
+    default:
+	return AttributeType::ValueLen;
+    }
+}
+
+// template read at once, for each key type
+static std::vector<AttributeType> template_attributes(P11GetAttributeBenchmark::Key key)
+{
+    switch(key) {
+    case P11GetAttributeBenchmark::Key::RSA:
+	return { AttributeType::Class, AttributeType::KeyType, AttributeType::Label, AttributeType::Modulus, AttributeType::PublicExponent };
+
+    case P11GetAttributeBenchmark::Key::EC:
+	return { AttributeType::Class, AttributeType::KeyType, AttributeType::Label, AttributeType::EcParams, AttributeType::EcPoint };
+
+    case P11GetAttributeBenchmark::Key::AES:
+    default:
+	return { AttributeType::Class, AttributeType::KeyType, AttributeType::Label, AttributeType::ValueLen, AttributeType::Encrypt };
+    }
+}
+
+static std::string benchmark_name(P11GetAttributeBenchmark::Key key, P11GetAttributeBenchmark::Read read)
+{
+    std::string attribute;
+
+    switch(key) {
+    case P11GetAttributeBenchmark::Key::RSA: attribute = "CKA_MODULUS"; break;
+    case P11GetAttributeBenchmark::Key::EC:  attribute = "CKA_EC_POINT"; break;
+    case P11GetAttributeBenchmark::Key::AES: attribute = "CKA_VALUE_LEN"; break;
+    }
+
+    switch(read) {
+    case P11GetAttributeBenchmark::Read::Single:
+	return "Attribute read, " + attribute + " (C_GetAttributeValue())";
+
+    case P11GetAttributeBenchmark::Read::Probe:
+	return "Attribute read, " + attribute + " with length probe (2 x C_GetAttributeValue())";
+
+    case P11GetAttributeBenchmark::Read::Template:
+    default:
+	return "Attribute read, template of " + std::to_string(template_attributes(key).size()) + " attributes (C_GetAttributeValue())";
+    }
+}
+
+
+P11GetAttributeBenchmark::P11GetAttributeBenchmark(const std::string &label, const Key key, const Read read) :
+    P11Benchmark( benchmark_name(key, read), label, key==Key::AES ? ObjectClass::SecretKey : ObjectClass::PublicKey ),
+    m_key(key),
+    m_read(read) { }
+
+
+P11GetAttributeBenchmark::P11GetAttributeBenchmark(const P11GetAttributeBenchmark &other) :
+    P11Benchmark(other),
+    m_key(other.m_key),
+    m_read(other.m_read) { }
+
+
+inline P11GetAttributeBenchmark *P11GetAttributeBenchmark::clone() const {
+    return new P11GetAttributeBenchmark{*this};
+}
+
+std::optional<size_t> P11GetAttributeBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    if(function=="C_GetAttributeValue" && m_read==Read::Single) return payload;
+    return std::nullopt;
+}
+
+void P11GetAttributeBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
+{
+    m_handle = obj.handle();
+
+    std::vector<AttributeType> types;
+    if(m_read==Read::Template) {
+	types = template_attributes(m_key);
+    } else {
+	types.push_back(hot_attribute(m_key));
+    }
+
+    // probe lengths once, and size buffers accordingly
+    m_template.clear();
+    for(auto type: types) {
+	m_template.push_back( { static_cast<CK_ATTRIBUTE_TYPE>(type), nullptr, 0 } );
+    }
+    session.module()->C_GetAttributeValue( session.handle(), m_handle, m_template.data(), m_template.size() );
+
+    m_values.resize(m_template.size());
+    for(size_t i=0; i<m_template.size(); i++) {
+	m_values[i].resize(m_template[i].ulValueLen);
+	m_template[i].pValue = m_values[i].data();
+    }
+}
+
+void P11GetAttributeBenchmark::crashtestdummy(Session &session)
+{
+    if(m_read==Read::Probe) {
+	// what a client without cache does: ask for the length, then for the value
+	m_template[0].pValue = nullptr;
+	session.module()->C_GetAttributeValue( session.handle(), m_handle, m_template.data(), 1 );
+	m_values[0].resize(m_template[0].ulValueLen);
+	m_template[0].pValue = m_values[0].data();
+    } else {
+	for(size_t i=0; i<m_template.size(); i++) {
+	    m_template[i].ulValueLen = m_values[i].size();
+	}
+    }
+
+    session.module()->C_GetAttributeValue( session.handle(), m_handle, m_template.data(), m_template.size() );
+}
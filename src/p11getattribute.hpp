@@ -0,0 +1,61 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11getattribute: attribute read test cases, i.e. C_GetAttributeValue() on keys
+
+#if !defined P11GETATTRIBUTE_HPP
+#define P11GETATTRIBUTE_HPP
+
+#include <vector>
+#include "p11benchmark.hpp"
+
+class P11GetAttributeBenchmark : public P11Benchmark
+{
+public:
+    enum class Key : size_t {
+	RSA,			// RSA public key: CKA_MODULUS
+	EC,			// EC public key: CKA_EC_POINT
+	AES			// AES secret key: CKA_VALUE_LEN
+    };
+
+    enum class Read : size_t {
+	Single,			// one attribute, buffer sized beforehand: one call
+	Probe,			// one attribute, length probed first: two calls
+	Template		// several attributes at once, buffers sized beforehand: one call
+    };
+
+private:
+    Key m_key;
+    Read m_read;
+    ObjectHandle m_handle { CK_INVALID_HANDLE };
+    std::vector<Attribute> m_template;
+    std::vector<std::vector<uint8_t> > m_values;
+
+    virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
+    virtual void crashtestdummy(Session &session) override;
+    virtual P11GetAttributeBenchmark *clone() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+
+public:
+
+    P11GetAttributeBenchmark(const std::string &label, const Key key, const Read read);
+    P11GetAttributeBenchmark(const P11GetAttributeBenchmark & other);
+
+};
+
+#endif // P11GETATTRIBUTE_HPP
@@ -18,6 +18,7 @@
 
 #include <botan/hash.h>
 #include "p11hmacsha1.hpp"
+#include "swbaseline.hpp"
 
 P11HMACSHA1Benchmark::P11HMACSHA1Benchmark(const std::string &label) :
     P11Benchmark( "SHA1 HMAC (CKM_SHA_1_HMAC)", label, ObjectClass::SecretKey ) { }
@@ -31,6 +32,21 @@ inline P11HMACSHA1Benchmark *P11HMACSHA1Benchmark::clone() const {
     return new P11HMACSHA1Benchmark{*this};
 }
 
+P11Benchmark *P11HMACSHA1Benchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::HMACSHA1, label() );
+}
+
+std::optional<size_t> P11HMACSHA1Benchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // verification is replayed as a signature
+    if((function=="C_Sign" || function=="C_Verify") && mechanism==CKM_SHA_1_HMAC) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11HMACSHA1Benchmark::requirements() const {
+    return { { CKM_SHA_1_HMAC, CKF_SIGN, keybytes() },
+	     { CKM_GENERIC_SECRET_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 void P11HMACSHA1Benchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     m_digest.resize( m_digest_size );
@@ -17,6 +17,7 @@
 //
 
 #include "p11hmacsha512.hpp"
+#include "swbaseline.hpp"
 #include <botan/hash.h>
 
 
@@ -32,6 +33,21 @@ inline P11HMACSHA512Benchmark *P11HMACSHA512Benchmark::clone() const {
     return new P11HMACSHA512Benchmark{*this};
 }
 
+P11Benchmark *P11HMACSHA512Benchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::HMACSHA512, label() );
+}
+
+std::optional<size_t> P11HMACSHA512Benchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // verification is replayed as a signature
+    if((function=="C_Sign" || function=="C_Verify") && mechanism==CKM_SHA512_HMAC) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11HMACSHA512Benchmark::requirements() const {
+    return { { CKM_SHA512_HMAC, CKF_SIGN, keybytes() },
+	     { CKM_GENERIC_SECRET_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 void P11HMACSHA512Benchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     m_digest.resize( m_digest_size );
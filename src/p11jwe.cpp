@@ -26,6 +26,7 @@
 #include <random>
 #include <cstdlib>
 #include <algorithm>
+#include <set>
 #include "p11jwe.hpp"
 
 
@@ -79,6 +80,14 @@ inline P11JWEBenchmark *P11JWEBenchmark::clone() const {
     return new P11JWEBenchmark{*this};
 }
 
+std::vector<requirement_t> P11JWEBenchmark::requirements() const {
+    // the content encryption key is generated and wrapped, when preparing
+    return { { CKM_RSA_PKCS_OAEP, CKF_UNWRAP | CKF_WRAP, keybits() },
+	     { CKM_AES_GCM, CKF_DECRYPT, static_cast<Ulong>(m_symalg) },
+	     { CKM_AES_KEY_GEN, CKF_GENERATE, static_cast<Ulong>(m_symalg) },
+	     { CKM_RSA_PKCS_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11JWEBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
 
@@ -227,6 +236,16 @@ void P11JWEBenchmark::prepare(Session &session, Object &obj, std::optional<size_
     Ulong returned_len=m_encrypted.size();
     session.module()->C_EncryptInit(session.handle(), &m_mech_aes_gcm, symkey_handle);
     session.module()->C_Encrypt(session.handle(), m_payload.data(), m_payload.size(), m_encrypted.data(), &returned_len);
+
+    // check the output layout, before extracting the IV from it: on Luna, it must have been appended
+    auto overhead = flavour()==Implementation::Vendor::luna ? std::set<size_t>{ 32 } : Implementation::gcm_overhead(flavour());
+    if(returned_len < m_payload.size() || overhead.count(returned_len - m_payload.size())==0) {
+	session.module()->C_DestroyObject(session.handle(), symkey_handle);
+	std::cerr << "Error: CKM_AES_GCM returned " << returned_len << " bytes for a payload of " << m_payload.size()
+		  << " bytes, which does not match the " << Implementation::name(flavour()) << " flavour (check --flavour)\n";
+	throw Botan::PKCS11::PKCS11_ReturnError(ReturnValue::FunctionFailed); // reported as a failure of this test case only
+    }
+
     m_encrypted.resize(returned_len);
 
     // finaly, cleanup generated session key:
@@ -238,6 +257,7 @@ void P11JWEBenchmark::prepare(Session &session, Object &obj, std::optional<size_
     case Implementation::Vendor::generic:
     case Implementation::Vendor::utimaco:
     case Implementation::Vendor::entrust:
+    case Implementation::Vendor::marvell:
 	// [ PAYLOAD | AUTH (variable) ]
 	// leave it as it is
 	break;
@@ -299,8 +319,16 @@ void P11JWEBenchmark::crashtestdummy(Session &session)
     Ulong returned_len=m_decrypted.size();
 
     resume_timer();
-    session.module()->C_DecryptInit(session.handle(), &m_mech_aes_gcm, symkey_handle);
-    session.module()->C_Decrypt(session.handle(), m_encrypted.data(), m_encrypted.size(), m_decrypted.data(), &returned_len);
+    try {
+	session.module()->C_DecryptInit(session.handle(), &m_mech_aes_gcm, symkey_handle);
+	session.module()->C_Decrypt(session.handle(), m_encrypted.data(), m_encrypted.size(), m_decrypted.data(), &returned_len);
+    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	// the unwrapped key is destroyed on failure too, or each failed iteration would leak one (with --keep-going)
+	suspend_timer();
+	ReturnValue rv;
+	session.module()->C_DestroyObject(session.handle(), symkey_handle, &rv);
+	throw;
+    }
     suspend_timer();
 
     m_decrypted.resize(returned_len);
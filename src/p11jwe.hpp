@@ -74,6 +74,7 @@ private:
     virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
     virtual void crashtestdummy(Session &session) override;
     virtual P11JWEBenchmark *clone() const override;
+    virtual std::vector<requirement_t> requirements() const override;
 
 public:
 
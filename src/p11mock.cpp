@@ -0,0 +1,1505 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11mock.cpp: a mock PKCS#11 module, with a configurable latency and concurrency model
+//
+// example of configuration file (all entries are optional):
+//
+// {
+//     "device": {
+//         "cores": 4,                 <-- number of parallel crypto cores (0 = unlimited)
+//         "global_lock": false,       <-- serialize every call to the device
+//         "rtt_us": 250,              <-- network round trip time
+//         "rtt_jitter_us": 20,        <-- standard deviation on RTT
+//         "spin_us": 50               <-- last part of any wait is spent spinning, for accuracy
+//     },
+//     "default": { "distribution": "constant", "mean_us": 10 },
+//     "mechanisms": {
+//         "CKM_SHA256_RSA_PKCS": { "distribution": "lognormal", "mean_us": 1500, "stddev_us": 200, "cores": 2 },
+//         "CKM_AES_GCM": { "distribution": "normal", "mean_us": 40, "stddev_us": 5,
+//                          "error_rate": 0.001, "error_code": "CKR_DEVICE_ERROR" }
+//     },
+//     "functions": {
+//         "C_Login": { "mean_us": 5000 }
+//     },
+//     "failover": {
+//         "after_ms": 2000,           <-- first failover, since C_Initialize() (0 = never)
+//         "every_ms": 10000,          <-- period of subsequent failovers (0 = once)
+//         "outage_ms": 500,           <-- device calls fail during that time
+//         "error_code": "CKR_DEVICE_REMOVED",
+//         "drop_session_objects": false
+//     }
+// }
+//
+// Calls are charged as follows:
+// - C_Initialize(), C_Finalize(), C_GetInfo(), C_GetSlotList(), C_GetSlotInfo(),
+//   C_GetTokenInfo(), C_GetMechanismList() and C_GetMechanismInfo() are local to the library;
+// - C_xxxInit() calls are local as well: like most network client libraries, the mock
+//   defers the initialization of the operation to the call that performs it;
+// - all other calls pay the network round trip, and the service time of the "functions" entry, if any;
+// - calls that execute a mechanism (C_Encrypt(), C_Sign(), C_GenerateKey(), ...) are additionally
+//   charged with the service time of the mechanism, taken from the "mechanisms" entry, or from "default".
+//   They occupy a crypto core for that duration.
+//
+// Upon failover, all sessions are lost and the application is logged out; subsequent calls on these
+// sessions return CKR_SESSION_HANDLE_INVALID. During the outage, calls to the device return error_code.
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <optional>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include "errorcodes.hpp"
+#include "functions.hpp"
+#include "p11mock.hpp"
+
+namespace pt = boost::property_tree;
+
+namespace p11mock {
+
+    // mechanisms supported by the mock, with their capabilities
+    struct MechanismEntry {
+	const char *name;
+	CK_MECHANISM_TYPE type;
+	CK_ULONG min_keysize;
+	CK_ULONG max_keysize;
+	CK_FLAGS flags;
+    };
+
+    static const std::array<MechanismEntry,20> supported_mechanisms { {
+	    { "CKM_RSA_PKCS_KEY_PAIR_GEN", CKM_RSA_PKCS_KEY_PAIR_GEN, 1024, 4096, CKF_HW | CKF_GENERATE_KEY_PAIR },
+	    { "CKM_RSA_PKCS", CKM_RSA_PKCS, 1024, 4096, CKF_HW | CKF_SIGN | CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP },
+	    { "CKM_SHA256_RSA_PKCS", CKM_SHA256_RSA_PKCS, 1024, 4096, CKF_HW | CKF_SIGN | CKF_VERIFY },
+	    { "CKM_RSA_PKCS_OAEP", CKM_RSA_PKCS_OAEP, 1024, 4096, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP },
+	    { "CKM_EC_KEY_PAIR_GEN", CKM_EC_KEY_PAIR_GEN, 256, 521, CKF_HW | CKF_GENERATE_KEY_PAIR },
+	    { "CKM_ECDSA", CKM_ECDSA, 256, 521, CKF_HW | CKF_SIGN | CKF_VERIFY },
+	    { "CKM_ECDH1_DERIVE", CKM_ECDH1_DERIVE, 256, 521, CKF_HW | CKF_DERIVE },
+	    { "CKM_GENERIC_SECRET_KEY_GEN", CKM_GENERIC_SECRET_KEY_GEN, 1, 512, CKF_HW | CKF_GENERATE },
+	    { "CKM_SHA_1_HMAC", CKM_SHA_1_HMAC, 1, 512, CKF_HW | CKF_SIGN | CKF_VERIFY },
+	    { "CKM_SHA256_HMAC", CKM_SHA256_HMAC, 1, 512, CKF_HW | CKF_SIGN | CKF_VERIFY },
+	    { "CKM_SHA512_HMAC", CKM_SHA512_HMAC, 1, 512, CKF_HW | CKF_SIGN | CKF_VERIFY },
+	    { "CKM_DES2_KEY_GEN", CKM_DES2_KEY_GEN, 16, 16, CKF_HW | CKF_GENERATE },
+	    { "CKM_DES3_KEY_GEN", CKM_DES3_KEY_GEN, 24, 24, CKF_HW | CKF_GENERATE },
+	    { "CKM_DES3_ECB", CKM_DES3_ECB, 16, 24, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT },
+	    { "CKM_DES3_CBC", CKM_DES3_CBC, 16, 24, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT },
+	    { "CKM_AES_KEY_GEN", CKM_AES_KEY_GEN, 16, 32, CKF_HW | CKF_GENERATE },
+	    { "CKM_AES_ECB", CKM_AES_ECB, 16, 32, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT },
+	    { "CKM_AES_CBC", CKM_AES_CBC, 16, 32, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT },
+	    { "CKM_AES_GCM", CKM_AES_GCM, 16, 32, CKF_HW | CKF_ENCRYPT | CKF_DECRYPT },
+	    { "CKM_XOR_BASE_AND_DATA", CKM_XOR_BASE_AND_DATA, 1, 512, CKF_HW | CKF_DERIVE },
+	} };
+
+
+    // mechanism(): a known mnemonic, or an explicit decimal or hexadecimal (0x...) value
+    CK_MECHANISM_TYPE mechanism(const std::string &name)
+    {
+	for(auto &entry: supported_mechanisms) {
+	    if(name==entry.name) {
+		return entry.type;
+	    }
+	}
+
+	char *end = nullptr;
+	auto value = std::strtoul(name.c_str(), &end, 0);
+	if(name.empty() || !std::isdigit(static_cast<unsigned char>(name[0])) || *end!='\0') {
+	    throw std::runtime_error("unknown mechanism: " + name);
+	}
+	return static_cast<CK_MECHANISM_TYPE>(value);
+    }
+
+    std::string mechanism(CK_MECHANISM_TYPE mech)
+    {
+	for(auto &entry: supported_mechanisms) {
+	    if(mech==entry.type) {
+		return entry.name;
+	    }
+	}
+	return std::to_string(mech);
+    }
+
+    ServiceModel::Distribution distribution(const std::string &name)
+    {
+	if(name=="constant") return ServiceModel::Distribution::constant;
+	if(name=="uniform") return ServiceModel::Distribution::uniform;
+	if(name=="normal") return ServiceModel::Distribution::normal;
+	if(name=="exponential") return ServiceModel::Distribution::exponential;
+	if(name=="lognormal") return ServiceModel::Distribution::lognormal;
+
+	throw std::runtime_error("unknown distribution: " + name);
+    }
+
+    void CorePool::acquire()
+    {
+	std::unique_lock<std::mutex> lck(m_mtx);
+	m_cond.wait(lck, [this] { return m_available>0; });
+	--m_available;
+    }
+
+    void CorePool::release()
+    {
+	{
+	    std::lock_guard<std::mutex> lck(m_mtx);
+	    ++m_available;
+	}
+	m_cond.notify_one();
+    }
+
+    double ServiceModel::sample(std::mt19937_64 &rng) const
+    {
+	double rv = mean_us;
+
+	switch(distribution) {
+	case Distribution::constant:
+	    break;
+
+	case Distribution::uniform:
+	    rv = std::uniform_real_distribution<double>(mean_us-stddev_us, mean_us+stddev_us)(rng);
+	    break;
+
+	case Distribution::normal:
+	    rv = std::normal_distribution<double>(mean_us, stddev_us)(rng);
+	    break;
+
+	case Distribution::exponential:
+	    rv = mean_us > 0.0 ? std::exponential_distribution<double>(1.0/mean_us)(rng) : 0.0;
+	    break;
+
+	case Distribution::lognormal:
+	    if(mean_us > 0.0) {
+		// convert mean and standard deviation of the variable to the parameters of the underlying normal
+		double s2 = std::log(1.0 + (stddev_us*stddev_us) / (mean_us*mean_us));
+		rv = std::lognormal_distribution<double>(std::log(mean_us) - s2/2.0, std::sqrt(s2))(rng);
+	    }
+	    break;
+	}
+
+	return rv < 0.0 ? 0.0 : rv;
+    }
+
+    const ServiceModel &DeviceModel::service(CK_MECHANISM_TYPE mech) const
+    {
+	auto found = services.find(mech);
+	return found==services.end() ? default_service : found->second;
+    }
+
+    static ServiceModel parse_service(const pt::ptree &node, const ServiceModel &defaults)
+    {
+	ServiceModel rv { defaults };
+
+	auto name = node.get_optional<std::string>("distribution");
+	if(name) {
+	    rv.distribution = distribution(*name);
+	}
+	rv.mean_us = node.get<double>("mean_us", defaults.mean_us);
+	rv.stddev_us = node.get<double>("stddev_us", defaults.stddev_us);
+	rv.error_rate = node.get<double>("error_rate", defaults.error_rate);
+
+	auto error_code = node.get_optional<std::string>("error_code");
+	if(error_code) {
+	    auto rc = errorcode(*error_code);
+	    if(!rc) {
+		throw std::runtime_error("unknown error code: " + *error_code);
+	    }
+	    rv.error_code = *rc;
+	}
+
+	auto cores = node.get_optional<int>("cores");
+	if(cores && *cores>0) {
+	    rv.cores = std::make_shared<CorePool>(*cores);
+	}
+
+	return rv;
+    }
+
+    DeviceModel DeviceModel::load(const std::string &path)
+    {
+	DeviceModel model;
+	pt::ptree root;
+
+	try {
+	    pt::read_json(path, root);
+	} catch (pt::json_parser_error &e) {
+	    throw std::runtime_error(e.what());
+	}
+
+	model.cores = root.get<int>("device.cores", 0);
+	model.global_lock = root.get<bool>("device.global_lock", false);
+	model.rtt_us = root.get<double>("device.rtt_us", 0.0);
+	model.rtt_jitter_us = root.get<double>("device.rtt_jitter_us", 0.0);
+	model.spin_us = root.get<double>("device.spin_us", 50.0);
+
+	auto defaults = root.get_child_optional("default");
+	if(defaults) {
+	    model.default_service = parse_service(*defaults, ServiceModel{});
+	}
+
+	auto mechanisms = root.get_child_optional("mechanisms");
+	if(mechanisms) {
+	    for(auto &entry: *mechanisms) {
+		model.services[mechanism(entry.first)] = parse_service(entry.second, model.default_service);
+	    }
+	}
+
+	auto functions = root.get_child_optional("functions");
+	if(functions) {
+	    for(auto &entry: *functions) {
+		if(std::none_of(function_descriptors.begin(), function_descriptors.end(),
+				[&entry] (const FunctionDescriptor &function) { return entry.first==function.name; })) {
+		    throw std::runtime_error("unknown function: " + entry.first);
+		}
+		model.functions[entry.first] = parse_service(entry.second, ServiceModel{});
+	    }
+	}
+
+	auto failover = root.get_child_optional("failover");
+	if(failover) {
+	    model.failover.after_ms = failover->get<double>("after_ms", 0.0);
+	    model.failover.every_ms = failover->get<double>("every_ms", 0.0);
+	    model.failover.outage_ms = failover->get<double>("outage_ms", 0.0);
+	    model.failover.drop_session_objects = failover->get<bool>("drop_session_objects", false);
+
+	    auto error_code = failover->get_optional<std::string>("error_code");
+	    if(error_code) {
+		auto rc = errorcode(*error_code);
+		if(!rc) {
+		    throw std::runtime_error("unknown error code: " + *error_code);
+		}
+		model.failover.error_code = *rc;
+	    }
+	}
+
+	return model;
+    }
+}
+
+using namespace p11mock;
+
+namespace {
+
+    // key material used to synthesize EC public points.
+    // these are valid points on their respective curves, so that clients decoding CKA_EC_POINT are satisfied.
+    // (same points as in p11ecdh1derive.cpp)
+    const std::vector<CK_BYTE> secp256r1_oid { 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+    const std::vector<CK_BYTE> secp384r1_oid { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22 };
+    const std::vector<CK_BYTE> secp521r1_oid { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x23 };
+
+    const std::vector<CK_BYTE> secp256r1_point {
+	0x04, 0x41,		// DER OCTET STRING
+	0x04,
+	0x34, 0xe3, 0xe7, 0x64, 0x53, 0xc8, 0x5c, 0x3d, 0x47, 0x9a, 0xca, 0x9a, 0xc9, 0x01, 0x26, 0x07,
+	0x95, 0x27, 0x5e, 0x0e, 0x2b, 0x4b, 0x7b, 0xe3, 0x6d, 0x2c, 0xaf, 0xe5, 0x54, 0x62, 0x56, 0x3c,
+	0xac, 0xa4, 0xc2, 0xbb, 0xf4, 0xfa, 0x31, 0x77, 0x9a, 0x1d, 0x66, 0x89, 0xe6, 0x63, 0xbd, 0x77,
+	0x1b, 0x0f, 0xcf, 0x2b, 0x46, 0x73, 0xea, 0x09, 0x06, 0x81, 0xe2, 0x44, 0x53, 0xe9, 0xa8, 0x8e
+    };
+
+    const std::vector<CK_BYTE> secp384r1_point {
+	0x04, 0x61,		// DER OCTET STRING
+	0x04,
+	0xba, 0xae, 0x9c, 0xec, 0x21, 0x48, 0x72, 0xa4, 0xc8, 0x0d, 0x4b, 0x8a, 0xae, 0x9d, 0x56, 0x3e,
+	0xaa, 0x10, 0x33, 0xce, 0xcd, 0x5b, 0xaf, 0x94, 0xb4, 0x10, 0x9c, 0xec, 0x2e, 0xc5, 0x51, 0x45,
+	0xa1, 0x02, 0x4b, 0x0a, 0x77, 0xfa, 0xe1, 0x76, 0x69, 0x56, 0xfc, 0xfe, 0x9f, 0x12, 0x35, 0x4f,
+	0xed, 0x72, 0xa6, 0x40, 0x93, 0xe6, 0xb6, 0x2a, 0xb9, 0x6d, 0x82, 0x30, 0xa2, 0x9c, 0xbd, 0xc1,
+	0x27, 0x74, 0x36, 0x90, 0x40, 0x6c, 0x01, 0x20, 0xbd, 0xf1, 0x07, 0x3d, 0x2a, 0x2b, 0x37, 0xc0,
+	0x99, 0x15, 0xa8, 0xcc, 0xb1, 0x52, 0x76, 0xf5, 0x34, 0x59, 0xe6, 0xeb, 0xc2, 0xf2, 0x0b, 0xa5
+    };
+
+    const std::vector<CK_BYTE> secp521r1_point {
+	0x04, 0x81, 0x85,	// DER OCTET STRING
+	0x04,
+	0x00, 0x3c, 0x9d, 0xec, 0xb7, 0x86, 0xa2, 0xe7, 0xca, 0xcb, 0xcd, 0x72, 0x84, 0xf2, 0x11, 0x66,
+	0x04, 0xca, 0x62, 0x33, 0x9c, 0x36, 0x0d, 0x9d, 0xe1, 0xa1, 0x6b, 0xff, 0xf6, 0x7d, 0x86, 0x3b,
+	0x05, 0x36, 0xce, 0x65, 0x3f, 0xf3, 0x93, 0x4f, 0x5f, 0xed, 0x5b, 0xf9, 0x72, 0x27, 0x81, 0x6a,
+	0x6e, 0xb8, 0xad, 0xbc, 0xd8, 0xba, 0xcd, 0x97, 0x4d, 0xcc, 0x73, 0xfd, 0x8d, 0x84, 0x63, 0x3d,
+	0xe1, 0xbc,
+	0x00, 0xab, 0x07, 0xc2, 0x9c, 0x04, 0x77, 0xad, 0xc4, 0xb9, 0xe8, 0x6d, 0x15, 0x7f, 0x44, 0x4b,
+	0xd8, 0x6c, 0x68, 0x7a, 0x10, 0xc2, 0x9b, 0xc6, 0xda, 0x80, 0xcc, 0x5a, 0x3e, 0x3d, 0x69, 0xfa,
+	0x8f, 0xaa, 0x33, 0x03, 0x7c, 0x86, 0x89, 0xa4, 0x7c, 0x6a, 0x88, 0x7a, 0x79, 0x26, 0x52, 0x9b,
+	0x7d, 0xb9, 0x8c, 0x82, 0xab, 0x66, 0x42, 0x88, 0x78, 0x88, 0x04, 0x96, 0x8a, 0xfc, 0x74, 0xdb,
+	0xbb, 0x2b
+    };
+
+    using Attributes = std::map<CK_ATTRIBUTE_TYPE, std::vector<CK_BYTE> >;
+
+    struct MockObject {
+	Attributes attributes;
+	CK_SESSION_HANDLE owner;	// session that created the object, or 0 for token objects
+    };
+
+    struct Operation {
+	bool active { false };
+	CK_MECHANISM_TYPE mechanism { 0 };
+	CK_OBJECT_HANDLE key { 0 };
+    };
+
+    struct MockSession {
+	CK_SLOT_ID slot;
+	CK_FLAGS flags;
+	Operation encrypt, decrypt, sign;
+	bool finding { false };
+	std::vector<CK_OBJECT_HANDLE> found;
+	size_t foundpos { 0 };
+    };
+
+    // library lock. When the application provides mutex callbacks in C_Initialize(), we use them
+    class LibraryLock {
+	CK_C_INITIALIZE_ARGS m_args {};
+	CK_VOID_PTR m_appmutex { nullptr };
+	std::mutex m_mtx;
+
+    public:
+	void setup(CK_C_INITIALIZE_ARGS_PTR args) {
+	    if(args && args->CreateMutex && args->DestroyMutex && args->LockMutex && args->UnlockMutex) {
+		m_args = *args;
+		m_args.CreateMutex(&m_appmutex);
+	    }
+	}
+
+	void teardown() {
+	    if(m_appmutex) {
+		m_args.DestroyMutex(m_appmutex);
+		m_appmutex = nullptr;
+	    }
+	}
+
+	void lock() { if(m_appmutex) m_args.LockMutex(m_appmutex); else m_mtx.lock(); }
+	void unlock() { if(m_appmutex) m_args.UnlockMutex(m_appmutex); else m_mtx.unlock(); }
+    };
+
+    struct MockState {
+	std::atomic<bool> initialized { false };
+	DeviceModel model;
+	std::shared_ptr<CorePool> cores;   // device-wide cores, nullptr when unlimited
+	std::mutex device_mtx;		   // used when model.global_lock is set
+	LibraryLock lock;
+	std::map<CK_OBJECT_HANDLE, MockObject> objects;
+	std::map<CK_SESSION_HANDLE, MockSession> sessions;
+	CK_OBJECT_HANDLE next_object { 1 };
+	CK_SESSION_HANDLE next_session { 1 };
+	bool logged_in { false };
+	std::chrono::steady_clock::time_point epoch; // time of C_Initialize()
+	uint64_t failovers { 0 };	   // number of failovers that occurred
+    };
+
+    MockState state;
+
+    constexpr CK_SLOT_ID mock_slot = 0;
+
+    std::mt19937_64 &rng()
+    {
+	thread_local std::mt19937_64 generator { std::random_device{}() };
+	return generator;
+    }
+
+    struct StateGuard {
+	StateGuard() { state.lock.lock(); }
+	~StateGuard() { state.lock.unlock(); }
+    };
+
+    // spend the given amount of time. Most of it is spent sleeping, the last part spinning.
+    void spend(double us)
+    {
+	using namespace std::chrono;
+
+	if(us<=0.0) {
+	    return;
+	}
+
+	auto deadline = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double, std::micro>(us));
+	if(us > state.model.spin_us) {
+	    std::this_thread::sleep_until(deadline - duration_cast<steady_clock::duration>(duration<double, std::micro>(state.model.spin_us)));
+	}
+	while(steady_clock::now() < deadline) {
+	    // spin
+	}
+    }
+
+    void half_rtt()
+    {
+	if(state.model.rtt_us > 0.0) {
+	    double rtt = state.model.rtt_us;
+	    if(state.model.rtt_jitter_us > 0.0) {
+		rtt = std::max(0.0, std::normal_distribution<double>(rtt, state.model.rtt_jitter_us)(rng()));
+	    }
+	    spend(rtt/2.0);
+	}
+    }
+
+    // failover(): when a failover is due, drop all sessions. returns the outage error code while it lasts
+    CK_RV failover()
+    {
+	auto &model = state.model.failover;
+	if(model.after_ms<=0.0) {
+	    return CKR_OK;
+	}
+
+	auto now_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.epoch).count();
+	if(now_ms < model.after_ms) {
+	    return CKR_OK;
+	}
+
+	uint64_t event = model.every_ms > 0.0 ? static_cast<uint64_t>((now_ms - model.after_ms) / model.every_ms) : 0;
+	auto since_ms = now_ms - model.after_ms - event * model.every_ms;
+
+	StateGuard guard;
+	if(event >= state.failovers) {
+	    state.failovers = event + 1;
+	    for(auto it = state.objects.begin(); it!=state.objects.end(); ) {
+		it = model.drop_session_objects && it->second.owner!=0 ? state.objects.erase(it) : std::next(it);
+	    }
+	    state.sessions.clear();
+	    state.logged_in = false;
+	    return model.error_code; // the call that hits the failover fails, even without outage
+	}
+
+	return since_ms < model.outage_ms ? model.error_code : CKR_OK;
+    }
+
+    // charge a call to the device. if mech is given, a crypto core is occupied for the service time of that mechanism
+    CK_RV device_call(const char *function, std::optional<CK_MECHANISM_TYPE> mech = std::nullopt)
+    {
+	CK_RV rv = failover();
+	if(rv!=CKR_OK) {
+	    return rv;
+	}
+
+	half_rtt();		// request goes to the device
+	{
+	    std::unique_lock<std::mutex> serialize(state.device_mtx, std::defer_lock);
+	    if(state.model.global_lock) {
+		serialize.lock();
+	    }
+
+	    auto fn = state.model.functions.find(function);
+	    if(fn!=state.model.functions.end()) {
+		spend(fn->second.sample(rng()));
+		if(fn->second.error_rate > 0.0 && std::uniform_real_distribution<double>(0.0,1.0)(rng()) < fn->second.error_rate) {
+		    rv = fn->second.error_code;
+		}
+	    }
+
+	    if(mech && rv==CKR_OK) {
+		auto &service = state.model.service(*mech);
+		CorePool *pool = service.cores ? service.cores.get() : state.cores.get();
+
+		if(pool) pool->acquire();
+		spend(service.sample(rng()));
+		if(pool) pool->release();
+
+		if(service.error_rate > 0.0 && std::uniform_real_distribution<double>(0.0,1.0)(rng()) < service.error_rate) {
+		    rv = service.error_code;
+		}
+	    }
+	}
+	half_rtt();		// response comes back
+
+	return rv;
+    }
+
+    void padded_copy(CK_UTF8CHAR *dest, size_t len, const std::string &src)
+    {
+	std::memset(dest, ' ', len);
+	std::memcpy(dest, src.data(), std::min(len, src.size()));
+    }
+
+    template <typename T>
+    std::vector<CK_BYTE> to_bytes(const T &value)
+    {
+	auto ptr = reinterpret_cast<const CK_BYTE *>(&value);
+	return std::vector<CK_BYTE>(ptr, ptr + sizeof value);
+    }
+
+    template <typename T>
+    T from_bytes(const Attributes &attrs, CK_ATTRIBUTE_TYPE type, T defval)
+    {
+	auto found = attrs.find(type);
+	if(found==attrs.end() || found->second.size()!=sizeof(T)) {
+	    return defval;
+	}
+	T rv;
+	std::memcpy(&rv, found->second.data(), sizeof rv);
+	return rv;
+    }
+
+    void merge_template(Attributes &attrs, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
+    {
+	for(CK_ULONG i=0; i<ulCount; i++) {
+	    auto ptr = reinterpret_cast<const CK_BYTE *>(pTemplate[i].pValue);
+	    attrs[pTemplate[i].type] = ptr ? std::vector<CK_BYTE>(ptr, ptr+pTemplate[i].ulValueLen) : std::vector<CK_BYTE>();
+	}
+    }
+
+    // must be called with state locked
+    CK_OBJECT_HANDLE store_object(CK_SESSION_HANDLE hSession, Attributes &&attrs)
+    {
+	CK_OBJECT_HANDLE handle = state.next_object++;
+	bool token = from_bytes<CK_BBOOL>(attrs, CKA_TOKEN, CK_FALSE);
+	state.objects[handle] = MockObject { std::move(attrs), token ? 0 : hSession };
+	return handle;
+    }
+
+    // the size of the key, in bytes
+    size_t key_bytes(const Attributes &attrs)
+    {
+	auto modulus = attrs.find(CKA_MODULUS);
+	if(modulus!=attrs.end()) {
+	    return modulus->second.size();
+	}
+
+	auto ec_params = attrs.find(CKA_EC_PARAMS);
+	if(ec_params!=attrs.end()) {
+	    if(ec_params->second==secp384r1_oid) return 48;
+	    if(ec_params->second==secp521r1_oid) return 66;
+	    return 32;
+	}
+
+	return from_bytes<CK_ULONG>(attrs, CKA_VALUE_LEN, 16);
+    }
+
+    // size of the output produced by a mechanism
+    size_t output_length(CK_MECHANISM_TYPE mech, const Attributes &key, size_t inlen, bool decrypt)
+    {
+	switch(mech) {
+	case CKM_RSA_PKCS:
+	case CKM_SHA256_RSA_PKCS:
+	case CKM_RSA_PKCS_OAEP:
+	    return decrypt ? std::min<size_t>(inlen, 32) : key_bytes(key);
+
+	case CKM_ECDSA:
+	    return 2 * key_bytes(key);
+
+	case CKM_SHA_1_HMAC:
+	    return 20;
+
+	case CKM_SHA256_HMAC:
+	    return 32;
+
+	case CKM_SHA512_HMAC:
+	    return 64;
+
+	case CKM_AES_GCM:
+	    return decrypt ? (inlen > 16 ? inlen - 16 : 0) : inlen + 16;
+
+	default:
+	    return inlen;
+	}
+    }
+
+    bool is_supported(CK_MECHANISM_TYPE mech)
+    {
+	return std::any_of(supported_mechanisms.begin(),
+			   supported_mechanisms.end(),
+			   [mech] (const MechanismEntry &entry) { return entry.type==mech; });
+    }
+
+    CK_RV check_session(CK_SESSION_HANDLE hSession)
+    {
+	if(!state.initialized) {
+	    return CKR_CRYPTOKI_NOT_INITIALIZED;
+	}
+	return state.sessions.count(hSession) ? CKR_OK : CKR_SESSION_HANDLE_INVALID;
+    }
+
+    CK_RV operation_init(CK_SESSION_HANDLE hSession, Operation MockSession::*op, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+	StateGuard guard;
+	CK_RV rv = check_session(hSession);
+
+	if(rv!=CKR_OK) return rv;
+	if(!pMechanism) return CKR_ARGUMENTS_BAD;
+	if(!is_supported(pMechanism->mechanism)) return CKR_MECHANISM_INVALID;
+	if(state.objects.count(hKey)==0) return CKR_KEY_HANDLE_INVALID;
+
+	auto &operation = state.sessions[hSession].*op;
+	if(operation.active) return CKR_OPERATION_ACTIVE;
+
+	operation = Operation { true, pMechanism->mechanism, hKey };
+	return CKR_OK;
+    }
+
+    // common logic for C_Encrypt(), C_Decrypt() and C_Sign()
+    CK_RV operation_final(const char *function,
+			  CK_SESSION_HANDLE hSession,
+			  Operation MockSession::*op,
+			  CK_ULONG ulDataLen,
+			  CK_BYTE_PTR pOut,
+			  CK_ULONG_PTR pulOutLen,
+			  bool decrypt)
+    {
+	Operation operation;
+	size_t outlen;
+
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+
+	    operation = state.sessions[hSession].*op;
+	    if(!operation.active) return CKR_OPERATION_NOT_INITIALIZED;
+	    if(!pulOutLen) return CKR_ARGUMENTS_BAD;
+
+	    auto key = state.objects.find(operation.key);
+	    if(key==state.objects.end()) {
+		(state.sessions[hSession].*op).active = false;
+		return CKR_KEY_HANDLE_INVALID;
+	    }
+
+	    outlen = output_length(operation.mechanism, key->second.attributes, ulDataLen, decrypt);
+
+	    // length query: the operation remains active
+	    if(!pOut) {
+		*pulOutLen = outlen;
+		return CKR_OK;
+	    }
+
+	    if(*pulOutLen < outlen) {
+		*pulOutLen = outlen;
+		return CKR_BUFFER_TOO_SMALL;
+	    }
+
+	    (state.sessions[hSession].*op).active = false; // operation terminates
+	}
+
+	CK_RV rv = device_call(function, operation.mechanism);
+
+	if(rv==CKR_OK) {
+	    std::memset(pOut, 0x5a, outlen);
+	    *pulOutLen = outlen;
+	}
+
+	return rv;
+    }
+
+    bool matches(const Attributes &attrs, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
+    {
+	for(CK_ULONG i=0; i<ulCount; i++) {
+	    auto found = attrs.find(pTemplate[i].type);
+	    if(found==attrs.end()
+	       || found->second.size()!=pTemplate[i].ulValueLen
+	       || (pTemplate[i].ulValueLen && std::memcmp(found->second.data(), pTemplate[i].pValue, pTemplate[i].ulValueLen)!=0)) {
+		return false;
+	    }
+	}
+	return true;
+    }
+
+    template <typename... Args>
+    CK_RV not_supported(Args...)
+    {
+	return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+}
+
+
+//
+// PKCS#11 API
+//
+
+extern "C" {
+
+    static CK_RV mock_C_Initialize(CK_VOID_PTR pInitArgs)
+    {
+	if(state.initialized) {
+	    return CKR_CRYPTOKI_ALREADY_INITIALIZED;
+	}
+
+	auto args = reinterpret_cast<CK_C_INITIALIZE_ARGS_PTR>(pInitArgs);
+	if(args && args->pReserved) {
+	    return CKR_ARGUMENTS_BAD;
+	}
+
+	auto config = std::getenv("P11MOCK_CONFIG");
+	state.model = DeviceModel{};
+	if(config) {
+	    try {
+		state.model = DeviceModel::load(config);
+	    } catch (std::exception &e) {
+		std::fprintf(stderr, "p11mock: cannot load configuration from %s: %s\n", config, e.what());
+		return CKR_GENERAL_ERROR;
+	    }
+	}
+
+	state.cores = state.model.cores>0 ? std::make_shared<CorePool>(state.model.cores) : nullptr;
+	state.epoch = std::chrono::steady_clock::now();
+	state.failovers = 0;
+	state.lock.setup(args);
+	state.initialized = true;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_Finalize(CK_VOID_PTR pReserved)
+    {
+	if(!state.initialized) {
+	    return CKR_CRYPTOKI_NOT_INITIALIZED;
+	}
+
+	{
+	    StateGuard guard;
+	    state.sessions.clear();
+	    state.objects.clear();
+	    state.logged_in = false;
+	    state.initialized = false;
+	}
+	state.lock.teardown();
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetInfo(CK_INFO_PTR pInfo)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(!pInfo) return CKR_ARGUMENTS_BAD;
+
+	pInfo->cryptokiVersion = { 2, 40 };
+	padded_copy(pInfo->manufacturerID, sizeof pInfo->manufacturerID, "p11perftest");
+	pInfo->flags = 0;
+	padded_copy(pInfo->libraryDescription, sizeof pInfo->libraryDescription, "p11perftest mock module");
+	pInfo->libraryVersion = { 1, 0 };
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetSlotList(CK_BBOOL tokenPresent, CK_SLOT_ID_PTR pSlotList, CK_ULONG_PTR pulCount)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(!pulCount) return CKR_ARGUMENTS_BAD;
+
+	if(pSlotList) {
+	    if(*pulCount < 1) {
+		*pulCount = 1;
+		return CKR_BUFFER_TOO_SMALL;
+	    }
+	    pSlotList[0] = mock_slot;
+	}
+	*pulCount = 1;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetSlotInfo(CK_SLOT_ID slotID, CK_SLOT_INFO_PTR pInfo)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+	if(!pInfo) return CKR_ARGUMENTS_BAD;
+
+	padded_copy(pInfo->slotDescription, sizeof pInfo->slotDescription, "p11perftest mock slot");
+	padded_copy(pInfo->manufacturerID, sizeof pInfo->manufacturerID, "p11perftest");
+	pInfo->flags = CKF_TOKEN_PRESENT | CKF_HW_SLOT;
+	pInfo->hardwareVersion = { 1, 0 };
+	pInfo->firmwareVersion = { 1, 0 };
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetTokenInfo(CK_SLOT_ID slotID, CK_TOKEN_INFO_PTR pInfo)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+	if(!pInfo) return CKR_ARGUMENTS_BAD;
+
+	padded_copy(pInfo->label, sizeof pInfo->label, "p11mock");
+	padded_copy(pInfo->manufacturerID, sizeof pInfo->manufacturerID, "p11perftest");
+	padded_copy(pInfo->model, sizeof pInfo->model, "mock");
+	padded_copy(pInfo->serialNumber, sizeof pInfo->serialNumber, "0000000000000001");
+	pInfo->flags = CKF_RNG | CKF_LOGIN_REQUIRED | CKF_USER_PIN_INITIALIZED | CKF_TOKEN_INITIALIZED;
+	pInfo->ulMaxSessionCount = CK_EFFECTIVELY_INFINITE;
+	pInfo->ulMaxRwSessionCount = CK_EFFECTIVELY_INFINITE;
+	{
+	    StateGuard guard;
+	    pInfo->ulSessionCount = state.sessions.size();
+	    pInfo->ulRwSessionCount = state.sessions.size();
+	}
+	pInfo->ulMaxPinLen = 256;
+	pInfo->ulMinPinLen = 1;
+	pInfo->ulTotalPublicMemory = CK_UNAVAILABLE_INFORMATION;
+	pInfo->ulFreePublicMemory = CK_UNAVAILABLE_INFORMATION;
+	pInfo->ulTotalPrivateMemory = CK_UNAVAILABLE_INFORMATION;
+	pInfo->ulFreePrivateMemory = CK_UNAVAILABLE_INFORMATION;
+	pInfo->hardwareVersion = { 1, 0 };
+	pInfo->firmwareVersion = { 1, 0 };
+	padded_copy(pInfo->utcTime, sizeof pInfo->utcTime, "");
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetMechanismList(CK_SLOT_ID slotID, CK_MECHANISM_TYPE_PTR pMechanismList, CK_ULONG_PTR pulCount)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+	if(!pulCount) return CKR_ARGUMENTS_BAD;
+
+	if(pMechanismList) {
+	    if(*pulCount < supported_mechanisms.size()) {
+		*pulCount = supported_mechanisms.size();
+		return CKR_BUFFER_TOO_SMALL;
+	    }
+	    for(size_t i=0; i<supported_mechanisms.size(); i++) {
+		pMechanismList[i] = supported_mechanisms[i].type;
+	    }
+	}
+	*pulCount = supported_mechanisms.size();
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetMechanismInfo(CK_SLOT_ID slotID, CK_MECHANISM_TYPE type, CK_MECHANISM_INFO_PTR pInfo)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+	if(!pInfo) return CKR_ARGUMENTS_BAD;
+
+	for(auto &entry: supported_mechanisms) {
+	    if(entry.type==type) {
+		pInfo->ulMinKeySize = entry.min_keysize;
+		pInfo->ulMaxKeySize = entry.max_keysize;
+		pInfo->flags = entry.flags;
+		return CKR_OK;
+	    }
+	}
+
+	return CKR_MECHANISM_INVALID;
+    }
+
+    static CK_RV mock_C_OpenSession(CK_SLOT_ID slotID, CK_FLAGS flags, CK_VOID_PTR pApplication, CK_NOTIFY Notify, CK_SESSION_HANDLE_PTR phSession)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+	if(!(flags & CKF_SERIAL_SESSION)) return CKR_SESSION_PARALLEL_NOT_SUPPORTED;
+	if(!phSession) return CKR_ARGUMENTS_BAD;
+
+	CK_RV rv = device_call("C_OpenSession");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	*phSession = state.next_session++;
+	state.sessions[*phSession] = MockSession { slotID, flags };
+
+	return CKR_OK;
+    }
+
+    // must be called with state locked
+    static void close_session(CK_SESSION_HANDLE hSession)
+    {
+	// session objects are destroyed with the session that created them
+	for(auto it = state.objects.begin(); it!=state.objects.end(); ) {
+	    it = it->second.owner==hSession ? state.objects.erase(it) : std::next(it);
+	}
+	state.sessions.erase(hSession);
+
+	// closing the last session logs the application out
+	if(state.sessions.empty()) {
+	    state.logged_in = false;
+	}
+    }
+
+    static CK_RV mock_C_CloseSession(CK_SESSION_HANDLE hSession)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	}
+
+	CK_RV rv = device_call("C_CloseSession");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	close_session(hSession);
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_CloseAllSessions(CK_SLOT_ID slotID)
+    {
+	if(!state.initialized) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if(slotID!=mock_slot) return CKR_SLOT_ID_INVALID;
+
+	StateGuard guard;
+	while(!state.sessions.empty()) {
+	    close_session(state.sessions.begin()->first);
+	}
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetSessionInfo(CK_SESSION_HANDLE hSession, CK_SESSION_INFO_PTR pInfo)
+    {
+	MockSession session;
+	bool logged_in;
+
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pInfo) return CKR_ARGUMENTS_BAD;
+
+	    session = state.sessions[hSession];
+	    logged_in = state.logged_in;
+	}
+
+	CK_RV rv = device_call("C_GetSessionInfo");
+	if(rv!=CKR_OK) return rv;
+
+	pInfo->slotID = session.slot;
+	pInfo->flags = session.flags;
+	pInfo->ulDeviceError = 0;
+	if(session.flags & CKF_RW_SESSION) {
+	    pInfo->state = logged_in ? CKS_RW_USER_FUNCTIONS : CKS_RW_PUBLIC_SESSION;
+	} else {
+	    pInfo->state = logged_in ? CKS_RO_USER_FUNCTIONS : CKS_RO_PUBLIC_SESSION;
+	}
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_Login(CK_SESSION_HANDLE hSession, CK_USER_TYPE userType, CK_UTF8CHAR_PTR pPin, CK_ULONG ulPinLen)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(userType!=CKU_USER) return CKR_USER_TYPE_INVALID;
+	    if(state.logged_in) return CKR_USER_ALREADY_LOGGED_IN;
+	}
+
+	CK_RV rv = device_call("C_Login");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	state.logged_in = true;	// any PIN is accepted
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_Logout(CK_SESSION_HANDLE hSession)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!state.logged_in) return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	CK_RV rv = device_call("C_Logout");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	state.logged_in = false;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_CreateObject(CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phObject)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!phObject || (!pTemplate && ulCount)) return CKR_ARGUMENTS_BAD;
+	}
+
+	CK_RV rv = device_call("C_CreateObject");
+	if(rv!=CKR_OK) return rv;
+
+	Attributes attrs;
+	merge_template(attrs, pTemplate, ulCount);
+
+	StateGuard guard;
+	*phObject = store_object(hSession, std::move(attrs));
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_DestroyObject(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(state.objects.count(hObject)==0) return CKR_OBJECT_HANDLE_INVALID;
+	}
+
+	CK_RV rv = device_call("C_DestroyObject");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	state.objects.erase(hObject);
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GetAttributeValue(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(state.objects.count(hObject)==0) return CKR_OBJECT_HANDLE_INVALID;
+	    if(!pTemplate && ulCount) return CKR_ARGUMENTS_BAD;
+	}
+
+	CK_RV rv = device_call("C_GetAttributeValue");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	auto obj = state.objects.find(hObject);
+	if(obj==state.objects.end()) return CKR_OBJECT_HANDLE_INVALID;
+
+	for(CK_ULONG i=0; i<ulCount; i++) {
+	    auto found = obj->second.attributes.find(pTemplate[i].type);
+	    if(found==obj->second.attributes.end()) {
+		pTemplate[i].ulValueLen = CK_UNAVAILABLE_INFORMATION;
+		rv = CKR_ATTRIBUTE_TYPE_INVALID;
+	    } else if(pTemplate[i].pValue==nullptr) {
+		pTemplate[i].ulValueLen = found->second.size();
+	    } else if(pTemplate[i].ulValueLen < found->second.size()) {
+		pTemplate[i].ulValueLen = CK_UNAVAILABLE_INFORMATION;
+		rv = CKR_BUFFER_TOO_SMALL;
+	    } else {
+		std::memcpy(pTemplate[i].pValue, found->second.data(), found->second.size());
+		pTemplate[i].ulValueLen = found->second.size();
+	    }
+	}
+
+	return rv;
+    }
+
+    static CK_RV mock_C_FindObjectsInit(CK_SESSION_HANDLE hSession, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(state.sessions[hSession].finding) return CKR_OPERATION_ACTIVE;
+	}
+
+	CK_RV rv = device_call("C_FindObjectsInit");
+	if(rv!=CKR_OK) return rv;
+
+	// the session may have been lost by a failover, during the call
+	StateGuard guard;
+	auto it = state.sessions.find(hSession);
+	if(it==state.sessions.end()) return CKR_SESSION_HANDLE_INVALID;
+	auto &session = it->second;
+	session.found.clear();
+	session.foundpos = 0;
+	for(auto &obj: state.objects) {
+	    if(matches(obj.second.attributes, pTemplate, ulCount)) {
+		session.found.push_back(obj.first);
+	    }
+	}
+	session.finding = true;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_FindObjects(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE_PTR phObject, CK_ULONG ulMaxObjectCount, CK_ULONG_PTR pulObjectCount)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!state.sessions[hSession].finding) return CKR_OPERATION_NOT_INITIALIZED;
+	    if(!phObject || !pulObjectCount) return CKR_ARGUMENTS_BAD;
+	}
+
+	CK_RV rv = device_call("C_FindObjects");
+	if(rv!=CKR_OK) return rv;
+
+	StateGuard guard;
+	auto it = state.sessions.find(hSession);
+	if(it==state.sessions.end()) return CKR_SESSION_HANDLE_INVALID;
+	auto &session = it->second;
+	CK_ULONG count = 0;
+	while(count < ulMaxObjectCount && session.foundpos < session.found.size()) {
+	    phObject[count++] = session.found[session.foundpos++];
+	}
+	*pulObjectCount = count;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_FindObjectsFinal(CK_SESSION_HANDLE hSession)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!state.sessions[hSession].finding) return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	CK_RV rv = device_call("C_FindObjectsFinal");
+
+	StateGuard guard;
+	auto it = state.sessions.find(hSession);
+	if(it==state.sessions.end()) return CKR_SESSION_HANDLE_INVALID;
+	it->second.finding = false;
+	it->second.found.clear();
+
+	return rv;
+    }
+
+    static CK_RV mock_C_EncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+	return operation_init(hSession, &MockSession::encrypt, pMechanism, hKey);
+    }
+
+    static CK_RV mock_C_Encrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pEncryptedData, CK_ULONG_PTR pulEncryptedDataLen)
+    {
+	return operation_final("C_Encrypt", hSession, &MockSession::encrypt, ulDataLen, pEncryptedData, pulEncryptedDataLen, false);
+    }
+
+    static CK_RV mock_C_DecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+	return operation_init(hSession, &MockSession::decrypt, pMechanism, hKey);
+    }
+
+    static CK_RV mock_C_Decrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen)
+    {
+	return operation_final("C_Decrypt", hSession, &MockSession::decrypt, ulEncryptedDataLen, pData, pulDataLen, true);
+    }
+
+    static CK_RV mock_C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+	return operation_init(hSession, &MockSession::sign, pMechanism, hKey);
+    }
+
+    static CK_RV mock_C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+    {
+	return operation_final("C_Sign", hSession, &MockSession::sign, ulDataLen, pSignature, pulSignatureLen, false);
+    }
+
+    static CK_RV mock_C_GenerateKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phKey)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pMechanism || !phKey) return CKR_ARGUMENTS_BAD;
+	    if(!is_supported(pMechanism->mechanism)) return CKR_MECHANISM_INVALID;
+	}
+
+	CK_RV rv = device_call("C_GenerateKey", pMechanism->mechanism);
+	if(rv!=CKR_OK) return rv;
+
+	Attributes attrs;
+	attrs[CKA_CLASS] = to_bytes<CK_OBJECT_CLASS>(CKO_SECRET_KEY);
+
+	switch(pMechanism->mechanism) {
+	case CKM_AES_KEY_GEN:
+	    attrs[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_AES);
+	    break;
+
+	case CKM_DES2_KEY_GEN:
+	    attrs[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_DES2);
+	    attrs[CKA_VALUE_LEN] = to_bytes<CK_ULONG>(16);
+	    break;
+
+	case CKM_DES3_KEY_GEN:
+	    attrs[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_DES3);
+	    attrs[CKA_VALUE_LEN] = to_bytes<CK_ULONG>(24);
+	    break;
+
+	default:
+	    attrs[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_GENERIC_SECRET);
+	}
+
+	merge_template(attrs, pTemplate, ulCount);
+
+	StateGuard guard;
+	*phKey = store_object(hSession, std::move(attrs));
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_GenerateKeyPair(CK_SESSION_HANDLE hSession,
+					CK_MECHANISM_PTR pMechanism,
+					CK_ATTRIBUTE_PTR pPublicKeyTemplate,
+					CK_ULONG ulPublicKeyAttributeCount,
+					CK_ATTRIBUTE_PTR pPrivateKeyTemplate,
+					CK_ULONG ulPrivateKeyAttributeCount,
+					CK_OBJECT_HANDLE_PTR phPublicKey,
+					CK_OBJECT_HANDLE_PTR phPrivateKey)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pMechanism || !phPublicKey || !phPrivateKey) return CKR_ARGUMENTS_BAD;
+	    if(pMechanism->mechanism!=CKM_RSA_PKCS_KEY_PAIR_GEN && pMechanism->mechanism!=CKM_EC_KEY_PAIR_GEN) return CKR_MECHANISM_INVALID;
+	}
+
+	CK_RV rv = device_call("C_GenerateKeyPair", pMechanism->mechanism);
+	if(rv!=CKR_OK) return rv;
+
+	Attributes pub, priv;
+	pub[CKA_CLASS] = to_bytes<CK_OBJECT_CLASS>(CKO_PUBLIC_KEY);
+	priv[CKA_CLASS] = to_bytes<CK_OBJECT_CLASS>(CKO_PRIVATE_KEY);
+	merge_template(pub, pPublicKeyTemplate, ulPublicKeyAttributeCount);
+
+	if(pMechanism->mechanism==CKM_RSA_PKCS_KEY_PAIR_GEN) {
+	    auto bits = from_bytes<CK_ULONG>(pub, CKA_MODULUS_BITS, 2048);
+	    std::vector<CK_BYTE> modulus(bits/8, 0xc5); // top bit set, odd
+	    auto exponent = pub.count(CKA_PUBLIC_EXPONENT) ? pub[CKA_PUBLIC_EXPONENT] : std::vector<CK_BYTE>{ 0x01, 0x00, 0x01 };
+
+	    pub[CKA_KEY_TYPE] = priv[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_RSA);
+	    pub[CKA_MODULUS] = priv[CKA_MODULUS] = modulus;
+	    pub[CKA_PUBLIC_EXPONENT] = priv[CKA_PUBLIC_EXPONENT] = exponent;
+	} else {
+	    auto &params = pub[CKA_EC_PARAMS];
+
+	    pub[CKA_KEY_TYPE] = priv[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_EC);
+	    priv[CKA_EC_PARAMS] = params;
+	    pub[CKA_EC_POINT] = params==secp384r1_oid ? secp384r1_point : params==secp521r1_oid ? secp521r1_point : secp256r1_point;
+	}
+
+	merge_template(priv, pPrivateKeyTemplate, ulPrivateKeyAttributeCount);
+
+	StateGuard guard;
+	*phPublicKey = store_object(hSession, std::move(pub));
+	*phPrivateKey = store_object(hSession, std::move(priv));
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_WrapKey(CK_SESSION_HANDLE hSession,
+				CK_MECHANISM_PTR pMechanism,
+				CK_OBJECT_HANDLE hWrappingKey,
+				CK_OBJECT_HANDLE hKey,
+				CK_BYTE_PTR pWrappedKey,
+				CK_ULONG_PTR pulWrappedKeyLen)
+    {
+	size_t outlen;
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pMechanism || !pulWrappedKeyLen) return CKR_ARGUMENTS_BAD;
+	    if(!is_supported(pMechanism->mechanism)) return CKR_MECHANISM_INVALID;
+
+	    auto wrapping = state.objects.find(hWrappingKey);
+	    if(wrapping==state.objects.end()) return CKR_WRAPPING_KEY_HANDLE_INVALID;
+	    if(state.objects.count(hKey)==0) return CKR_KEY_HANDLE_INVALID;
+
+	    outlen = key_bytes(wrapping->second.attributes);
+	    if(!pWrappedKey) {
+		*pulWrappedKeyLen = outlen;
+		return CKR_OK;
+	    }
+	    if(*pulWrappedKeyLen < outlen) {
+		*pulWrappedKeyLen = outlen;
+		return CKR_BUFFER_TOO_SMALL;
+	    }
+	}
+
+	CK_RV rv = device_call("C_WrapKey", pMechanism->mechanism);
+	if(rv!=CKR_OK) return rv;
+
+	std::memset(pWrappedKey, 0xa5, outlen);
+	*pulWrappedKeyLen = outlen;
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_UnwrapKey(CK_SESSION_HANDLE hSession,
+				  CK_MECHANISM_PTR pMechanism,
+				  CK_OBJECT_HANDLE hUnwrappingKey,
+				  CK_BYTE_PTR pWrappedKey,
+				  CK_ULONG ulWrappedKeyLen,
+				  CK_ATTRIBUTE_PTR pTemplate,
+				  CK_ULONG ulAttributeCount,
+				  CK_OBJECT_HANDLE_PTR phKey)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pMechanism || !phKey) return CKR_ARGUMENTS_BAD;
+	    if(!is_supported(pMechanism->mechanism)) return CKR_MECHANISM_INVALID;
+	    if(state.objects.count(hUnwrappingKey)==0) return CKR_UNWRAPPING_KEY_HANDLE_INVALID;
+	}
+
+	CK_RV rv = device_call("C_UnwrapKey", pMechanism->mechanism);
+	if(rv!=CKR_OK) return rv;
+
+	Attributes attrs;
+	attrs[CKA_VALUE_LEN] = to_bytes<CK_ULONG>(32);
+	merge_template(attrs, pTemplate, ulAttributeCount);
+
+	StateGuard guard;
+	*phKey = store_object(hSession, std::move(attrs));
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_DeriveKey(CK_SESSION_HANDLE hSession,
+				  CK_MECHANISM_PTR pMechanism,
+				  CK_OBJECT_HANDLE hBaseKey,
+				  CK_ATTRIBUTE_PTR pTemplate,
+				  CK_ULONG ulAttributeCount,
+				  CK_OBJECT_HANDLE_PTR phKey)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pMechanism || !phKey) return CKR_ARGUMENTS_BAD;
+	    if(!is_supported(pMechanism->mechanism)) return CKR_MECHANISM_INVALID;
+	    if(state.objects.count(hBaseKey)==0) return CKR_KEY_HANDLE_INVALID;
+	}
+
+	CK_RV rv = device_call("C_DeriveKey", pMechanism->mechanism);
+	if(rv!=CKR_OK) return rv;
+
+	Attributes attrs;
+	attrs[CKA_CLASS] = to_bytes<CK_OBJECT_CLASS>(CKO_SECRET_KEY);
+	attrs[CKA_KEY_TYPE] = to_bytes<CK_KEY_TYPE>(CKK_GENERIC_SECRET);
+	merge_template(attrs, pTemplate, ulAttributeCount);
+
+	StateGuard guard;
+	*phKey = store_object(hSession, std::move(attrs));
+
+	return CKR_OK;
+    }
+
+    static CK_RV mock_C_SeedRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	}
+
+	return device_call("C_SeedRandom");
+    }
+
+    static CK_RV mock_C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData, CK_ULONG ulRandomLen)
+    {
+	{
+	    StateGuard guard;
+	    CK_RV rv = check_session(hSession);
+	    if(rv!=CKR_OK) return rv;
+	    if(!pRandomData && ulRandomLen) return CKR_ARGUMENTS_BAD;
+	}
+
+	CK_RV rv = device_call("C_GenerateRandom");
+	if(rv==CKR_OK) {
+	    std::generate(pRandomData, pRandomData+ulRandomLen, [] () { return static_cast<CK_BYTE>(rng()()); });
+	}
+
+	return rv;
+    }
+
+    static CK_FUNCTION_LIST mock_function_list = [] () {
+	CK_FUNCTION_LIST fl;
+
+	fl.version = { 2, 40 };
+	fl.C_Initialize = mock_C_Initialize;
+	fl.C_Finalize = mock_C_Finalize;
+	fl.C_GetInfo = mock_C_GetInfo;
+	fl.C_GetFunctionList = C_GetFunctionList;
+	fl.C_GetSlotList = mock_C_GetSlotList;
+	fl.C_GetSlotInfo = mock_C_GetSlotInfo;
+	fl.C_GetTokenInfo = mock_C_GetTokenInfo;
+	fl.C_GetMechanismList = mock_C_GetMechanismList;
+	fl.C_GetMechanismInfo = mock_C_GetMechanismInfo;
+	fl.C_InitToken = not_supported;
+	fl.C_InitPIN = not_supported;
+	fl.C_SetPIN = not_supported;
+	fl.C_OpenSession = mock_C_OpenSession;
+	fl.C_CloseSession = mock_C_CloseSession;
+	fl.C_CloseAllSessions = mock_C_CloseAllSessions;
+	fl.C_GetSessionInfo = mock_C_GetSessionInfo;
+	fl.C_GetOperationState = not_supported;
+	fl.C_SetOperationState = not_supported;
+	fl.C_Login = mock_C_Login;
+	fl.C_Logout = mock_C_Logout;
+	fl.C_CreateObject = mock_C_CreateObject;
+	fl.C_CopyObject = not_supported;
+	fl.C_DestroyObject = mock_C_DestroyObject;
+	fl.C_GetObjectSize = not_supported;
+	fl.C_GetAttributeValue = mock_C_GetAttributeValue;
+	fl.C_SetAttributeValue = not_supported;
+	fl.C_FindObjectsInit = mock_C_FindObjectsInit;
+	fl.C_FindObjects = mock_C_FindObjects;
+	fl.C_FindObjectsFinal = mock_C_FindObjectsFinal;
+	fl.C_EncryptInit = mock_C_EncryptInit;
+	fl.C_Encrypt = mock_C_Encrypt;
+	fl.C_EncryptUpdate = not_supported;
+	fl.C_EncryptFinal = not_supported;
+	fl.C_DecryptInit = mock_C_DecryptInit;
+	fl.C_Decrypt = mock_C_Decrypt;
+	fl.C_DecryptUpdate = not_supported;
+	fl.C_DecryptFinal = not_supported;
+	fl.C_DigestInit = not_supported;
+	fl.C_Digest = not_supported;
+	fl.C_DigestUpdate = not_supported;
+	fl.C_DigestKey = not_supported;
+	fl.C_DigestFinal = not_supported;
+	fl.C_SignInit = mock_C_SignInit;
+	fl.C_Sign = mock_C_Sign;
+	fl.C_SignUpdate = not_supported;
+	fl.C_SignFinal = not_supported;
+	fl.C_SignRecoverInit = not_supported;
+	fl.C_SignRecover = not_supported;
+	fl.C_VerifyInit = not_supported;
+	fl.C_Verify = not_supported;
+	fl.C_VerifyUpdate = not_supported;
+	fl.C_VerifyFinal = not_supported;
+	fl.C_VerifyRecoverInit = not_supported;
+	fl.C_VerifyRecover = not_supported;
+	fl.C_DigestEncryptUpdate = not_supported;
+	fl.C_DecryptDigestUpdate = not_supported;
+	fl.C_SignEncryptUpdate = not_supported;
+	fl.C_DecryptVerifyUpdate = not_supported;
+	fl.C_GenerateKey = mock_C_GenerateKey;
+	fl.C_GenerateKeyPair = mock_C_GenerateKeyPair;
+	fl.C_WrapKey = mock_C_WrapKey;
+	fl.C_UnwrapKey = mock_C_UnwrapKey;
+	fl.C_DeriveKey = mock_C_DeriveKey;
+	fl.C_SeedRandom = mock_C_SeedRandom;
+	fl.C_GenerateRandom = mock_C_GenerateRandom;
+	fl.C_GetFunctionStatus = not_supported;
+	fl.C_CancelFunction = not_supported;
+	fl.C_WaitForSlotEvent = not_supported;
+
+	return fl;
+    }();
+
+    __attribute__((visibility("default")))
+    CK_RV C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
+    {
+	if(!ppFunctionList) {
+	    return CKR_ARGUMENTS_BAD;
+	}
+	*ppFunctionList = &mock_function_list;
+	return CKR_OK;
+    }
+}
+
+// EOF
@@ -0,0 +1,116 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11mock.hpp: a mock PKCS#11 module, with a configurable latency and concurrency model
+//
+// The module does not perform any real cryptography: it returns buffers of the expected size,
+// after having spent the amount of time dictated by the model. It is meant to validate
+// the statistics of the executor, to measure the overhead of the harness, and to rehearse
+// capacity plans without access to a real device.
+//
+// The model is read from a JSON file, which path is given by the P11MOCK_CONFIG environment variable.
+// When the variable is not set, every call returns immediately.
+
+#if !defined(P11MOCK_H)
+#define P11MOCK_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <memory>
+#include <botan/p11.h>
+
+namespace p11mock {
+
+    // a counting semaphore, to model a pool of crypto cores
+    class CorePool
+    {
+	std::mutex m_mtx;
+	std::condition_variable m_cond;
+	int m_available;
+
+    public:
+	CorePool(int cores) : m_available(cores) { }
+
+	void acquire();
+	void release();
+    };
+
+    // service time distribution
+    struct ServiceModel
+    {
+	enum class Distribution {
+	    constant,		// always mean
+	    uniform,		// uniform in [mean-stddev, mean+stddev]
+	    normal,		// gaussian, truncated at 0
+	    exponential,	// exponential of given mean (stddev ignored)
+	    lognormal		// lognormal with given mean and stddev
+	};
+
+	Distribution distribution { Distribution::constant };
+	double mean_us { 0.0 };	// average service time, in microseconds
+	double stddev_us { 0.0 }; // standard deviation of service time, in microseconds
+	double error_rate { 0.0 }; // probability to return error_code instead of CKR_OK
+	CK_RV error_code { CKR_DEVICE_ERROR };
+	std::shared_ptr<CorePool> cores; // dedicated engine, or nullptr to use device cores
+
+	double sample(std::mt19937_64 &rng) const; // returns a service time, in microseconds
+    };
+
+    // failover of the device, e.g. a network HSM switching to another member of its cluster.
+    // upon failover, all sessions are lost, and the application is logged out.
+    // the device is then unreachable for the duration of the outage.
+    struct FailoverModel
+    {
+	double after_ms { 0.0 };  // time of first failover, since C_Initialize() (0 means never)
+	double every_ms { 0.0 };  // period of subsequent failovers (0 means only once)
+	double outage_ms { 0.0 }; // duration during which device calls fail
+	CK_RV error_code { CKR_DEVICE_REMOVED }; // returned by device calls during outage
+	bool drop_session_objects { false }; // when false, session objects survive (e.g. replicated across the cluster)
+    };
+
+    // whole device model
+    struct DeviceModel
+    {
+	int cores { 0 };	  // number of parallel crypto cores (0 means unlimited)
+	bool global_lock { false }; // when true, all calls to the device are serialized
+	double rtt_us { 0.0 };	  // network round trip time, in microseconds
+	double rtt_jitter_us { 0.0 }; // standard deviation of RTT, in microseconds
+	double spin_us { 50.0 };  // the last part of any wait is spent spinning, for accuracy
+
+	ServiceModel default_service; // used when no mechanism-specific entry is found
+	std::map<CK_MECHANISM_TYPE, ServiceModel> services;
+	std::map<std::string, ServiceModel> functions; // extra cost of API calls, by function name
+	FailoverModel failover;
+
+	const ServiceModel &service(CK_MECHANISM_TYPE mech) const;
+
+	static DeviceModel load(const std::string &path); // throws std::runtime_error on parsing error
+    };
+
+    // parse a distribution name
+    ServiceModel::Distribution distribution(const std::string &name);
+
+    // mechanism name <-> value
+    CK_MECHANISM_TYPE mechanism(const std::string &name);
+    std::string mechanism(CK_MECHANISM_TYPE mech);
+}
+
+#endif // P11MOCK_H
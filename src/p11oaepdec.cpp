@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <algorithm>
 #include "p11oaepdec.hpp"
+#include "swbaseline.hpp"
 
 
 P11OAEPDecryptBenchmark::P11OAEPDecryptBenchmark(const std::string &label,
@@ -62,6 +63,23 @@ inline P11OAEPDecryptBenchmark *P11OAEPDecryptBenchmark::clone() const {
     return new P11OAEPDecryptBenchmark{*this};
 }
 
+P11Benchmark *P11OAEPDecryptBenchmark::swbaseline() const {
+    auto algorithm = m_hashalg==HashAlg::SHA1 ? SWBaselineBenchmark::Algorithm::RSAOAEPSHA1 : SWBaselineBenchmark::Algorithm::RSAOAEPSHA256;
+    return new SWBaselineBenchmark( algorithm, label() );
+}
+
+std::optional<size_t> P11OAEPDecryptBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // the traced payload is the ciphertext; the plaintext is assumed to be a 256 bits secret
+    if(function=="C_Decrypt" && mechanism==CKM_RSA_PKCS_OAEP) return 32;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11OAEPDecryptBenchmark::requirements() const {
+    // the public key encrypts the data to decrypt, when preparing
+    return { { CKM_RSA_PKCS_OAEP, CKF_DECRYPT | CKF_ENCRYPT, keybits() },
+	     { CKM_RSA_PKCS_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11OAEPDecryptBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
 
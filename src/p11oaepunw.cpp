@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <algorithm>
 #include "p11oaepunw.hpp"
+#include "swbaseline.hpp"
 
 
 P11OAEPUnwrapBenchmark::P11OAEPUnwrapBenchmark(const std::string &label,
@@ -62,6 +63,24 @@ inline P11OAEPUnwrapBenchmark *P11OAEPUnwrapBenchmark::clone() const {
     return new P11OAEPUnwrapBenchmark{*this};
 }
 
+P11Benchmark *P11OAEPUnwrapBenchmark::swbaseline() const {
+    auto algorithm = m_hashalg==HashAlg::SHA1 ? SWBaselineBenchmark::Algorithm::RSAOAEPSHA1 : SWBaselineBenchmark::Algorithm::RSAOAEPSHA256;
+    return new SWBaselineBenchmark( algorithm, label() );
+}
+
+std::optional<size_t> P11OAEPUnwrapBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // the traced payload is the wrapped key; the unwrapped key is assumed to be a 256 bits secret
+    if(function=="C_UnwrapKey" && mechanism==CKM_RSA_PKCS_OAEP) return 32;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11OAEPUnwrapBenchmark::requirements() const {
+    // a secret key is generated and wrapped with the public key, when preparing
+    return { { CKM_RSA_PKCS_OAEP, CKF_UNWRAP | CKF_WRAP, keybits() },
+	     { CKM_GENERIC_SECRET_KEY_GEN, CKF_GENERATE },
+	     { CKM_RSA_PKCS_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11OAEPUnwrapBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     Byte btrue = CK_TRUE;
@@ -70,6 +89,7 @@ void P11OAEPUnwrapBenchmark::prepare(Session &session, Object &obj, std::optiona
     Mechanism mech_generic_secret_key_gen { CKM_GENERIC_SECRET_KEY_GEN, nullptr, 0 };
     Ulong keylen;
 
+    m_unwrappedhandle = 0;	// nothing to cleanup yet
     m_objhandle = obj.handle();	// RSA key handle stored at m_objhandle
 
     // we need to wrap a key, that we create.
@@ -170,5 +190,8 @@ void P11OAEPUnwrapBenchmark::crashtestdummy(Session &session)
 
 
 void P11OAEPUnwrapBenchmark::cleanup(Session &session) {
-    session.module()->C_DestroyObject(session.handle(), m_unwrappedhandle);
+    if(m_unwrappedhandle) {
+	session.module()->C_DestroyObject(session.handle(), m_unwrappedhandle);
+	m_unwrappedhandle = 0;
+    }
 }
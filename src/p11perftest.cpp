@@ -26,10 +26,14 @@
 #include <string_view>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
 #include <forward_list>
 #include <thread>
+#include <chrono>
+#include <optional>
 #include <cstdlib>
 #include <sysexits.h>		// BSD exit codes
+#include <sys/stat.h>
 
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/range/adaptor/map.hpp>
@@ -52,6 +56,7 @@
 #include "timeprecision.hpp"
 #include "keygenerator.hpp"
 #include "executor.hpp"
+#include "ConsoleTable.h"
 #include "p11rsasig.hpp"
 #include "p11oaepdec.hpp"
 #include "p11oaepunw.hpp"
@@ -61,6 +66,11 @@
 #include "p11xorkeydataderive.hpp"
 #include "p11genrandom.hpp"
 #include "p11seedrandom.hpp"
+#include "p11session.hpp"
+#include "p11findobjects.hpp"
+#include "p11getattribute.hpp"
+#include "population.hpp"
+#include "preflight.hpp"
 #include "p11hmacsha1.hpp"
 #include "p11hmacsha256.hpp"
 #include "p11hmacsha512.hpp"
@@ -69,6 +79,12 @@
 #include "p11aesecb.hpp"
 #include "p11aescbc.hpp"
 #include "p11aesgcm.hpp"
+#include "p11calibration.hpp"
+#include "lockprofile.hpp"
+#include "regression.hpp"
+#include "resultsink.hpp"
+#include "checkpoint.hpp"
+#include "metrics.hpp"
 
 
 namespace po = boost::program_options;
@@ -90,6 +106,7 @@ std::string env_mapper(std::string env_var)
 
 int main(int argc, char **argv)
 {
+    auto program_started = std::chrono::steady_clock::now(); // for time to first measurement
     std::cout << "-- " PACKAGE ": a small utility to benchmark PKCS#11 operations --\n"
 	      << "------------------------------------------------------------------\n"
 	      << "  Version " PACKAGE_VERSION << '\n'
@@ -102,6 +119,7 @@ int main(int argc, char **argv)
     int argslot = -1;
     int argiter, argskipiter;
     int argnthreads;
+    double argthreshold;
     bool json = false;
     std::fstream jsonout;
     bool generate_session_keys = true;
@@ -111,9 +129,10 @@ int main(int argc, char **argv)
     // default coverage: RSA, ECDSA, HMAC, DES and AES
     const auto default_tests {"rsa,ecdsa,ecdh,hmac,des,aes,xorder,rand,jwe,oaep,oaepunw"};
     const auto default_vectors {"8,16,64,256,1024,4096"};
+    const auto default_population {"100,1000,10000"};
     const auto default_keysizes{"rsa2048,rsa3072,rsa4096,ecnistp256,ecnistp384,ecnistp521,hmac160,hmac256,hmac512,des128,des192,aes128,aes192,aes256"};
-    const auto default_flavour{"generic"};
-    const auto help_text_flavour = "PKCS#11 implementation flavour. Possible values: " + Implementation::choices();
+    const auto default_flavour{"auto"};
+    const auto help_text_flavour = "PKCS#11 implementation flavour. Possible values: auto (detected from the library and the token), " + Implementation::choices();
 
     const auto hwthreads = std::thread::hardware_concurrency(); // how many threads do we have on this platform ?
 
@@ -143,11 +162,62 @@ int main(int argc, char **argv)
 	 " - des  = desecb + descbc\n"
 	 " - oaep = oaepsha1 + oaepsha256\n"
 	 " - oaepuwn = oaepunwsha1 + oaepunwsha256\n"
-	 " - jwe  = jweoaepsha1 + jweoaepsha256")
+	 " - jwe  = jweoaepsha1 + jweoaepsha256\n"
+	 " - session = session open, close, login, logout and setup (not in default coverage)\n"
+	 " - find = findlabel + findid + findclass (not in default coverage)\n"
+	 " - attr = attribute reads on RSA, EC and AES keys (not in default coverage)")
 	("vectors,v", po::value< std::string >()->default_value(default_vectors), "test vectors to use")
+	("population", po::value< std::string >()->default_value(default_population),
+	 "numbers of objects to populate the token with, for object search test cases (find coverage)")
+	("population-token", "populate the token with token objects, instead of session objects")
 	("keysizes,k", po::value< std::string >()->default_value(default_keysizes), "key sizes or curves to use")
 	("flavour,f", po::value< std::string >()->default_value(default_flavour), help_text_flavour.c_str() )
-	("nogenerate,n", "Do not attempt to generate session keys; use existing token keys instead");
+	("nogenerate,n", "Do not attempt to generate session keys; use existing token keys instead")
+	("persistent-keys", "generate token keys instead of session keys, and reuse those generated by previous runs with the same parameters")
+	("keys-per-thread", po::value<int>()->default_value(1),
+	 "number of keys per thread and test case, to defeat key caches of the token")
+	("shared-keys", po::value<int>()->implicit_value(1),
+	 "instead of a key per thread, generate the given number of keys (default 1), shared by all threads\n"
+	 "thread n uses key n modulo the number of shared keys")
+	("key-pick", po::value< std::string >()->default_value("roundrobin"),
+	 "how a key is picked for each iteration, when there are several keys per thread\n"
+	 "Possible values: roundrobin (default), uniform, zipf[:exponent] (default exponent 1)")
+	("calibrate", po::value< std::string >()->implicit_value("getsessioninfo"),
+	 "measure dispatch overhead with a null operation, before running test cases\n"
+	 "Possible values: getsessioninfo (default), getinfo")
+	("net", "report latency net of dispatch overhead (requires --calibrate)")
+	("swbaseline", "compare every test case against its software equivalent (OpenSSL libcrypto)")
+	("lockprofile", "supply instrumented mutex callbacks to the PKCS#11 library, and report lock contention")
+	("replay", po::value< std::string >(),
+	 "replay a trace captured with p11profiler, instead of running test cases\n"
+	 "calls are mapped to test cases from the coverage")
+	("speed", po::value< std::string >()->default_value("1"),
+	 "replay speed, as a factor of the captured pace (requires --replay)\n"
+	 "use \"max\" to replay as fast as possible")
+	("compare", po::value< std::string >(),
+	 "compare results against a baseline JSON file, matching test cases by key label, vector and number of threads\n"
+	 "exit code is 1 when a significant regression above threshold is found")
+	("threshold", po::value<double>(&argthreshold)->default_value(5.0),
+	 "degradation threshold for --compare, in percent")
+	("samples-out", po::value< std::string >(),
+	 "directory where to export raw samples of every test case and vector, for offline analysis")
+	("results", po::value< std::string >(),
+	 "file where to append results, as soon as each test case completes")
+	("results-format", po::value< std::string >(),
+	 "format of results file: ndjson or csv\n"
+	 "by default, taken from the file extension (.csv, else NDJSON)")
+	("checkpoint", po::value< std::string >(),
+	 "file where to persist the run plan and progress, after each test case and vector")
+	("resume", "resume the campaign recorded in the checkpoint file, skipping completed cases (requires --checkpoint)")
+	("recover", po::value<int>()->implicit_value(60),
+	 "when a session is lost (e.g. upon HSM failover), open a new one, login, find the key again and carry on\n"
+	 "the optional value is the recovery timeout, in seconds (default 60)")
+	("keep-going", "when a call returns an error, account for it by return code and carry on, instead of stopping the test case")
+	("live", "show a live view of running test cases on stderr, refreshed about once a second, with per-thread throughput")
+	("metrics-port", po::value<int>(),
+	 "expose metrics of running test cases over HTTP, on 127.0.0.1 and the given port, for Prometheus to scrape")
+	("metrics-file", po::value< std::string >(),
+	 "write metrics of running test cases to the given file every 5 seconds, for the textfile collector of node_exporter");
 
     envvars.add_options()
 	("library", po::value< std::string >(), "PKCS#11 library path\noverrides PKCS11LIB environment variable")
@@ -176,14 +246,24 @@ int main(int argc, char **argv)
     // retrieve the vectors coverage
     VectorCoverage vectors{ vm["vectors"].as<std::string>() };
 
+    // retrieve the population sizes, for object search
+    VectorCoverage populations{ vm["population"].as<std::string>() };
+    if(populations.contains(0)) {
+	std::cerr << "Invalid population size: 0" << std::endl;
+	std::exit(EX_USAGE);
+    }
+
     // retrieve the key size or curve coverage
     KeySizeCoverage keysizes{ vm["keysizes"].as<std::string>() };
 
-    // retrieve the PKCS#11 implementation flavour
-    Implementation::Vendor vendor;
+    // retrieve the PKCS#11 implementation flavour. when auto, it is detected once sessions are open
+    Implementation::Vendor vendor { Implementation::Vendor::generic };
+    bool detect_flavour = vm["flavour"].as<std::string>()=="auto";
     try {
-	auto implementation = Implementation{ vm["flavour"].as<std::string>() };
-	vendor = implementation.vendor();
+	if(!detect_flavour) {
+	    auto implementation = Implementation{ vm["flavour"].as<std::string>() };
+	    vendor = implementation.vendor();
+	}
     } catch(...) {
 	std::cerr << "Unkown or unsupported implementation flavour:" << vm["flavour"].as<std::string>() << std::endl;
 	std::exit(EX_USAGE);
@@ -204,6 +284,219 @@ int main(int argc, char **argv)
 	generate_session_keys = false;
     }
 
+    // read the baseline to compare against, if any
+    std::unique_ptr<Regression> regression;
+    if(vm.count("compare")) {
+	if(argthreshold<0) {
+	    std::cerr << "Invalid threshold:" << argthreshold << std::endl;
+	    std::exit(EX_USAGE);
+	}
+	try {
+	    regression.reset(new Regression(vm["compare"].as<std::string>(), argthreshold / 100.0));
+	} catch(std::exception &e) {
+	    std::cerr << "Cannot read baseline " << vm["compare"].as<std::string>() << ": " << e.what() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    }
+
+    // open the results file, if any
+    std::unique_ptr<ResultSink> sink;
+    if(vm.count("results")) {
+	auto path = vm["results"].as<std::string>();
+	auto format = ResultSink::format(vm.count("results-format") ? vm["results-format"].as<std::string>() : path);
+	if(!format) {
+	    if(vm.count("results-format")) {
+		std::cerr << "Unknown results format:" << vm["results-format"].as<std::string>() << std::endl;
+		std::exit(EX_USAGE);
+	    }
+	    format = ResultSink::Format::ndjson;
+	}
+	try {
+	    sink.reset(new ResultSink(path, *format));
+	} catch(std::exception &e) {
+	    std::cerr << "Cannot open results file: " << e.what() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    }
+
+    // start or resume a campaign, if requested
+    std::unique_ptr<Checkpoint> checkpoint;
+    if(vm.count("checkpoint")) {
+	// a campaign can only be resumed with the same options
+	pt::ptree parameters;
+	parameters.put("library", vm.count("library") ? vm["library"].as<std::string>() : "");
+	parameters.put("slot", argslot);
+	parameters.put("threads", argnthreads);
+	parameters.put("iterations", argiter);
+	parameters.put("skip", argskipiter);
+	parameters.put("coverage", vm["coverage"].as<std::string>());
+	parameters.put("vectors", vm["vectors"].as<std::string>());
+	parameters.put("keysizes", vm["keysizes"].as<std::string>());
+	parameters.put("flavour", vm["flavour"].as<std::string>());
+	parameters.put("nogenerate", vm.count("nogenerate")>0);
+	parameters.put("persistent-keys", vm.count("persistent-keys")>0);
+	parameters.put("population", vm["population"].as<std::string>());
+	parameters.put("population-token", vm.count("population-token")>0);
+	parameters.put("keep-going", vm.count("keep-going")>0);
+	if(vm.count("recover")) {
+	    parameters.put("recover", vm["recover"].as<int>());
+	}
+	if(vm.count("shared-keys")) {
+	    parameters.put("shared-keys", vm["shared-keys"].as<int>());
+	}
+	if(vm["keys-per-thread"].as<int>()>1) {
+	    parameters.put("keys-per-thread", vm["keys-per-thread"].as<int>());
+	    parameters.put("key-pick", vm["key-pick"].as<std::string>());
+	}
+
+	try {
+	    checkpoint.reset(new Checkpoint(vm["checkpoint"].as<std::string>(), parameters, vm.count("resume")>0));
+	} catch(std::exception &e) {
+	    std::cerr << "Checkpoint error: " << e.what() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    } else if(vm.count("resume")) {
+	std::cerr << "When resume option is used, --checkpoint is mandatory\n";
+	std::exit(EX_USAGE);
+    }
+
+    // check the samples directory, if any
+    if(vm.count("samples-out")) {
+	struct stat st;
+	auto dir = vm["samples-out"].as<std::string>();
+	if(stat(dir.c_str(), &st)!=0 || !S_ISDIR(st.st_mode)) {
+	    std::cerr << "Samples directory " << dir << " does not exist, or is not a directory" << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    }
+
+    if(vm.count("recover") && vm["recover"].as<int>()<=0) {
+	std::cerr << "Invalid recovery timeout: " << vm["recover"].as<int>() << std::endl;
+	std::exit(EX_USAGE);
+    }
+
+    // start the metrics exporter, if requested
+    std::unique_ptr<MetricsExporter> metrics;
+    if(vm.count("metrics-port") || vm.count("metrics-file")) {
+	std::optional<uint16_t> port;
+	std::optional<std::string> file;
+
+	if(vm.count("metrics-port")) {
+	    auto value = vm["metrics-port"].as<int>();
+	    if(value<=0 || value>65535) {
+		std::cerr << "Invalid metrics port: " << value << std::endl;
+		std::exit(EX_USAGE);
+	    }
+	    port = static_cast<uint16_t>(value);
+	}
+	if(vm.count("metrics-file")) {
+	    file = vm["metrics-file"].as<std::string>();
+	}
+
+	try {
+	    metrics.reset(new MetricsExporter(port, file));
+	} catch(std::exception &e) {
+	    std::cerr << "Metrics error: " << e.what() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    }
+
+    // open the trace to replay, if any
+    std::unique_ptr<TraceReader> trace;
+    double replay_speed = 0.0;	// as fast as possible
+    if(vm.count("replay")) {
+	try {
+	    trace.reset(new TraceReader(vm["replay"].as<std::string>()));
+	} catch(std::exception &e) {
+	    std::cerr << "Cannot open trace " << vm["replay"].as<std::string>() << ": " << e.what() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+
+	auto speed = vm["speed"].as<std::string>();
+	if(speed!="max") {
+	    try {
+		replay_speed = std::stod(speed);
+	    } catch(...) {
+		replay_speed = -1.0;
+	    }
+	    if(replay_speed<=0) {
+		std::cerr << "Invalid replay speed:" << speed << std::endl;
+		std::exit(EX_USAGE);
+	    }
+	}
+    }
+
+    // retrieve the calibration call, if any
+    std::optional<P11CalibrationBenchmark::Call> calibration;
+    if(vm.count("calibrate")) {
+	try {
+	    calibration = P11CalibrationBenchmark::call(vm["calibrate"].as<std::string>());
+	} catch(std::invalid_argument &e) {
+	    std::cerr << "Unknown calibration call:" << vm["calibrate"].as<std::string>() << std::endl;
+	    std::exit(EX_USAGE);
+	}
+    } else if(vm.count("net")) {
+	std::cerr << "When net option is used, --calibrate is mandatory\n";
+	std::exit(EX_USAGE);
+    }
+
+    // retrieve the number of keys per thread, and how they are picked
+    keyset_t keyset;
+    {
+	auto count = vm["keys-per-thread"].as<int>();
+	if(count<1) {
+	    std::cerr << "Invalid number of keys per thread: " << count << std::endl;
+	    std::exit(EX_USAGE);
+	}
+	keyset.count = static_cast<size_t>(count);
+
+	auto pick = vm["key-pick"].as<std::string>();
+	if(pick=="roundrobin") {
+	    keyset.pick = keyset_t::Pick::RoundRobin;
+	} else if(pick=="uniform") {
+	    keyset.pick = keyset_t::Pick::Uniform;
+	} else if(pick.rfind("zipf", 0)==0 && (pick.size()==4 || pick[4]==':')) {
+	    keyset.pick = keyset_t::Pick::Zipf;
+	    if(pick.size()>5) {
+		try {
+		    keyset.exponent = std::stod(pick.substr(5));
+		} catch(...) {
+		    keyset.exponent = -1.0;
+		}
+	    }
+	    if(pick.size()==5 || keyset.exponent<=0) {
+		std::cerr << "Invalid Zipf exponent: " << pick << std::endl;
+		std::exit(EX_USAGE);
+	    }
+	} else {
+	    std::cerr << "Unknown key pick: " << pick << std::endl;
+	    std::exit(EX_USAGE);
+	}
+
+	if(vm.count("persistent-keys") && vm.count("nogenerate")) {
+	    std::cerr << "--persistent-keys requires keys to be generated, it cannot be used with --nogenerate\n";
+	    std::exit(EX_USAGE);
+	}
+	keyset.persistent = vm.count("persistent-keys")>0;
+
+	if(vm.count("shared-keys")) {
+	    auto shared = vm["shared-keys"].as<int>();
+	    if(shared<1) {
+		std::cerr << "Invalid number of shared keys: " << shared << std::endl;
+		std::exit(EX_USAGE);
+	    }
+	    if(keyset.count>1) {
+		std::cerr << "--shared-keys and --keys-per-thread cannot be used together\n";
+		std::exit(EX_USAGE);
+	    }
+	    if(vm.count("nogenerate")) {
+		std::cerr << "--shared-keys requires keys to be generated, it cannot be used with --nogenerate\n";
+		std::exit(EX_USAGE);
+	    }
+	    keyset.shared = static_cast<size_t>(shared);
+	}
+    }
+
     if (vm.count("library")==0 || vm.count("password")==0 || argslot==-1) {
 	std::cerr << "You must specify at leasr a path to a PKCS#11 library, a slot index and a password\n";
 	std::cerr << cliopts << '\n';
@@ -215,7 +508,10 @@ int main(int argc, char **argv)
 	std::cerr << "*** TPS and latency figures may be affected.\n\n";
     }
 
-    p11::Module module( vm["library"].as<std::string>() );
+    // when profiling locks, the library is initialized with our own mutex callbacks
+    p11::Module module = vm.count("lockprofile") ?
+	p11::Module( vm["library"].as<std::string>(), LockProfiler::instance().init_args() ) :
+	p11::Module( vm["library"].as<std::string>() );
 
     p11::Info info = module.get_info();
 
@@ -288,11 +584,10 @@ int main(int argc, char **argv)
 		      << std::to_string( token_info.firmwareVersion.major ) << '.'
 		      << std::to_string( token_info.firmwareVersion.minor ) << '\n';
 
-	    // login all sessions (one per thread)
-	    std::vector<std::unique_ptr<p11::Session> > sessions;
-	    for(int i=0; i<argnthreads; ++i) {
+	    // open a session and login. also used to replace lost sessions, when recovering
+	    std::string argpwd { vm["password"].as<std::string>() };
+	    auto open_session = [&slot, argpwd] () {
 		std::unique_ptr<p11::Session> session ( new Session(slot, false) );
-		std::string argpwd { vm["password"].as<std::string>() };
 		p11::secure_string pwd( argpwd.data(), argpwd.data()+argpwd.length() );
 		try {
 		    session->login(p11::UserType::User, pwd );
@@ -303,8 +598,37 @@ int main(int argc, char **argv)
 			throw;
 		    }
 		}
+		return session;
+	    };
+
+	    // login all sessions (one per thread)
+	    std::vector<std::unique_ptr<p11::Session> > sessions;
+	    for(int i=0; i<argnthreads; ++i) {
+		sessions.push_back(open_session()); // move session to sessions
+	    }
 
-		sessions.push_back(std::move(session)); // move session to sessions
+	    // detect the flavour from metadata, and check the GCM layout of the token with a probe.
+	    // when metadata is not recognized, the probe decides.
+	    if(detect_flavour) {
+		std::string library_manufacturer( reinterpret_cast<const char *>(info.manufacturerID), sizeof info.manufacturerID );
+		vendor = Implementation::detect( library_manufacturer, std::string(manufacturer_id), std::string(model) );
+		auto probed = Implementation::probe_gcm( *sessions.front() );
+
+		std::cout << "Implementation flavour: ";
+		if(!probed) {
+		    std::cout << Implementation::name(vendor) << " (detected from metadata, GCM probe inconclusive)\n";
+		} else if(vendor==Implementation::Vendor::generic) {
+		    vendor = *probed;
+		    std::cout << Implementation::name(vendor) << " (detected from GCM probe)\n";
+		} else if(Implementation::same_gcm_layout(vendor, *probed)) {
+		    std::cout << Implementation::name(vendor) << " (detected from metadata, confirmed by GCM probe)\n";
+		} else {
+		    std::cout << Implementation::name(vendor) << " (detected from metadata)\n";
+		    std::cerr << "*** Warning: the GCM probe matches the " << Implementation::name(*probed)
+			      << " flavour instead; use --flavour to override\n";
+		}
+	    } else {
+		std::cout << "Implementation flavour: " << Implementation::name(vendor) << '\n';
 	    }
 
 	    // generate test vectors, according to command line requirements
@@ -322,68 +646,26 @@ int main(int argc, char **argv)
 
 	    Executor executor( testvecs, sessions, argnthreads, epsilon, generate_session_keys==true );
 
-	    if(generate_session_keys) {
-		KeyGenerator keygenerator( sessions, argnthreads, vendor );
-
-		std::cout << "Generating session keys for " << argnthreads << " thread(s)\n";
-		if(tests.contains("rsa")
-		   || tests.contains("jwe")
-		   || tests.contains("jweoaepsha1")
-		   || tests.contains("jweoaepsha256")
-		   || tests.contains("oaep")
-		   || tests.contains("oaepsha1")
-		   || tests.contains("oaepsha256")
-		   || tests.contains("oaepunw")
-		   || tests.contains("oaepunwsha1")
-		   || tests.contains("oaepunwsha256")
-		    ) {
-		    if(keysizes.contains("rsa2048")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-2048", 2048);
-		    if(keysizes.contains("rsa3072")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-3072", 3072);
-		    if(keysizes.contains("rsa4096")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-4096", 4096);
-		}
-
-		if(tests.contains("ecdsa")) {
-		    if(keysizes.contains("ecnistp256")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp256r1", "secp256r1");
-		    if(keysizes.contains("ecnistp384")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp384r1", "secp384r1");
-		    if(keysizes.contains("ecnistp521")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp521r1", "secp521r1");
-		}
-
-		if(tests.contains("ecdh")) {
-		    if(keysizes.contains("ecnistp256")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp256r1", "secp256r1");
-		    if(keysizes.contains("ecnistp384")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp384r1", "secp384r1");
-		    if(keysizes.contains("ecnistp521")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp521r1", "secp521r1");
-		}
+	    if(vm.count("samples-out")) {
+		executor.samples_out(vm["samples-out"].as<std::string>());
+	    }
 
-		if(tests.contains("hmac")) {
-		    if(keysizes.contains("hmac160")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-160", 160);
-		    if(keysizes.contains("hmac256")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-256", 256);
-		    if(keysizes.contains("hmac512")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-512", 512);
-		}
+	    executor.keyset(keyset);
 
-		if(tests.contains("des")
-		   || tests.contains("desecb")
-		   || tests.contains("descbc")) {
-		    if(keysizes.contains("des128")) keygenerator.generate_key(KeyGenerator::KeyType::DES, "des-128", 128); // DES2
-		    if(keysizes.contains("des192")) keygenerator.generate_key(KeyGenerator::KeyType::DES, "des-192", 192); // DES3
-		}
-
-		if(tests.contains("aes")
-		   || tests.contains("aesecb")
-		   || tests.contains("aescbc")
-		   || tests.contains("aesgcm")) {
-		    if(keysizes.contains("aes128")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-128", 128);
-		    if(keysizes.contains("aes192")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-192", 192);
-		    if(keysizes.contains("aes256")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-256", 256);
-		}
+	    if(vm.count("keep-going")) {
+		executor.keep_going(true);
+	    }
 
-		if(tests.contains("xorder")) {
-		    keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "xorder-128", 128);
-		}
+	    if(vm.count("recover")) {
+		executor.recovery(open_session, std::chrono::seconds(vm["recover"].as<int>()));
+	    }
 
-		if(tests.contains("rand")) {
-		    keygenerator.generate_key(KeyGenerator::KeyType::AES, "rand-128", 128); // not really used
-		}
+	    if(vm.count("live")) {
+		executor.live(true);
+	    }
 
+	    if(metrics) {
+		executor.metrics(metrics.get());
 	    }
 
 	    std::forward_list<P11Benchmark *> benchmarks;
@@ -531,19 +813,337 @@ int main(int argc, char **argv)
 		benchmarks.emplace_front( new P11GenerateRandomBenchmark("rand-128") );
 	    }
 
+	    if(tests.contains("session")) {
+		p11::secure_string pwd( argpwd.data(), argpwd.data()+argpwd.length() );
+		benchmarks.emplace_front( new P11SessionBenchmark("session-128", P11SessionBenchmark::Step::Open, pwd) );
+		benchmarks.emplace_front( new P11SessionBenchmark("session-128", P11SessionBenchmark::Step::Close, pwd) );
+		benchmarks.emplace_front( new P11SessionBenchmark("session-128", P11SessionBenchmark::Step::Setup, pwd) );
+	    }
+
+	    if(tests.contains("attr")) {
+		using Key = P11GetAttributeBenchmark::Key;
+		using Read = P11GetAttributeBenchmark::Read;
+		std::forward_list<std::pair<Key, std::string> > keys;
+
+		if(keysizes.contains("rsa2048")) keys.emplace_front( Key::RSA, "rsa-2048" );
+		if(keysizes.contains("rsa3072")) keys.emplace_front( Key::RSA, "rsa-3072" );
+		if(keysizes.contains("rsa4096")) keys.emplace_front( Key::RSA, "rsa-4096" );
+		if(keysizes.contains("ecnistp256")) keys.emplace_front( Key::EC, "ecdsa-secp256r1" );
+		if(keysizes.contains("ecnistp384")) keys.emplace_front( Key::EC, "ecdsa-secp384r1" );
+		if(keysizes.contains("ecnistp521")) keys.emplace_front( Key::EC, "ecdsa-secp521r1" );
+		if(keysizes.contains("aes128")) keys.emplace_front( Key::AES, "aes-128" );
+		if(keysizes.contains("aes192")) keys.emplace_front( Key::AES, "aes-192" );
+		if(keysizes.contains("aes256")) keys.emplace_front( Key::AES, "aes-256" );
+		keys.reverse();
+
+		for(auto &key: keys) {
+		    benchmarks.emplace_front( new P11GetAttributeBenchmark(key.second, key.first, Read::Single) );
+		    benchmarks.emplace_front( new P11GetAttributeBenchmark(key.second, key.first, Read::Probe) );
+		    benchmarks.emplace_front( new P11GetAttributeBenchmark(key.second, key.first, Read::Template) );
+		}
+	    }
+
+	    // object search test cases are grouped by population size, so that the token is populated once per size
+	    for(auto size: populations) {
+		if(tests.contains("find") || tests.contains("findlabel")) {
+		    benchmarks.emplace_front( new P11FindObjectsBenchmark(P11FindObjectsBenchmark::Template::Label, size) );
+		}
+		if(tests.contains("find") || tests.contains("findid")) {
+		    benchmarks.emplace_front( new P11FindObjectsBenchmark(P11FindObjectsBenchmark::Template::Id, size) );
+		}
+		if(tests.contains("find") || tests.contains("findclass")) {
+		    benchmarks.emplace_front( new P11FindObjectsBenchmark(P11FindObjectsBenchmark::Template::Class, size) );
+		}
+	    }
+
+	    // login and logout come last, as C_Logout() destroys session keys and invalidates handles to private objects.
+	    // as the login state is shared by all sessions of the application, they are measured with one thread only.
+	    if(tests.contains("session")) {
+		if(argnthreads==1) {
+		    p11::secure_string pwd( argpwd.data(), argpwd.data()+argpwd.length() );
+		    benchmarks.emplace_front( new P11SessionBenchmark("session-128", P11SessionBenchmark::Step::Login, pwd) );
+		    benchmarks.emplace_front( new P11SessionBenchmark("session-128", P11SessionBenchmark::Step::Logout, pwd) );
+		} else {
+		    std::cerr << "*** Warning: session login and logout are only measured with one thread (-t 1), skipping\n";
+		}
+	    }
+
 	    benchmarks.reverse();
 
+	    // preflight: test cases the token cannot run are pruned, before keys are generated
+	    Preflight preflight( slot, generate_session_keys );
+	    std::set<std::string> needed, unneeded;
+	    pt::ptree pruned;
+
+	    benchmarks.remove_if( [&] (P11Benchmark *benchmark) {
+		auto reasons = preflight.check(*benchmark);
+		if(reasons.empty()) {
+		    needed.insert(benchmark->label());
+		    return false;
+		}
+		auto testcase = benchmark->name()+" using "+benchmark->label();
+		pt::ptree node;
+		for(auto &reason: reasons) {
+		    node.push_back( pt::ptree::value_type( "", pt::ptree(reason) ) );
+		}
+		pruned.push_back( pt::ptree::value_type( testcase, node ) );
+		unneeded.insert(benchmark->label());
+		delete benchmark;
+		return true;
+	    });
+
+	    for(auto &label: needed) {
+		unneeded.erase(label);
+	    }
+
+	    if(preflight.available()) {
+		std::cout << "Preflight: " << preflight.size() << " mechanism(s) supported by the token, "
+			  << pruned.size() << " test case(s) pruned\n";
+		for(auto &testcase: pruned) {
+		    std::cout << "  " << testcase.first << ":\n";
+		    for(auto &reason: testcase.second) {
+			std::cout << "    - " << reason.second.data() << '\n';
+		    }
+		}
+		std::cout << '\n';
+	    }
 
 	    std::forward_list<std::string> testvecsnames;
 	    boost::copy(testvecs | boost::adaptors::map_keys, std::front_inserter(testvecsnames));
 	    testvecsnames.sort();	// sort in alphabetical order
 
+	    // persist the run plan up front, once preflight has pruned it, and before keys are generated,
+	    // so that an interruption during key generation or calibration can be resumed.
+	    // in replay mode, test cases are driven by the trace, and none is planned.
+	    if(checkpoint) {
+		std::forward_list<std::tuple<std::string, std::string, std::forward_list<std::string> > > cases;
+		for(auto benchmark : benchmarks) {
+		    if(!trace) {
+			cases.emplace_front( benchmark->name()+" using "+benchmark->label(), benchmark->label(), testvecsnames );
+		    }
+		}
+		checkpoint->plan(cases);
+	    }
+
+	    if(generate_session_keys) {
+		KeyGenerator keygenerator( sessions, argnthreads, vendor );
+		keygenerator.keys_per_thread(keyset.count);
+		keygenerator.shared(keyset.shared);
+		keygenerator.persistent(keyset.persistent);
+
+		// when resuming, keys used only by completed cases are not needed
+		if(checkpoint) {
+		    keygenerator.skip(checkpoint->completed_labels());
+		}
+
+		// nor are keys used only by test cases pruned by preflight
+		keygenerator.skip(unneeded);
+
+		std::cout << "Generating session keys for " << argnthreads << " thread(s)";
+		if(keyset.count>1) {
+		    std::cout << ", " << keyset.count << " key(s) per thread";
+		}
+		if(keyset.shared>0) {
+		    std::cout << ", " << keyset.shared << " key(s) shared by all threads";
+		}
+		std::cout << '\n';
+		if(tests.contains("rsa")
+		   || tests.contains("jwe")
+		   || tests.contains("jweoaepsha1")
+		   || tests.contains("jweoaepsha256")
+		   || tests.contains("oaep")
+		   || tests.contains("oaepsha1")
+		   || tests.contains("oaepsha256")
+		   || tests.contains("oaepunw")
+		   || tests.contains("oaepunwsha1")
+		   || tests.contains("oaepunwsha256")
+		   || tests.contains("attr")
+		    ) {
+		    if(keysizes.contains("rsa2048")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-2048", 2048);
+		    if(keysizes.contains("rsa3072")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-3072", 3072);
+		    if(keysizes.contains("rsa4096")) keygenerator.generate_key(KeyGenerator::KeyType::RSA, "rsa-4096", 4096);
+		}
+
+		if(tests.contains("ecdsa") || tests.contains("attr")) {
+		    if(keysizes.contains("ecnistp256")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp256r1", "secp256r1");
+		    if(keysizes.contains("ecnistp384")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp384r1", "secp384r1");
+		    if(keysizes.contains("ecnistp521")) keygenerator.generate_key(KeyGenerator::KeyType::ECDSA, "ecdsa-secp521r1", "secp521r1");
+		}
+
+		if(tests.contains("ecdh")) {
+		    if(keysizes.contains("ecnistp256")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp256r1", "secp256r1");
+		    if(keysizes.contains("ecnistp384")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp384r1", "secp384r1");
+		    if(keysizes.contains("ecnistp521")) keygenerator.generate_key(KeyGenerator::KeyType::ECDH, "ecdh-secp521r1", "secp521r1");
+		}
+
+		if(tests.contains("hmac")) {
+		    if(keysizes.contains("hmac160")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-160", 160);
+		    if(keysizes.contains("hmac256")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-256", 256);
+		    if(keysizes.contains("hmac512")) keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "hmac-512", 512);
+		}
+
+		if(tests.contains("des")
+		   || tests.contains("desecb")
+		   || tests.contains("descbc")) {
+		    if(keysizes.contains("des128")) keygenerator.generate_key(KeyGenerator::KeyType::DES, "des-128", 128); // DES2
+		    if(keysizes.contains("des192")) keygenerator.generate_key(KeyGenerator::KeyType::DES, "des-192", 192); // DES3
+		}
+
+		if(tests.contains("aes")
+		   || tests.contains("aesecb")
+		   || tests.contains("aescbc")
+		   || tests.contains("aesgcm")
+		   || tests.contains("attr")) {
+		    if(keysizes.contains("aes128")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-128", 128);
+		    if(keysizes.contains("aes192")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-192", 192);
+		    if(keysizes.contains("aes256")) keygenerator.generate_key(KeyGenerator::KeyType::AES, "aes-256", 256);
+		}
+
+		if(tests.contains("xorder")) {
+		    keygenerator.generate_key(KeyGenerator::KeyType::GENERIC, "xorder-128", 128);
+		}
+
+		if(tests.contains("rand")) {
+		    keygenerator.generate_key(KeyGenerator::KeyType::AES, "rand-128", 128); // not really used
+		}
+
+		if(tests.contains("session")) {
+		    keygenerator.generate_key(KeyGenerator::KeyType::AES, "session-128", 128); // searched by session setup
+		}
+
+		// all key types are generated at once, spread over the sessions
+		keygenerator.generate();
+	    }
+
+
+	    // record(): stream the results of a test case as soon as it completes,
+	    // and keep them for JSON output and comparison, if needed
+	    auto record = [&] (const std::string &testcase, const ptree &tree) {
+		if(sink) {
+		    sink->write(testcase, tree);
+		}
+		if(json || regression) {
+		    merge_results( results, testcase, tree );
+		}
+	    };
+
+	    // when resuming, results of completed cases are taken from the checkpoint
+	    if(checkpoint && (json || regression)) {
+		for(auto &testcase: checkpoint->results()) {
+		    merge_results( results, testcase.first, testcase.second );
+		}
+	    }
+
+	    std::cout << "Time to first measurement: "
+		      << std::chrono::duration<double>(std::chrono::steady_clock::now() - program_started).count() << "s\n\n";
+
+	    // calibration: measure the dispatch overhead, using the same threading setup
+	    if(calibration && !testvecsnames.empty()) {
+		P11CalibrationBenchmark nullbenchmark(*calibration);
+		record( nullbenchmark.name()+" using "+nullbenchmark.label(),
+			executor.calibrate( nullbenchmark, argiter, argskipiter, testvecsnames.front(), vm.count("net")>0 ));
+	    }
+
+	    if(trace) {
+		// replay mode: test cases are driven by the trace
+		auto replayed = executor.replay( benchmarks, *trace, replay_speed );
+		for(auto &testcase: replayed) {
+		    record( testcase.first, testcase.second );
+		}
+		for(auto benchmark : benchmarks) {
+		    delete benchmark;
+		}
+		benchmarks.clear();
+	    }
+
+	    // token population, for test cases requiring one. it is replaced when the size changes,
+	    // and removed when the last test case has run
+	    std::unique_ptr<Population> population;
+	    auto populate = [&] (const P11Benchmark &benchmark) {
+		auto size = benchmark.population();
+		if(!size) {
+		    population.reset(); // removed before other test cases, as these may log out (see session)
+		} else if(!population || population->size()!=*size) {
+		    population.reset();
+		    population.reset(new Population(sessions, argnthreads, vendor, *size, vm.count("population-token")>0));
+		}
+	    };
+
 	    for(auto benchmark : benchmarks) {
-		results.add_child( benchmark->name()+" using "+benchmark->label(), executor.benchmark( *benchmark, argiter, argskipiter, testvecsnames ));
-		free(benchmark);
+		std::unique_ptr<P11Benchmark> baseline { vm.count("swbaseline") ? benchmark->swbaseline() : nullptr };
+		auto testcase = benchmark->name()+" using "+benchmark->label();
+
+		if(checkpoint) {
+		    // vectors are run one at a time, and progress recorded after each of them
+		    for(auto &vector: testvecsnames) {
+			if(checkpoint->completed(testcase, vector)) {
+			    std::cout << testcase << ", " << vector << ": already completed, skipping\n";
+			    continue;
+			}
+			populate( *benchmark );
+			auto tree = executor.benchmark( *benchmark, argiter, argskipiter, { vector }, baseline.get() );
+			record( testcase, tree );
+			checkpoint->complete( testcase, tree );
+		    }
+		} else {
+		    populate( *benchmark );
+		    record( testcase, executor.benchmark( *benchmark, argiter, argskipiter, testvecsnames, baseline.get() ));
+		}
+		delete benchmark;
+	    }
+	    population.reset();
+
+	    // regression table against baseline, if any
+	    if(regression) {
+		auto outcomes = regression->compare(results);
+		ConsoleTable table { "test case", "key label", "vector", "threads", "measure", "baseline (ms)", "current (ms)", "delta", "p-value", "verdict" };
+		table.setStyle(1);
+
+		auto d2s = [] (double arg, int precision=-1) -> std::string {
+			       std::ostringstream stream;
+			       if(precision>=0) stream << std::setprecision(precision);
+			       stream << arg;
+			       return stream.str();
+			   };
+
+		size_t regressions = 0;
+		for(auto &outcome: outcomes) {
+		    table += { outcome.testcase,
+			       outcome.label,
+			       outcome.vector,
+			       d2s(outcome.threads),
+			       outcome.measure,
+			       d2s(outcome.baseline, 6),
+			       d2s(outcome.current, 6),
+			       d2s(outcome.delta * 100, 3) + '%',
+			       d2s(outcome.pvalue, 3),
+			       Regression::verdict(outcome.verdict) };
+		    if(outcome.verdict==Regression::Verdict::regressed) {
+			regressions++;
+		    }
+		}
+
+		std::cout << "Comparison against " << vm["compare"].as<std::string>()
+			  << " (threshold " << argthreshold << "%, significance level 5%)\n"
+			  << "================================================================================\n";
+		if(outcomes.empty()) {
+		    std::cerr << "*** Warning: no test case matches the baseline (key label, vector and number of threads)\n";
+		} else {
+		    std::cout << table << '\n'
+			      << regressions << " regression(s) found" << std::endl;
+		}
+
+		if(regressions>0) {
+		    rv = EXIT_FAILURE;
+		}
 	    }
 
 	    if(json==true) {
+		results.put("preflight.flavour", Implementation::name(vendor));
+		if(preflight.available()) {
+		    results.put_child("preflight.mechanisms", preflight.capabilities());
+		    results.put_child("preflight.pruned", pruned);
+		}
 		boost::property_tree::write_json(jsonout.is_open() ? jsonout : std::cout, results);
 		if(jsonout.is_open()) {
 		    std::cout << "output written to " << vm["jsonfile"].as<std::string>() << '\n';
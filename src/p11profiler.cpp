@@ -0,0 +1,628 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11profiler.cpp: a PKCS#11 interposer, to profile the calls of any application
+//
+// usage:
+//   $ P11PROFILER_MODULE=/path/to/vendor/libpkcs11.so P11PROFILER_OUTPUT=profile.json <application>
+// where the application is configured to use p11profiler.so as its PKCS#11 library.
+//
+// The profile is a JSON file, with one test case per function and per mechanism, named
+// "<function> using <mechanism>". Operation calls (e.g. C_Sign(), C_EncryptUpdate()) are attributed to
+// the mechanism given to the matching C_xxxInit() call, in the same thread, on the same session.
+// Functions without a mechanism are reported with "n/a", and operation calls which initialization
+// was not seen by the same thread are reported with "unknown".
+//
+// When P11PROFILER_TRACE is set, every call is also recorded to a binary trace file (see trace.hpp),
+// that can be replayed by p11perftest. The trace has room for P11PROFILER_TRACE_RECORDS records
+// (by default, 1048576 records, i.e. 32MB); further calls are not traced.
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <sstream>
+#include <fstream>
+#include <type_traits>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include "errorcodes.hpp"
+#include "mechanisms.hpp"
+#include "measure.hpp"
+#include "p11profiler.hpp"
+
+namespace pt = boost::property_tree;
+
+namespace p11profiler {
+
+    static constexpr bool same_name(const char *a, const char *b)
+    {
+	while(*a && *a==*b) { ++a; ++b; }
+	return *a==*b;
+    }
+
+    // what was given to C_xxxInit(), per session and per operation, for the calling thread
+    struct OperationContext {
+	CK_MECHANISM_TYPE mechanism { unknown_mechanism };
+	KeyInfo key;
+    };
+
+    thread_local std::unordered_map<CK_SESSION_HANDLE, std::array<OperationContext, static_cast<size_t>(OperationKind::count)> > session_contexts;
+
+    // retrieve the mechanism from arguments, if any
+    inline CK_MECHANISM_PTR as_mechanism(CK_MECHANISM_PTR mech) { return mech; }
+
+    template<typename T>
+    inline CK_MECHANISM_PTR as_mechanism(T) { return nullptr; }
+
+    template<typename... Args>
+    inline CK_MECHANISM_PTR find_mechanism(Args... args)
+    {
+	CK_MECHANISM_PTR mech = nullptr;
+	((mech = mech ? mech : as_mechanism(args)), ...);
+	return mech;
+    }
+
+    // the session handle, when it is the first argument
+    inline CK_SESSION_HANDLE first_handle() { return CK_INVALID_HANDLE; }
+
+    template<typename First, typename... Rest>
+    inline CK_SESSION_HANDLE first_handle(First first, Rest...)
+    {
+	if constexpr (std::is_integral_v<First>) {
+	    return first;
+	} else {
+	    return CK_INVALID_HANDLE;
+	}
+    }
+
+    // the integral argument that immediately follows an argument of type Marker, if any.
+    // - after CK_MECHANISM_PTR, it is the key (C_xxxInit(), C_WrapKey(), C_UnwrapKey(), C_DeriveKey())
+    // - after CK_BYTE_PTR, it is the length of input data (C_Encrypt(), C_Sign(), C_GenerateRandom(), ...)
+    template<typename Marker, typename... Args>
+    inline CK_ULONG integral_after(Args... args)
+    {
+	CK_ULONG value = 0;
+	bool armed = false, done = false;
+
+	auto visit = [&] (auto arg) {
+	    using T = decltype(arg);
+	    if(done) return;
+	    if constexpr (std::is_same_v<T, Marker>) {
+		armed = true;
+	    } else if(armed) {
+		if constexpr (std::is_integral_v<T>) value = arg;
+		done = true;
+	    }
+	};
+
+	(visit(args), ...);
+	return value;
+    }
+
+    // the interposed function: measure the call to the real module,
+    // and account for it under the relevant mechanism
+    template<typename T, T member, size_t function>
+    struct Interposer;
+
+    template<typename... Args, CK_RV (* CK_FUNCTION_LIST::*member)(Args...), size_t function>
+    struct Interposer<CK_RV (* CK_FUNCTION_LIST::*)(Args...), member, function>
+    {
+	static CK_RV call(Args... args)
+	{
+	    auto &profiler = Profiler::instance();
+	    constexpr auto &desc = function_descriptors[function];
+	    constexpr auto op = static_cast<size_t>(desc.operation);
+
+	    CK_MECHANISM_TYPE mech = no_mechanism;
+	    KeyInfo key;
+	    auto pmech = find_mechanism(args...);
+
+	    if(pmech) {
+		mech = pmech->mechanism;
+	    } else if(desc.operation != OperationKind::none) {
+		auto it = session_contexts.find(first_handle(args...));
+		if(it != session_contexts.end()) {
+		    mech = it->second[op].mechanism;
+		    key = it->second[op].key;
+		} else {
+		    mech = unknown_mechanism;
+		}
+	    }
+
+	    auto inflight = profiler.enter();
+	    auto start = Profiler::now();
+	    CK_RV rv = (profiler.real()->*member)(args...);
+	    auto end = Profiler::now();
+	    profiler.leave();
+
+	    // key attributes are only retrieved when tracing, outside of the measured window
+	    if(pmech && profiler.tracing()) {
+		auto hkey = integral_after<CK_MECHANISM_PTR>(args...);
+		if(hkey!=CK_INVALID_HANDLE) {
+		    key = profiler.key_info(first_handle(args...), hkey);
+		}
+	    }
+
+	    if constexpr (desc.init) {
+		if(rv==CKR_OK) {
+		    auto &context = session_contexts[first_handle(args...)][op];
+		    context.mechanism = mech;
+		    context.key = key;
+		}
+	    }
+
+	    profiler.record(function, mech, start, end, inflight, rv);
+
+	    if(profiler.tracing()) {
+		TraceRecord record {};
+		record.timestamp = profiler.elapsed(start);
+		record.latency = end - start < UINT32_MAX ? static_cast<uint32_t>(end - start) : UINT32_MAX;
+		record.mechanism = mech==no_mechanism || mech==unknown_mechanism ? trace_no_mechanism : static_cast<uint32_t>(mech);
+		// the length of PINs (C_Login(), C_InitToken(), ...) is not recorded
+		if(mech!=no_mechanism || same_name(desc.name, "C_GenerateRandom") || same_name(desc.name, "C_SeedRandom")) {
+		    record.payload = static_cast<uint32_t>(integral_after<CK_BYTE_PTR>(args...));
+		}
+		record.keybits = key.bits;
+		record.function = static_cast<uint8_t>(function);
+		record.keyclass = key.keyclass;
+		record.keytype = key.keytype;
+		record.flags = rv!=CKR_OK ? trace_flag_error : 0;
+		profiler.trace(record);
+	    }
+
+	    if constexpr (same_name(desc.name, "C_Finalize")) {
+		if(rv==CKR_OK) profiler.dump();
+	    }
+
+	    return rv;
+	}
+    };
+
+#define INTERPOSE(fn)							\
+    static_assert(same_name(function_descriptors[function_slot(offsetof(CK_FUNCTION_LIST, fn))].name, #fn), #fn " is misplaced in descriptors"); \
+    m_interposed.fn = m_real->fn ? &Interposer<decltype(&CK_FUNCTION_LIST::fn), &CK_FUNCTION_LIST::fn, function_slot(offsetof(CK_FUNCTION_LIST, fn))>::call : nullptr
+
+    Profiler::Profiler() : m_epoch(now())
+    {
+	auto module = std::getenv("P11PROFILER_MODULE");
+	if(!module) {
+	    std::fprintf(stderr, "p11profiler: P11PROFILER_MODULE environment variable is not set\n");
+	    return;
+	}
+	m_module = module;
+
+	m_dlhandle = dlopen(module, RTLD_NOW | RTLD_LOCAL);
+	if(!m_dlhandle) {
+	    std::fprintf(stderr, "p11profiler: cannot load %s: %s\n", module, dlerror());
+	    return;
+	}
+
+	auto getfunctionlist = reinterpret_cast<CK_C_GetFunctionList>(dlsym(m_dlhandle, "C_GetFunctionList"));
+	if(!getfunctionlist || getfunctionlist(&m_real)!=CKR_OK || !m_real) {
+	    std::fprintf(stderr, "p11profiler: cannot retrieve function list from %s\n", module);
+	    m_real = nullptr;
+	    return;
+	}
+
+	// optional trace of all calls, for later replay
+	auto trace = std::getenv("P11PROFILER_TRACE");
+	if(trace) {
+	    auto records = std::getenv("P11PROFILER_TRACE_RECORDS");
+	    try {
+		m_trace.reset(new TraceWriter(trace, records ? std::strtoul(records, nullptr, 0) : default_trace_records));
+	    } catch(std::exception &e) {
+		std::fprintf(stderr, "p11profiler: tracing disabled, %s\n", e.what());
+	    }
+	}
+
+	m_interposed.version = m_real->version;
+	INTERPOSE(C_Initialize);
+	INTERPOSE(C_Finalize);
+	INTERPOSE(C_GetInfo);
+	m_interposed.C_GetFunctionList = C_GetFunctionList; // not profiled
+	INTERPOSE(C_GetSlotList);
+	INTERPOSE(C_GetSlotInfo);
+	INTERPOSE(C_GetTokenInfo);
+	INTERPOSE(C_GetMechanismList);
+	INTERPOSE(C_GetMechanismInfo);
+	INTERPOSE(C_InitToken);
+	INTERPOSE(C_InitPIN);
+	INTERPOSE(C_SetPIN);
+	INTERPOSE(C_OpenSession);
+	INTERPOSE(C_CloseSession);
+	INTERPOSE(C_CloseAllSessions);
+	INTERPOSE(C_GetSessionInfo);
+	INTERPOSE(C_GetOperationState);
+	INTERPOSE(C_SetOperationState);
+	INTERPOSE(C_Login);
+	INTERPOSE(C_Logout);
+	INTERPOSE(C_CreateObject);
+	INTERPOSE(C_CopyObject);
+	INTERPOSE(C_DestroyObject);
+	INTERPOSE(C_GetObjectSize);
+	INTERPOSE(C_GetAttributeValue);
+	INTERPOSE(C_SetAttributeValue);
+	INTERPOSE(C_FindObjectsInit);
+	INTERPOSE(C_FindObjects);
+	INTERPOSE(C_FindObjectsFinal);
+	INTERPOSE(C_EncryptInit);
+	INTERPOSE(C_Encrypt);
+	INTERPOSE(C_EncryptUpdate);
+	INTERPOSE(C_EncryptFinal);
+	INTERPOSE(C_DecryptInit);
+	INTERPOSE(C_Decrypt);
+	INTERPOSE(C_DecryptUpdate);
+	INTERPOSE(C_DecryptFinal);
+	INTERPOSE(C_DigestInit);
+	INTERPOSE(C_Digest);
+	INTERPOSE(C_DigestUpdate);
+	INTERPOSE(C_DigestKey);
+	INTERPOSE(C_DigestFinal);
+	INTERPOSE(C_SignInit);
+	INTERPOSE(C_Sign);
+	INTERPOSE(C_SignUpdate);
+	INTERPOSE(C_SignFinal);
+	INTERPOSE(C_SignRecoverInit);
+	INTERPOSE(C_SignRecover);
+	INTERPOSE(C_VerifyInit);
+	INTERPOSE(C_Verify);
+	INTERPOSE(C_VerifyUpdate);
+	INTERPOSE(C_VerifyFinal);
+	INTERPOSE(C_VerifyRecoverInit);
+	INTERPOSE(C_VerifyRecover);
+	INTERPOSE(C_DigestEncryptUpdate);
+	INTERPOSE(C_DecryptDigestUpdate);
+	INTERPOSE(C_SignEncryptUpdate);
+	INTERPOSE(C_DecryptVerifyUpdate);
+	INTERPOSE(C_GenerateKey);
+	INTERPOSE(C_GenerateKeyPair);
+	INTERPOSE(C_WrapKey);
+	INTERPOSE(C_UnwrapKey);
+	INTERPOSE(C_DeriveKey);
+	INTERPOSE(C_SeedRandom);
+	INTERPOSE(C_GenerateRandom);
+	INTERPOSE(C_GetFunctionStatus);
+	INTERPOSE(C_CancelFunction);
+	INTERPOSE(C_WaitForSlotEvent);
+    }
+
+#undef INTERPOSE
+
+    // the profiler is never destroyed, nor the real module unloaded,
+    // as the application may still issue calls from its own static destructors
+    Profiler &Profiler::instance()
+    {
+	static Profiler *profiler = [] () {
+	    auto p = new Profiler;
+	    std::atexit( [] () { instance().dump(); } ); // the application may exit without calling C_Finalize()
+	    return p;
+	}();
+	return *profiler;
+    }
+
+    uint64_t Profiler::now()
+    {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ThreadBuffer *Profiler::attach()
+    {
+	std::lock_guard<std::mutex> lock(m_registry_mtx);
+	m_buffers.emplace_back(new ThreadBuffer);
+	return m_buffers.back().get();
+    }
+
+    void Profiler::record(size_t function, CK_MECHANISM_TYPE mechanism, uint64_t start, uint64_t end, uint64_t inflight, CK_RV rv)
+    {
+	thread_local ThreadBuffer *buffer = attach();
+
+	auto e = buffer->entry(function, mechanism);
+	if(!e) {
+	    buffer->drop();
+	    return;
+	}
+
+	e->latency.record(end - start);
+	if(rv!=CKR_OK) {
+	    e->errors.store(e->errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	    e->lasterror.store(rv, std::memory_order_relaxed);
+	}
+	if(inflight > e->max_inflight.load(std::memory_order_relaxed)) {
+	    e->max_inflight.store(inflight, std::memory_order_relaxed);
+	}
+	if(e->latency.count()==1) {
+	    e->first.store(elapsed(start), std::memory_order_relaxed);
+	}
+	e->last.store(elapsed(end), std::memory_order_relaxed);
+
+	m_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Profiler::trace(TraceRecord &record)
+    {
+	thread_local uint32_t thread = m_threads.fetch_add(1, std::memory_order_relaxed);
+
+	record.thread = thread;
+	m_trace->append(record);
+    }
+
+    // class, type and size of a key, cached per thread.
+    // the cache is not invalidated when objects are destroyed, as handles are seldom reused
+    // for keys of a different kind.
+    KeyInfo Profiler::key_info(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key)
+    {
+	thread_local std::unordered_map<CK_OBJECT_HANDLE, KeyInfo> cache;
+
+	auto it = cache.find(key);
+	if(it!=cache.end()) {
+	    return it->second;
+	}
+
+	KeyInfo info;
+	CK_OBJECT_CLASS keyclass;
+	CK_KEY_TYPE keytype;
+	CK_ATTRIBUTE attrs[] = {
+	    { CKA_CLASS, &keyclass, sizeof keyclass },
+	    { CKA_KEY_TYPE, &keytype, sizeof keytype },
+	};
+
+	m_real->C_GetAttributeValue(session, key, attrs, 2);
+	if(attrs[0].ulValueLen==sizeof keyclass && keyclass < trace_unknown) info.keyclass = static_cast<uint8_t>(keyclass);
+	if(attrs[1].ulValueLen==sizeof keytype && keytype < trace_unknown) info.keytype = static_cast<uint8_t>(keytype);
+
+	if(attrs[1].ulValueLen==sizeof keytype) {
+	    switch(keytype) {
+	    case CKK_RSA: {
+		CK_ATTRIBUTE modulus { CKA_MODULUS, nullptr, 0 };
+		if(m_real->C_GetAttributeValue(session, key, &modulus, 1)==CKR_OK) {
+		    info.bits = static_cast<uint16_t>(modulus.ulValueLen * 8);
+		}
+		break;
+	    }
+
+	    case CKK_EC: {
+		// named curves, as DER-encoded OIDs
+		static const std::map<std::vector<CK_BYTE>, uint16_t> curves {
+		    { { 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 }, 256 }, // secp256r1
+		    { { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22 }, 384 },		    // secp384r1
+		    { { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x23 }, 521 },		    // secp521r1
+		};
+		std::vector<CK_BYTE> ecparams(32);
+		CK_ATTRIBUTE params { CKA_EC_PARAMS, ecparams.data(), ecparams.size() };
+		if(m_real->C_GetAttributeValue(session, key, &params, 1)==CKR_OK) {
+		    ecparams.resize(params.ulValueLen);
+		    auto curve = curves.find(ecparams);
+		    if(curve!=curves.end()) info.bits = curve->second;
+		}
+		break;
+	    }
+
+	    default: {
+		CK_ULONG len;
+		CK_ATTRIBUTE valuelen { CKA_VALUE_LEN, &len, sizeof len };
+		if(m_real->C_GetAttributeValue(session, key, &valuelen, 1)==CKR_OK) {
+		    info.bits = static_cast<uint16_t>(len * 8);
+		}
+	    }
+	    }
+	}
+
+	cache.emplace(key, info);
+	return info;
+    }
+
+    ThreadBuffer::~ThreadBuffer()
+    {
+	for(auto &slot: m_entries) {
+	    delete slot.load(std::memory_order_relaxed);
+	}
+    }
+
+    Entry *ThreadBuffer::entry(size_t function, CK_MECHANISM_TYPE mechanism)
+    {
+	auto start = (mechanism * 31 + function) % capacity;
+
+	for(size_t probe=0; probe<capacity; probe++) {
+	    auto &slot = m_entries[(start + probe) % capacity];
+	    auto e = slot.load(std::memory_order_relaxed); // we are the only writer
+	    if(!e) {
+		e = new Entry(function, mechanism);
+		slot.store(e, std::memory_order_release);
+		return e;
+	    }
+	    if(e->function==function && e->mechanism==mechanism) {
+		return e;
+	    }
+	}
+	return nullptr;
+    }
+
+    // aggregated statistics for one function and one mechanism, across threads
+    struct Aggregate {
+	std::unique_ptr<Histogram> latency { new Histogram };
+	uint64_t errors { 0 };
+	CK_RV lasterror { CKR_OK };
+	uint64_t max_inflight { 0 };
+	uint64_t first { ~uint64_t(0) };
+	uint64_t last { 0 };
+	size_t threads { 0 };
+    };
+
+    void Profiler::dump()
+    {
+	std::lock_guard<std::mutex> lock(m_registry_mtx);
+
+	auto calls = m_calls.load(std::memory_order_relaxed);
+	if(calls==m_dumped_calls) {
+	    return;		// nothing new since last time
+	}
+	m_dumped_calls = calls;
+
+	std::map<std::pair<size_t, CK_MECHANISM_TYPE>, Aggregate> aggregates;
+	uint64_t dropped = 0;
+
+	for(auto &buffer: m_buffers) {
+	    buffer->for_each( [&aggregates] (const Entry &e) {
+		auto &agg = aggregates[std::make_pair(e.function, e.mechanism)];
+		agg.latency->add(e.latency);
+		agg.errors += e.errors.load(std::memory_order_relaxed);
+		auto lasterror = e.lasterror.load(std::memory_order_relaxed);
+		if(lasterror!=CKR_OK) agg.lasterror = lasterror;
+		agg.max_inflight = std::max(agg.max_inflight, e.max_inflight.load(std::memory_order_relaxed));
+		agg.first = std::min(agg.first, e.first.load(std::memory_order_relaxed));
+		agg.last = std::max(agg.last, e.last.load(std::memory_order_relaxed));
+		agg.threads++;
+	    });
+	    dropped += buffer->dropped();
+	}
+
+	auto d2s = [] (double arg) -> std::string {
+		       std::ostringstream stream;
+		       stream << arg;
+		       return stream.str();
+		   };
+
+	// timer resolution: each latency is the difference of two time measurements
+	struct timespec res;
+	clock_getres(CLOCK_MONOTONIC, &res);
+	const double nano_to_milli = 1000000.0;
+	const double epsilon = 2.0 * (res.tv_sec * 1000000000.0 + res.tv_nsec) / nano_to_milli;
+
+	pt::ptree profile;
+
+	for(auto &item: aggregates) {
+	    auto &desc = function_descriptors[item.first.first];
+	    auto mech = item.first.second;
+	    auto &agg = item.second;
+	    auto n = agg.latency->count();
+
+	    if(n==0) continue;
+
+	    std::string label = mech==no_mechanism ? "n/a" : mech==unknown_mechanism ? "unknown" : mechanism(mech);
+	    pt::ptree testcase;
+	    std::string prefix { label + ".calls." };
+
+	    testcase.add(prefix + "algorithm", desc.name);
+	    testcase.add(prefix + "label", label);
+	    testcase.add<size_t>(prefix + "threads", agg.threads);
+	    testcase.add<uint64_t>(prefix + "total iterations", n);
+	    testcase.add<uint64_t>(prefix + "errors", agg.errors);
+	    testcase.add<uint64_t>(prefix + "concurrency.maximum", agg.max_inflight);
+
+	    std::vector<std::pair<std::string, Measure<> > > result_rows;
+
+	    auto add_measure = [&result_rows] (const std::string &key, double value, double error, const std::string &unit) {
+		if(value > 0 && error > 0) {
+		    result_rows.emplace_back(key, Measure<>(value, error, unit));
+		}
+	    };
+
+	    auto latency_avg_val = agg.latency->mean() / nano_to_milli;
+	    auto latency_avg_err = n>1 ? std::sqrt(agg.latency->variance() / n) * 2 / nano_to_milli : 0.0;
+	    if(latency_avg_err < epsilon) latency_avg_err = epsilon;
+	    add_measure("latency.average", latency_avg_val, latency_avg_err, "ms");
+	    add_measure("latency.minimum", agg.latency->min() / nano_to_milli, epsilon, "ms");
+	    add_measure("latency.maximum", agg.latency->max() / nano_to_milli, epsilon, "ms");
+
+	    for(auto q: { std::make_pair("p50", 0.50), std::make_pair("p95", 0.95), std::make_pair("p98", 0.98), std::make_pair("p99", 0.99) }) {
+		auto err = agg.latency->quantile_error(q.second) / nano_to_milli;
+		add_measure(std::string("latency.") + q.first, agg.latency->quantile(q.second) / nano_to_milli, err < epsilon ? epsilon : err, "ms");
+	    }
+
+	    // rate and average concurrency, over the period where the function was called.
+	    // the count of calls follows a Poisson law, so its relative error is 1/sqrt(n)
+	    if(agg.last > agg.first && n>1) {
+		auto span = static_cast<double>(agg.last - agg.first);
+		auto tps_val = n * 1e9 / span;
+		add_measure("tps.global", tps_val, tps_val * 2 / std::sqrt(n), "Tnx/s");
+
+		// Little's law: average number of calls in progress is the busy time divided by the period
+		auto concurrency_val = agg.latency->sum() / span;
+		add_measure("concurrency.average", concurrency_val, concurrency_val * latency_avg_err / latency_avg_val, "call");
+		add_measure("wallclock", span / nano_to_milli, epsilon, "ms");
+	    }
+
+	    for(auto &row: result_rows) {
+		testcase.add<double>(prefix + row.first + ".value", row.second.value());
+		testcase.add(prefix + row.first + ".unit", row.second.unit());
+		testcase.add(prefix + row.first + ".error", d2s(row.second.error()));
+		testcase.add(prefix + row.first + ".relerr", d2s(row.second.relerr()));
+	    }
+
+	    testcase.add(prefix + "errorcode", errorcode(agg.lasterror));
+
+	    profile.add_child(pt::ptree::path_type(std::string(desc.name) + " using " + label, '\0'), testcase);
+	}
+
+	if(dropped) {
+	    std::fprintf(stderr, "p11profiler: %lu calls not accounted for, increase ThreadBuffer::capacity\n", static_cast<unsigned long>(dropped));
+	}
+
+	if(m_trace) {
+	    m_trace->flush();
+	    if(m_trace->dropped()) {
+		std::fprintf(stderr, "p11profiler: %lu calls not traced, increase P11PROFILER_TRACE_RECORDS\n", static_cast<unsigned long>(m_trace->dropped()));
+	    }
+	}
+
+	auto output = std::getenv("P11PROFILER_OUTPUT");
+	std::string path = output ? output : "p11profiler-" + std::to_string(getpid()) + ".json";
+	std::ofstream out(path);
+
+	if(!out) {
+	    std::fprintf(stderr, "p11profiler: cannot write profile to %s\n", path.c_str());
+	    return;
+	}
+
+	pt::write_json(out, profile);
+    }
+}
+
+
+//
+// PKCS#11 API
+//
+
+extern "C" {
+
+    __attribute__((visibility("default")))
+    CK_RV C_GetFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
+    {
+	if(!ppFunctionList) {
+	    return CKR_ARGUMENTS_BAD;
+	}
+
+	auto fl = p11profiler::Profiler::instance().interposed();
+	if(!fl) {
+	    return CKR_GENERAL_ERROR;
+	}
+
+	*ppFunctionList = fl;
+	return CKR_OK;
+    }
+}
+
+// EOF
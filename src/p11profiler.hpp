@@ -0,0 +1,147 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11profiler.hpp: a PKCS#11 interposer, to profile the calls of any application
+//
+// The application loads p11profiler.so in place of the vendor module. The profiler loads the real module,
+// given by the P11PROFILER_MODULE environment variable, and hands over to the application a function list
+// where every entry forwards the call to the real module, while measuring it.
+//
+// Calls are accounted for per function and per mechanism, in buffers private to each calling thread,
+// so that the calling path never takes a lock. Buffers are aggregated when the profile is written,
+// upon C_Finalize() and at process exit, to the file given by P11PROFILER_OUTPUT
+// (by default, p11profiler-<pid>.json), in the same JSON schema as p11perftest.
+// Optionally, every call is recorded to a trace file, given by P11PROFILER_TRACE, for later replay.
+
+#if !defined(P11PROFILER_H)
+#define P11PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <botan/p11.h>
+#include "histogram.hpp"
+#include "functions.hpp"
+#include "trace.hpp"
+
+namespace p11profiler {
+
+    // mechanism values used when a call does not carry a mechanism
+    constexpr CK_MECHANISM_TYPE no_mechanism = ~CK_MECHANISM_TYPE(0); // the function does not use any mechanism
+    constexpr CK_MECHANISM_TYPE unknown_mechanism = ~CK_MECHANISM_TYPE(1); // operation initialized from another thread, or not at all
+
+    // key used by a call, when tracing
+    struct KeyInfo {
+	uint8_t keyclass { trace_unknown };
+	uint8_t keytype { trace_unknown };
+	uint16_t bits { 0 };
+    };
+
+    constexpr size_t default_trace_records = 1048576;
+
+    // statistics for one function and one mechanism, within one thread
+    struct Entry {
+	const size_t function;
+	const CK_MECHANISM_TYPE mechanism;
+	Histogram latency;		       // in nanoseconds
+	std::atomic<uint64_t> errors { 0 };    // number of calls not returning CKR_OK
+	std::atomic<CK_RV> lasterror { CKR_OK };
+	std::atomic<uint64_t> max_inflight { 0 }; // highest number of calls in progress (all threads), seen at entry
+	std::atomic<uint64_t> first { 0 };	   // start of first call, in ns since profiler start
+	std::atomic<uint64_t> last { 0 };	   // end of last call, in ns since profiler start
+
+	Entry(size_t fn, CK_MECHANISM_TYPE mech) : function(fn), mechanism(mech) { }
+    };
+
+    // per-thread storage: a fixed-size, open addressing table of entries.
+    // Only the owning thread inserts; entries are published with release semantics,
+    // so that the profiler can walk the table at any time.
+    class ThreadBuffer
+    {
+    public:
+	static constexpr size_t capacity = 256;
+
+    private:
+	std::array<std::atomic<Entry *>, capacity> m_entries {};
+	std::atomic<uint64_t> m_dropped { 0 }; // calls not accounted for, because the table is full
+
+    public:
+	ThreadBuffer() = default;
+	ThreadBuffer(const ThreadBuffer &) = delete;
+	ThreadBuffer& operator=(const ThreadBuffer &) = delete;
+	~ThreadBuffer();
+
+	Entry *entry(size_t function, CK_MECHANISM_TYPE mechanism); // owner thread only. nullptr if the table is full
+	void drop() { m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	template<typename F>
+	void for_each(F f) const {
+	    for(auto &slot: m_entries) {
+		auto e = slot.load(std::memory_order_acquire);
+		if(e) f(*e);
+	    }
+	}
+    };
+
+    class Profiler
+    {
+	std::string m_module;	// path to the real module
+	void *m_dlhandle { nullptr };
+	CK_FUNCTION_LIST_PTR m_real { nullptr };
+	CK_FUNCTION_LIST m_interposed;
+
+	std::mutex m_registry_mtx; // protects m_buffers and the output file
+	std::vector<std::unique_ptr<ThreadBuffer> > m_buffers;
+
+	std::unique_ptr<TraceWriter> m_trace; // never released, as calls may come until the very end of the process
+	std::atomic<uint32_t> m_threads { 0 };
+
+	std::atomic<uint64_t> m_inflight { 0 };
+	std::atomic<uint64_t> m_calls { 0 };	// calls recorded, to know if a new dump is needed
+	uint64_t m_dumped_calls { 0 };
+	const uint64_t m_epoch;
+
+	Profiler();
+	ThreadBuffer *attach(); // registers a buffer for the calling thread
+
+    public:
+	static Profiler &instance();
+
+	inline CK_FUNCTION_LIST_PTR real() const { return m_real; }
+	inline CK_FUNCTION_LIST_PTR interposed() { return m_real ? &m_interposed : nullptr; }
+
+	static uint64_t now();	// monotonic time, in nanoseconds
+	inline uint64_t elapsed(uint64_t t) const { return t - m_epoch; }
+
+	inline uint64_t enter() { return m_inflight.fetch_add(1, std::memory_order_relaxed) + 1; }
+	inline void leave() { m_inflight.fetch_sub(1, std::memory_order_relaxed); }
+
+	void record(size_t function, CK_MECHANISM_TYPE mechanism, uint64_t start, uint64_t end, uint64_t inflight, CK_RV rv);
+	void dump();		// writes the profile to the output file, if anything new was recorded
+
+	inline bool tracing() const { return m_trace!=nullptr; }
+	void trace(TraceRecord &record);
+	KeyInfo key_info(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key);
+    };
+}
+
+#endif // P11PROFILER_H
@@ -17,6 +17,7 @@
 //
 
 #include "p11rsasig.hpp"
+#include "swbaseline.hpp"
 
 P11RSASigBenchmark::P11RSASigBenchmark(const std::string &label) :
     P11Benchmark( "RSA PKCS#1 Signature with SHA256 hashing (CKM_SHA256_RSA_PKCS)", label, ObjectClass::PrivateKey ) { }
@@ -37,6 +38,21 @@ inline P11RSASigBenchmark *P11RSASigBenchmark::clone() const {
     return new P11RSASigBenchmark{*this};
 }
 
+P11Benchmark *P11RSASigBenchmark::swbaseline() const {
+    return new SWBaselineBenchmark( SWBaselineBenchmark::Algorithm::RSASig, label() );
+}
+
+std::optional<size_t> P11RSASigBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    // payload is hashed, any size will do
+    if(function=="C_Sign" && mechanism==CKM_SHA256_RSA_PKCS) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11RSASigBenchmark::requirements() const {
+    return { { CKM_SHA256_RSA_PKCS, CKF_SIGN, keybits() },
+	     { CKM_RSA_PKCS_KEY_PAIR_GEN, CKF_GENERATE_KEY_PAIR, keybits(), true } };
+}
+
 void P11RSASigBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     m_rsakey = std::unique_ptr<PKCS11_RSA_PrivateKey>(new PKCS11_RSA_PrivateKey(session, obj.handle()));
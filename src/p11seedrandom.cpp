@@ -34,6 +34,11 @@ inline P11SeedRandomBenchmark *P11SeedRandomBenchmark::clone() const {
     return new P11SeedRandomBenchmark{*this};
 }
 
+std::optional<size_t> P11SeedRandomBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    if(function=="C_SeedRandom") return payload;
+    return std::nullopt;
+}
+
 void P11SeedRandomBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
     m_seed.resize( m_payload.size() );
@@ -0,0 +1,179 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "p11session.hpp"
+
+// the login state is shared by all sessions of the application, and C_Logout() destroys its private session objects,
+// and invalidates its handles to private objects. Login and Logout are therefore run with one thread, after all other
+// test cases (see p11perftest.cpp), and do not use any key. For these, any return code other than CKR_OK is an error.
+// Setup logs in a new session while the application is already logged in: there, CKR_USER_ALREADY_LOGGED_IN is expected,
+// and C_Login() only costs a round trip to the token. Setup does not measure a cold login; Login does.
+
+static std::string step_name(P11SessionBenchmark::Step step)
+{
+    switch(step) {
+    case P11SessionBenchmark::Step::Open:
+	return "Session open (C_OpenSession())";
+
+    case P11SessionBenchmark::Step::Close:
+	return "Session close (C_CloseSession())";
+
+    case P11SessionBenchmark::Step::Login:
+	return "Session login (C_Login())";
+
+    case P11SessionBenchmark::Step::Logout:
+	return "Session logout (C_Logout())";
+
+    case P11SessionBenchmark::Step::Setup:
+    default:
+	return "Session setup (C_OpenSession(), C_Login() while logged in, C_FindObjects(), C_CloseSession())";
+    }
+}
+
+
+P11SessionBenchmark::P11SessionBenchmark(const std::string &label, const Step step, const secure_string &pin) :
+    P11Benchmark( step_name(step), label, ObjectClass::SecretKey ),
+    m_step(step),
+    m_pin(pin) { }
+
+
+P11SessionBenchmark::P11SessionBenchmark(const P11SessionBenchmark &other) :
+    P11Benchmark(other),
+    m_step(other.m_step),
+    m_pin(other.m_pin) { }
+
+
+inline P11SessionBenchmark *P11SessionBenchmark::clone() const {
+    return new P11SessionBenchmark{*this};
+}
+
+std::optional<size_t> P11SessionBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    switch(m_step) {
+    case Step::Open:   if(function=="C_OpenSession") return payload; break;
+    case Step::Close:  if(function=="C_CloseSession") return payload; break;
+    case Step::Login:  if(function=="C_Login") return payload; break;
+    case Step::Logout: if(function=="C_Logout") return payload; break;
+    default: break;
+    }
+    return std::nullopt;
+}
+
+bool P11SessionBenchmark::requires_key() const
+{
+    // only Setup searches its key, in the new session. Login and Logout run once C_Logout() has destroyed session keys
+    return m_step==Step::Setup;
+}
+
+void P11SessionBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
+{
+    // the key is not used: for Setup, it is searched again in the new session, by label
+    m_slot = session.slot().slot_id();
+
+    m_search.reset(new AttributeContainer);
+    m_search->add_string( AttributeType::Label, build_threaded_label(threadindex) );
+    m_search->add_class( ObjectClass::SecretKey );
+}
+
+void P11SessionBenchmark::open(Session &session)
+{
+    session.module()->C_OpenSession( m_slot, CKF_SERIAL_SESSION | CKF_RW_SESSION, nullptr, nullptr, &m_handle );
+}
+
+void P11SessionBenchmark::close(Session &session)
+{
+    session.module()->C_CloseSession( m_handle );
+    m_handle = 0;
+}
+
+void P11SessionBenchmark::login(Session &session, SessionHandle handle)
+{
+    ReturnValue rv;
+    session.module()->C_Login( handle, UserType::User, m_pin, &rv );
+    if(rv!=ReturnValue::OK && !(m_step==Step::Setup && rv==ReturnValue::UserAlreadyLoggedIn)) {
+	throw PKCS11_ReturnError(rv);
+    }
+}
+
+void P11SessionBenchmark::logout(Session &session, SessionHandle handle)
+{
+    session.module()->C_Logout( handle );
+}
+
+void P11SessionBenchmark::find(Session &session, SessionHandle handle)
+{
+    ObjectHandle found[2];
+    Ulong count = 0;
+
+    session.module()->C_FindObjectsInit( handle, m_search->data(), static_cast<Ulong>(m_search->count()) );
+    session.module()->C_FindObjects( handle, found, 2, &count );
+    session.module()->C_FindObjectsFinal( handle );
+
+    // a setup that does not find its key must not be timed as a successful one
+    if(count!=1) {
+	throw PKCS11_ReturnError(ReturnValue::ObjectHandleInvalid);
+    }
+}
+
+void P11SessionBenchmark::crashtestdummy(Session &session)
+{
+    switch(m_step) {
+    case Step::Open:
+	open(session);
+	suspend_timer();
+	close(session);
+	resume_timer();
+	break;
+
+    case Step::Close:
+	suspend_timer();
+	open(session);
+	resume_timer();
+	close(session);
+	break;
+
+    case Step::Login:
+	// login and logout are done on the thread session, the application remains logged in afterwards
+	suspend_timer();
+	logout(session, session.handle());
+	resume_timer();
+	login(session, session.handle());
+	break;
+
+    case Step::Logout:
+	logout(session, session.handle());
+	suspend_timer();
+	login(session, session.handle());
+	resume_timer();
+	break;
+
+    case Step::Setup:
+	open(session);
+	try {
+	    login(session, m_handle);
+	    find(session, m_handle);
+	} catch (...) {
+	    // the new session is closed on failure too, or each failed iteration would leak one (with --keep-going)
+	    ReturnValue rv;
+	    session.module()->C_CloseSession( m_handle, &rv );
+	    m_handle = 0;
+	    throw;
+	}
+	close(session);
+	break;
+    }
+}
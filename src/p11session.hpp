@@ -0,0 +1,65 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// p11session: session lifecycle test cases, i.e. what a short-lived client does before its first operation
+
+#if !defined P11SESSION_HPP
+#define P11SESSION_HPP
+
+#include <memory>
+#include "p11benchmark.hpp"
+
+class P11SessionBenchmark : public P11Benchmark
+{
+public:
+    enum class Step : size_t {
+	Open,			// C_OpenSession() is measured, C_CloseSession() is not
+	Close,			// C_CloseSession() is measured, C_OpenSession() is not
+	Login,			// C_Login() is measured, C_Logout() is not
+	Logout,			// C_Logout() is measured, C_Login() is not
+	Setup			// C_OpenSession(), C_Login(), key search and C_CloseSession() are measured together.
+				// as the application is already logged in, C_Login() returns CKR_USER_ALREADY_LOGGED_IN
+    };
+
+private:
+    Step m_step;
+    secure_string m_pin;
+    SlotId m_slot { 0 };
+    SessionHandle m_handle { 0 };
+    std::unique_ptr<AttributeContainer> m_search; // key search template, for Setup
+
+    void open(Session &session);
+    void close(Session &session);
+    void login(Session &session, SessionHandle handle);
+    void logout(Session &session, SessionHandle handle);
+    void find(Session &session, SessionHandle handle);
+
+    virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
+    virtual void crashtestdummy(Session &session) override;
+    virtual P11SessionBenchmark *clone() const override;
+    virtual bool requires_key() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+
+public:
+
+    P11SessionBenchmark(const std::string &label, const Step step, const secure_string &pin);
+    P11SessionBenchmark(const P11SessionBenchmark & other);
+
+};
+
+#endif // P11SESSION_HPP
@@ -39,6 +39,16 @@ inline P11XorKeyDataDeriveBenchmark *P11XorKeyDataDeriveBenchmark::clone() const
     return new P11XorKeyDataDeriveBenchmark{*this};
 }
 
+std::optional<size_t> P11XorKeyDataDeriveBenchmark::replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const {
+    if(function=="C_DeriveKey" && mechanism==CKM_XOR_BASE_AND_DATA) return payload;
+    return std::nullopt;
+}
+
+std::vector<requirement_t> P11XorKeyDataDeriveBenchmark::requirements() const {
+    return { { CKM_XOR_BASE_AND_DATA, CKF_DERIVE, keybytes() },
+	     { CKM_GENERIC_SECRET_KEY_GEN, CKF_GENERATE, keybytes(), true } };
+}
+
 void P11XorKeyDataDeriveBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
 {
 
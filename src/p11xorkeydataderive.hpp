@@ -47,6 +47,8 @@ class P11XorKeyDataDeriveBenchmark : public P11Benchmark
     virtual void crashtestdummy(Session &session) override;
     virtual void cleanup(Session &session) override;
     virtual P11XorKeyDataDeriveBenchmark *clone() const override;
+    virtual std::optional<size_t> replays(const std::string &function, CK_MECHANISM_TYPE mechanism, size_t payload) const override;
+    virtual std::vector<requirement_t> requirements() const override;
 
 public:
 
@@ -0,0 +1,141 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// population.cpp: a class to populate the token with many objects, for the time of some test cases
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <future>
+#include <array>
+#include <boost/timer/timer.hpp>
+#include "population.hpp"
+#include "errorcodes.hpp"
+
+
+Population::Population( std::vector<std::unique_ptr<Session> > &sessions, const int numthreads, const Implementation::Vendor vendor, size_t size, bool token)
+    : m_sessions(sessions), m_numthreads(numthreads), m_vendor(vendor), m_token(token), m_handles(size, CK_INVALID_HANDLE)
+{
+    std::vector<std::future<bool> > future_array(m_numthreads);
+    boost::timer::cpu_timer t;
+
+    std::cout << "Populating token with " << size << (m_token ? " token" : " session") << " object(s)... " << std::flush;
+
+    // each thread writes to its own slots of m_handles, no locking needed
+    for(int th=0; th<m_numthreads; th++) {
+	future_array[th] = std::async( std::launch::async, &Population::populate, this, th );
+    }
+
+    bool rv = true;
+    for(int th=0; th<m_numthreads; th++) {
+	if(future_array[th].get() == false) {
+	    rv = false;
+	}
+    }
+
+    if(!rv) {
+	destroy();
+	throw KeyGenerationException{"could not populate token"};
+    }
+
+    std::cout << "done in " << t.format(3, "%w") << "s\n";
+}
+
+
+Population::~Population()
+{
+    std::cout << "Removing population of " << m_handles.size() << " object(s)\n";
+    destroy();
+}
+
+
+std::string Population::label(size_t index)
+{
+    std::stringstream label;
+    label << "population-" << std::setw(8) << std::setfill('0') << index;
+    return label.str();
+}
+
+
+bool Population::populate(size_t th)
+{
+    Byte btrue = CK_TRUE;
+    Byte bfalse = CK_FALSE;
+    Ulong len = 16;
+    Mechanism mech_aes_key_gen { CKM_AES_KEY_GEN, nullptr, 0 };
+    Session *session = m_sessions[th].get();
+
+    try {
+	for(size_t i=th; i<m_handles.size(); i+=m_numthreads) {
+	    auto alias = label(i);
+
+	    std::array<Attribute,6> keytemplate {
+		{
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Label), const_cast< char* >(alias.c_str()), alias.size() },
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Id), const_cast< char* >(alias.c_str()), alias.size() },
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Token), m_token ? &btrue : &bfalse, sizeof(Byte) },
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Encrypt), &btrue, sizeof(Byte) },
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::ValueLen), &len, sizeof(Ulong) },
+		    { static_cast<CK_ATTRIBUTE_TYPE>(AttributeType::Private), &btrue, sizeof(Byte) } // not well supported on Marvell
+		}
+	    };
+
+	    session->module()->C_GenerateKey( session->handle(),
+					      &mech_aes_key_gen,
+					      keytemplate.data(),
+					      m_vendor==Implementation::Vendor::marvell ? keytemplate.size()-1 : keytemplate.size(),
+					      &m_handles[i] );
+	}
+    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	std::cerr << "ERROR:: " << bexc.what()
+		  << " (" << errorcode(bexc.error_code()) << ")" << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+
+void Population::depopulate(size_t th)
+{
+    Session *session = m_sessions[th].get();
+
+    for(size_t i=th; i<m_handles.size(); i+=m_numthreads) {
+	if(m_handles[i]!=CK_INVALID_HANDLE) {
+	    ReturnValue rv;	// errors are ignored: session objects go away with sessions anyway
+	    session->module()->C_DestroyObject( session->handle(), m_handles[i], &rv );
+	    m_handles[i] = CK_INVALID_HANDLE;
+	}
+    }
+}
+
+
+void Population::destroy()
+{
+    std::vector<std::future<void> > future_array(m_numthreads);
+
+    for(int th=0; th<m_numthreads; th++) {
+	future_array[th] = std::async( std::launch::async, &Population::depopulate, this, th );
+    }
+
+    for(auto &f: future_array) {
+	f.get();
+    }
+}
+
+// EOF
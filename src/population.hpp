@@ -0,0 +1,73 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// population.hpp: a class to populate the token with many objects, for the time of some test cases
+
+#if !defined(POPULATION_H)
+#define POPULATION_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <botan/p11_types.h>
+#include "../config.h"
+#include "implementation.hpp"
+#include "keygenerator.hpp"
+
+using namespace Botan::PKCS11;
+
+class Population
+{
+    std::vector<std::unique_ptr<Session> > &m_sessions;
+    const int m_numthreads;
+    const Implementation::Vendor m_vendor;
+    const bool m_token;
+    std::vector<ObjectHandle> m_handles; // CK_INVALID_HANDLE when not created
+
+    // populate()/depopulate(): create/destroy objects whose index is congruent to th, using session of thread th
+    bool populate(size_t th);
+    void depopulate(size_t th);
+
+    void destroy();
+
+public:
+    // objects are AES keys, labelled and identified with label(index).
+    // creation is spread over the sessions; KeyGenerationException is thrown if it fails, after cleanup.
+    Population( std::vector<std::unique_ptr<Session> > &sessions,
+		const int numthreads,
+		const Implementation::Vendor vendor,
+		size_t size,
+		bool token );
+
+    // objects are destroyed with the population
+    ~Population();
+
+    Population( const Population &) = delete;
+    Population& operator=( const Population &) = delete;
+
+    Population( Population &&) = delete;
+    Population& operator=( Population &&) = delete;
+
+    inline size_t size() const { return m_handles.size(); }
+
+    // label(): label (and CKA_ID) of the object at index
+    static std::string label(size_t index);
+};
+
+
+#endif // POPULATION_H
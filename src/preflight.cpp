@@ -0,0 +1,130 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// preflight.cpp: a class to check, before running, that the token supports the mechanisms of test cases
+
+#include <iostream>
+#include <sstream>
+#include "preflight.hpp"
+#include "mechanisms.hpp"
+#include "errorcodes.hpp"
+
+namespace {
+    const std::vector<std::pair<CK_FLAGS, const std::string> > flagnames {
+	{ CKF_HW, "hw" },
+	{ CKF_ENCRYPT, "encrypt" },
+	{ CKF_DECRYPT, "decrypt" },
+	{ CKF_DIGEST, "digest" },
+	{ CKF_SIGN, "sign" },
+	{ CKF_SIGN_RECOVER, "sign_recover" },
+	{ CKF_VERIFY, "verify" },
+	{ CKF_VERIFY_RECOVER, "verify_recover" },
+	{ CKF_GENERATE, "generate" },
+	{ CKF_GENERATE_KEY_PAIR, "generate_key_pair" },
+	{ CKF_WRAP, "wrap" },
+	{ CKF_UNWRAP, "unwrap" },
+	{ CKF_DERIVE, "derive" },
+    };
+
+    // flags(): names of flags, separated by commas
+    std::string flags(CK_FLAGS value) {
+	std::string rv;
+	for(auto &entry: flagnames) {
+	    if(value & entry.first) {
+		if(!rv.empty()) rv += ',';
+		rv += entry.second;
+	    }
+	}
+	return rv;
+    }
+}
+
+
+Preflight::Preflight( Slot &slot, bool generating ) : m_generating(generating)
+{
+    try {
+	for(auto type: slot.get_mechanism_list()) {
+	    m_mechanisms.emplace( static_cast<CK_MECHANISM_TYPE>(type), slot.get_mechanism_info(type) );
+	}
+	m_available = true;
+    } catch (Botan::PKCS11::PKCS11_ReturnError &bexc) {
+	// without the list, nothing is pruned: test cases fail when running, as before
+	std::cerr << "*** Warning: could not obtain the mechanisms of the token (" << errorcode(bexc.error_code())
+		  << "), test cases are not checked\n";
+	m_mechanisms.clear();
+    }
+}
+
+
+std::vector<std::string> Preflight::check( const P11Benchmark &benchmark ) const
+{
+    std::vector<std::string> reasons;
+
+    if(!m_available) {
+	return reasons;
+    }
+
+    for(auto &requirement: benchmark.requirements()) {
+	if(requirement.keygen && !m_generating) {
+	    continue;
+	}
+
+	std::ostringstream reason;
+	auto name = mechanism(requirement.mechanism);
+	auto found = m_mechanisms.find(requirement.mechanism);
+
+	if(found==m_mechanisms.end()) {
+	    reason << name << " is not supported";
+	} else {
+	    auto &info = found->second;
+	    auto missing = requirement.flags & ~info.flags;
+
+	    if(missing) {
+		reason << name << " does not support " << flags(missing);
+	    } else if(requirement.keysize) {
+		// a maximum of 0 is reported by some tokens when there is no upper bound
+		if(*requirement.keysize < info.ulMinKeySize
+		   || (info.ulMaxKeySize!=0 && *requirement.keysize > info.ulMaxKeySize)) {
+		    reason << name << " does not support key size " << *requirement.keysize
+			   << " (supported: " << info.ulMinKeySize << ".." << info.ulMaxKeySize << ")";
+		}
+	    }
+	}
+
+	if(!reason.str().empty()) {
+	    reasons.push_back(reason.str() + (requirement.keygen ? ", needed to generate keys" : ""));
+	}
+    }
+
+    return reasons;
+}
+
+
+ptree Preflight::capabilities() const
+{
+    ptree rv;
+
+    for(auto &entry: m_mechanisms) {
+	ptree node;
+	node.put("minkeysize", entry.second.ulMinKeySize);
+	node.put("maxkeysize", entry.second.ulMaxKeySize);
+	node.put("flags", flags(entry.second.flags));
+	rv.push_back( ptree::value_type( mechanism(entry.first), node ) );
+    }
+
+    return rv;
+}
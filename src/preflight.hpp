@@ -0,0 +1,58 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// preflight.hpp: a class to check, before running, that the token supports the mechanisms of test cases
+
+#if !defined(PREFLIGHT_H)
+#define PREFLIGHT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <botan/p11_types.h>
+#include <boost/property_tree/ptree.hpp>
+#include "../config.h"
+#include "p11benchmark.hpp"
+
+using namespace Botan::PKCS11;
+using namespace boost::property_tree;
+
+class Preflight
+{
+    std::map<CK_MECHANISM_TYPE, MechanismInfo> m_mechanisms;
+    bool m_available { false };	// false when the mechanism list could not be obtained
+    const bool m_generating;	// when false, requirements for key generation are not checked
+
+public:
+    // mechanisms and their information are queried once, from the slot
+    Preflight( Slot &slot, bool generating );
+
+    Preflight( const Preflight &) = delete;
+    Preflight& operator=( const Preflight &) = delete;
+
+    inline bool available() const { return m_available; }
+    inline size_t size() const { return m_mechanisms.size(); }
+
+    // check(): reasons why the token cannot run the test case, empty when it can
+    std::vector<std::string> check( const P11Benchmark &benchmark ) const;
+
+    // capabilities(): mechanisms of the token, with key sizes and flags
+    ptree capabilities() const;
+};
+
+
+#endif // PREFLIGHT_H
@@ -0,0 +1,159 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// regression.cpp: compare results against a baseline JSON file
+
+#include <cmath>
+#include <iostream>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/math/distributions/students_t.hpp>
+#include <boost/math/distributions/normal.hpp>
+#include "regression.hpp"
+
+namespace bmath = boost::math;
+
+// measures compared, when present in both files. Average latency is compared with Welch's t-test,
+// as the number of samples is known. Percentiles are compared with a normal approximation,
+// using the error reported for them.
+static const std::vector<std::string> compared_measures { "latency.average", "latency.p95", "latency.p99" };
+
+
+Regression::Regression(const std::string &baselinefile, double threshold, double alpha)
+    : m_threshold(threshold), m_alpha(alpha)
+{
+    ptree baseline;
+    read_json(baselinefile, baseline);
+
+    // aggregated files group test cases by number of threads, under keys labelled "* thread-s"
+    for(auto &group: baseline) {
+	auto &name = group.first;
+	if(name.size() >= 8 && name.compare(name.size()-8, 8, "thread-s")==0) {
+	    index(group.second);
+	} else {
+	    index(baseline);
+	    break;
+	}
+    }
+}
+
+
+void Regression::index(const ptree &testcases)
+{
+    for(auto &testcase: testcases) {
+	for(auto &label: testcase.second) {
+	    for(auto &vector: label.second) {
+		auto threads = vector.second.get_optional<int>("threads");
+		if(threads) {
+		    m_baseline[ key_t(testcase.first, label.first, vector.first, *threads) ] = vector.second;
+		}
+	    }
+	}
+    }
+}
+
+
+std::vector<Regression::Outcome> Regression::compare(ptree &results) const
+{
+    std::vector<Outcome> outcomes;
+
+    for(auto &testcase: results) {
+	for(auto &label: testcase.second) {
+	    for(auto &vector: label.second) {
+		auto threads = vector.second.get_optional<int>("threads");
+		if(!threads) {
+		    continue;
+		}
+
+		auto found = m_baseline.find( key_t(testcase.first, label.first, vector.first, *threads) );
+		if(found==m_baseline.end()) {
+		    continue;
+		}
+
+		auto &before = found->second;
+		auto &after = vector.second;
+
+		for(auto &measure: compared_measures) {
+		    auto m1 = before.get_optional<double>(measure + ".value");
+		    auto m2 = after.get_optional<double>(measure + ".value");
+		    if(!m1 || !m2 || *m1<=0) {
+			continue;
+		    }
+
+		    // errors are reported with k=2, i.e. twice the standard error
+		    auto se1 = before.get<double>(measure + ".error", 0.0) / 2;
+		    auto se2 = after.get<double>(measure + ".error", 0.0) / 2;
+		    auto se = std::sqrt(se1*se1 + se2*se2);
+		    auto diff = *m2 - *m1;
+		    double pvalue;
+
+		    if(se==0) {
+			pvalue = diff==0 ? 1.0 : 0.0;
+		    } else if(measure=="latency.average") {
+			// Welch's t-test, with Welch-Satterthwaite degrees of freedom.
+			// when latencies are autocorrelated, the effective sample size stands for the number of samples
+			auto n1 = before.get<double>("samples.effective", before.get<double>("total iterations", 0.0));
+			auto n2 = after.get<double>("samples.effective", after.get<double>("total iterations", 0.0));
+			if(n1<2 || n2<2) {
+			    continue;
+			}
+			auto df = std::pow(se*se, 2) / ( std::pow(se1, 4)/(n1-1) + std::pow(se2, 4)/(n2-1) );
+			bmath::students_t dist(df);
+			pvalue = 2 * bmath::cdf(bmath::complement(dist, std::fabs(diff / se)));
+		    } else {
+			bmath::normal dist;
+			pvalue = 2 * bmath::cdf(bmath::complement(dist, std::fabs(diff / se)));
+		    }
+
+		    auto delta = diff / *m1;
+		    Verdict v;
+		    if(pvalue >= m_alpha) {
+			v = Verdict::unchanged;
+		    } else if(delta < 0) {
+			v = Verdict::improved;
+		    } else if(delta > m_threshold) {
+			v = Verdict::regressed;
+		    } else {
+			v = Verdict::within;
+		    }
+
+		    std::string prefix { "regression." + measure + '.' };
+		    vector.second.put(prefix + "baseline", *m1);
+		    vector.second.put(prefix + "delta", delta);
+		    vector.second.put(prefix + "pvalue", pvalue);
+		    vector.second.put(prefix + "verdict", verdict(v));
+
+		    outcomes.push_back( Outcome { testcase.first, label.first, vector.first, *threads, measure, *m1, *m2, delta, pvalue, v } );
+		}
+	    }
+	}
+    }
+
+    return outcomes;
+}
+
+
+std::string Regression::verdict(Verdict v)
+{
+    switch(v) {
+    case Verdict::unchanged: return "not significant";
+    case Verdict::within:    return "within threshold";
+    case Verdict::improved:  return "improved";
+    case Verdict::regressed: return "REGRESSION";
+    }
+    return "";
+}
@@ -0,0 +1,78 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// regression.hpp: compare results against a baseline JSON file, with a test of statistical significance,
+// to detect performance regressions (e.g. after a firmware or a client library upgrade)
+
+#if !defined(REGRESSION_H)
+#define REGRESSION_H
+
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <boost/property_tree/ptree.hpp>
+
+using namespace boost::property_tree;
+
+class Regression
+{
+public:
+    enum class Verdict {
+	unchanged,		// difference is not statistically significant
+	within,			// significant, but below the degradation threshold
+	improved,		// significant improvement
+	regressed		// significant degradation, above the threshold
+    };
+
+    struct Outcome {
+	std::string testcase;
+	std::string label;
+	std::string vector;
+	int threads;
+	std::string measure;	// e.g. latency.average
+	double baseline;
+	double current;
+	double delta;		// relative to baseline
+	double pvalue;		// two-sided
+	Verdict verdict;
+    };
+
+private:
+    // test case, key label, vector name, number of threads
+    using key_t = std::tuple<std::string, std::string, std::string, int>;
+
+    std::map<key_t, ptree> m_baseline;
+    double m_threshold;		// relative degradation, e.g. 0.05 for 5%
+    double m_alpha;		// significance level
+
+    void index(const ptree &testcases);
+
+public:
+    // the baseline file is read at construction time. throws when it cannot be parsed.
+    Regression(const std::string &baselinefile, double threshold, double alpha = 0.05);
+
+    size_t size() const { return m_baseline.size(); }
+
+    // compare(): match results against the baseline, and annotate results with the outcome
+    std::vector<Outcome> compare(ptree &results) const;
+
+    static std::string verdict(Verdict v);
+};
+
+#endif // REGRESSION_H
@@ -0,0 +1,174 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// resultsink.cpp: streaming output of results
+
+#include <cstdlib>
+#include <cctype>
+#include <ctime>
+#include <cstdio>
+#include <stdexcept>
+#include "resultsink.hpp"
+
+// is_number(): true when the whole string is a number, as written by property_tree
+static bool is_number(const std::string &value)
+{
+    // JSON numbers start with a digit or a minus sign, and end with a digit
+    if(value.empty() || !(std::isdigit(value.front()) || value.front()=='-') || !std::isdigit(value.back())) {
+	return false;
+    }
+    char *end;
+    std::strtod(value.c_str(), &end);
+    // hexadecimal is not valid JSON
+    return *end=='\0' && value.find_first_of("xX")==std::string::npos;
+}
+
+static std::string json_string(const std::string &value)
+{
+    std::string rv { '"' };
+    for(unsigned char c: value) {
+	switch(c) {
+	case '"':  rv += "\\\""; break;
+	case '\\': rv += "\\\\"; break;
+	case '\n': rv += "\\n"; break;
+	case '\r': rv += "\\r"; break;
+	case '\t': rv += "\\t"; break;
+	default:
+	    if(c < 0x20) {
+		char buf[8];
+		std::snprintf(buf, sizeof buf, "\\u%04x", c);
+		rv += buf;
+	    } else {
+		rv += c;
+	    }
+	}
+    }
+    return rv + '"';
+}
+
+static std::string json_value(const ptree &node)
+{
+    if(node.empty()) {
+	auto &value = node.data();
+	return is_number(value) ? value : json_string(value);
+    }
+
+    std::string rv { '{' };
+    bool first = true;
+    for(auto &child: node) {
+	if(!first) rv += ',';
+	rv += json_string(child.first) + ':' + json_value(child.second);
+	first = false;
+    }
+    return rv + '}';
+}
+
+static std::string csv_field(const std::string &value)
+{
+    if(value.find_first_of(",\"\n\r")==std::string::npos) {
+	return value;
+    }
+    std::string rv { '"' };
+    for(auto c: value) {
+	if(c=='"') rv += '"';
+	rv += c;
+    }
+    return rv + '"';
+}
+
+static std::string now_iso8601()
+{
+    char buf[32];
+    auto now = std::time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    std::strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
+}
+
+
+ResultSink::ResultSink(const std::string &path, Format format) : m_format(format)
+{
+    m_out.open(path, std::ios::out | std::ios::app);
+    if(!m_out) {
+	throw std::runtime_error("cannot open " + path + " for appending");
+    }
+
+    // CSV header, only when the file is new
+    if(m_format==Format::csv && m_out.tellp()==0) {
+	m_out << "completed,test case,key label,vector name,field,value\n" << std::flush;
+    }
+}
+
+std::optional<ResultSink::Format> ResultSink::format(const std::string &name)
+{
+    auto ends_with = [&name] (const std::string &suffix) {
+	return name.size() >= suffix.size() && name.compare(name.size()-suffix.size(), suffix.size(), suffix)==0;
+    };
+
+    if(name=="ndjson" || ends_with(".ndjson") || ends_with(".jsonl")) {
+	return Format::ndjson;
+    } else if(name=="csv" || ends_with(".csv")) {
+	return Format::csv;
+    }
+    return std::nullopt;
+}
+
+void ResultSink::write_ndjson(const std::string &testcase, const std::string &label, const std::string &vector, const std::string &completed, const ptree &results)
+{
+    m_out << "{\"test case\":" << json_string(testcase)
+	  << ",\"key label\":" << json_string(label)
+	  << ",\"vector name\":" << json_string(vector)
+	  << ",\"completed\":" << json_string(completed)
+	  << ",\"results\":" << json_value(results)
+	  << "}\n";
+}
+
+void ResultSink::write_csv(const std::string &testcase, const std::string &label, const std::string &vector, const std::string &completed, const ptree &results, const std::string &prefix)
+{
+    for(auto &child: results) {
+	auto field = prefix.empty() ? child.first : prefix + '.' + child.first;
+	if(child.second.empty()) {
+	    m_out << completed << ','
+		  << csv_field(testcase) << ','
+		  << csv_field(label) << ','
+		  << csv_field(vector) << ','
+		  << csv_field(field) << ','
+		  << csv_field(child.second.data()) << '\n';
+	} else {
+	    write_csv(testcase, label, vector, completed, child.second, field);
+	}
+    }
+}
+
+void ResultSink::write(const std::string &testcase, const ptree &tree)
+{
+    auto completed = now_iso8601();
+
+    for(auto &label: tree) {
+	for(auto &vector: label.second) {
+	    if(m_format==Format::ndjson) {
+		write_ndjson(testcase, label.first, vector.first, completed, vector.second);
+	    } else {
+		write_csv(testcase, label.first, vector.first, completed, vector.second, "");
+	    }
+	}
+    }
+
+    m_out.flush();
+}
@@ -0,0 +1,63 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// resultsink.hpp: streaming output of results, one record per test case and vector,
+// appended and flushed as soon as a test case completes, so that a long campaign
+// does not lose results when interrupted.
+//
+// Two formats are supported:
+//  - NDJSON: one JSON object per line, with "test case", "key label", "vector name",
+//    "completed" (ISO 8601 timestamp) and "results", holding the same structure as JSON output,
+//    with numbers written as numbers.
+//  - CSV: long format, one line per measure, with columns
+//    completed,test case,key label,vector name,field,value
+
+#if !defined(RESULTSINK_H)
+#define RESULTSINK_H
+
+#include <fstream>
+#include <optional>
+#include <string>
+#include <boost/property_tree/ptree.hpp>
+
+using namespace boost::property_tree;
+
+class ResultSink
+{
+public:
+    enum class Format { ndjson, csv };
+
+private:
+    std::ofstream m_out;
+    Format m_format;
+
+    void write_ndjson(const std::string &testcase, const std::string &label, const std::string &vector, const std::string &completed, const ptree &results);
+    void write_csv(const std::string &testcase, const std::string &label, const std::string &vector, const std::string &completed, const ptree &results, const std::string &prefix);
+
+public:
+    // the file is opened for appending. throws when it cannot be opened.
+    ResultSink(const std::string &path, Format format);
+
+    // format(): retrieve a format from its name, or from a file extension
+    static std::optional<Format> format(const std::string &name);
+
+    // write(): append the records of a test case, as returned by Executor, and flush them
+    void write(const std::string &testcase, const ptree &tree);
+};
+
+#endif // RESULTSINK_H
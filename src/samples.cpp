@@ -0,0 +1,164 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// samples.cpp: export of raw samples, to a compact columnar binary file
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include "samples.hpp"
+
+static const char samples_magic[8] = { 'P', '1', '1', 'S', 'M', 'P', 'L', 'S' };
+
+static std::runtime_error samples_error(const std::string &what, const std::string &path)
+{
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+SampleWriter::SampleWriter(const std::string &prefix) : m_prefix(prefix)
+{
+    m_start = std::fopen((prefix + ".start.tmp").c_str(), "w+b");
+    m_duration = std::fopen((prefix + ".duration.tmp").c_str(), "w+b");
+    m_rc = std::fopen((prefix + ".rc.tmp").c_str(), "w+b");
+
+    if(!m_start || !m_duration || !m_rc) {
+	auto error = samples_error("cannot create temporary files", prefix + ".*.tmp");
+	close();
+	throw error;
+    }
+
+    m_start_buf.reserve(buffer_size);
+    m_duration_buf.reserve(buffer_size);
+    m_rc_buf.reserve(buffer_size);
+}
+
+SampleWriter::~SampleWriter()
+{
+    close();
+}
+
+void SampleWriter::close()
+{
+    for(auto column: { std::make_pair(&m_start, ".start.tmp"), std::make_pair(&m_duration, ".duration.tmp"), std::make_pair(&m_rc, ".rc.tmp") }) {
+	if(*column.first) {
+	    std::fclose(*column.first);
+	    *column.first = nullptr;
+	    std::remove((m_prefix + column.second).c_str());
+	}
+    }
+}
+
+void SampleWriter::flush()
+{
+    auto n = m_rc_buf.size();
+    if(n==0) {
+	return;
+    }
+
+    if(std::fwrite(m_start_buf.data(), sizeof(uint64_t), n, m_start)!=n
+       || std::fwrite(m_duration_buf.data(), sizeof(uint64_t), n, m_duration)!=n
+       || std::fwrite(m_rc_buf.data(), sizeof(uint32_t), n, m_rc)!=n) {
+	throw samples_error("cannot write temporary files", m_prefix + ".*.tmp");
+    }
+
+    m_count += n;
+    m_start_buf.clear();
+    m_duration_buf.clear();
+    m_rc_buf.clear();
+}
+
+// copy a temporary column file to the output
+static void copy_column(std::FILE *from, std::FILE *to, const std::string &path)
+{
+    char buffer[65536];
+    size_t n;
+
+    std::rewind(from);
+    while((n = std::fread(buffer, 1, sizeof buffer, from)) > 0) {
+	if(std::fwrite(buffer, 1, n, to)!=n) {
+	    throw samples_error("cannot write", path);
+	}
+    }
+}
+
+uint64_t assemble_samples(const std::string &path, std::vector<SampleWriter *> &writers)
+{
+    SamplesHeader header {};
+    std::memcpy(header.magic, samples_magic, sizeof samples_magic);
+    header.version = samples_version;
+    header.header_size = sizeof(SamplesHeader);
+    header.threads = writers.size();
+
+    for(auto writer: writers) {
+	writer->flush();
+	std::fflush(writer->m_start);
+	std::fflush(writer->m_duration);
+	std::fflush(writer->m_rc);
+	header.count += writer->m_count;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.realtime = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+    header.monotonic = monotonic_ns();
+
+    std::FILE *out = std::fopen(path.c_str(), "wb");
+    if(!out) {
+	throw samples_error("cannot create", path);
+    }
+
+    try {
+	if(std::fwrite(&header, sizeof header, 1, out)!=1) {
+	    throw samples_error("cannot write", path);
+	}
+
+	for(auto writer: writers) copy_column(writer->m_start, out, path);
+	for(auto writer: writers) copy_column(writer->m_duration, out, path);
+
+	// thread column is not buffered by writers, as it is implicit
+	for(uint32_t th=0; th<writers.size(); th++) {
+	    std::vector<uint32_t> thread_column(SampleWriter::buffer_size, th);
+	    for(uint64_t left = writers[th]->m_count; left>0; ) {
+		auto n = left < thread_column.size() ? left : thread_column.size();
+		if(std::fwrite(thread_column.data(), sizeof(uint32_t), n, out)!=n) {
+		    throw samples_error("cannot write", path);
+		}
+		left -= n;
+	    }
+	}
+
+	for(auto writer: writers) copy_column(writer->m_rc, out, path);
+    } catch(...) {
+	std::fclose(out);
+	throw;
+    }
+
+    if(std::fclose(out)!=0) {
+	throw samples_error("cannot write", path);
+    }
+
+    return header.count;
+}
@@ -0,0 +1,99 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// samples.hpp: export of raw samples, to a compact columnar binary file, for offline analysis
+//
+// A samples file is made of a header, followed by columns, in native byte order:
+//  - start    uint64_t[count]: start of the call, CLOCK_MONOTONIC, in ns
+//  - duration uint64_t[count]: wall clock time of the call, in ns
+//  - thread   uint32_t[count]: thread index
+//  - rc       uint32_t[count]: return code of the call (CKR_xxx)
+// Samples are grouped by thread, in the order of execution. Columns can be memory-mapped directly.
+//
+// While measuring, each thread buffers its own samples, and spills them to temporary
+// files (one per column) in between iterations. The file is assembled once all threads are done.
+
+#if !defined(SAMPLES_H)
+#define SAMPLES_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct SamplesHeader {
+    char magic[8];		// "P11SMPLS"
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t count;		// number of samples
+    uint32_t threads;
+    uint32_t reserved;
+    uint64_t realtime;		// wall clock, in ns since the epoch, taken together with monotonic
+    uint64_t monotonic;		// CLOCK_MONOTONIC, in ns
+    uint8_t padding[16];
+};
+
+static_assert(sizeof(SamplesHeader)==64, "unexpected SamplesHeader size");
+
+constexpr uint32_t samples_version = 1;
+
+class SampleWriter
+{
+    static constexpr size_t buffer_size = 8192;
+
+    std::string m_prefix;
+    std::FILE *m_start { nullptr };
+    std::FILE *m_duration { nullptr };
+    std::FILE *m_rc { nullptr };
+    std::vector<uint64_t> m_start_buf;
+    std::vector<uint64_t> m_duration_buf;
+    std::vector<uint32_t> m_rc_buf;
+    uint64_t m_count { 0 };
+
+    void close();		// close and remove temporary files
+
+    friend uint64_t assemble_samples(const std::string &path, std::vector<SampleWriter *> &writers);
+
+public:
+    // prefix is used to name temporary files
+    SampleWriter(const std::string &prefix);
+    ~SampleWriter();
+
+    SampleWriter(const SampleWriter &) = delete;
+    SampleWriter& operator=(const SampleWriter &) = delete;
+
+    inline void record(uint64_t start, uint64_t duration, uint32_t rc) {
+	m_start_buf.push_back(start);
+	m_duration_buf.push_back(duration);
+	m_rc_buf.push_back(rc);
+	if(m_rc_buf.size()==buffer_size) {
+	    flush();
+	}
+    }
+
+    void flush();
+    inline uint64_t count() const { return m_count + m_rc_buf.size(); }
+};
+
+// assemble_samples(): write the samples file from per-thread writers, in thread order. returns the number of samples.
+uint64_t assemble_samples(const std::string &path, std::vector<SampleWriter *> &writers);
+
+// monotonic_ns(): CLOCK_MONOTONIC, in ns, the time base of the start column
+uint64_t monotonic_ns();
+
+#endif // SAMPLES_H
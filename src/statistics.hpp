@@ -0,0 +1,132 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// statistics.hpp: online accumulators, updated by each thread while measuring, and merged afterwards.
+// Memory usage does not depend upon the number of iterations.
+
+#if !defined(STATISTICS_HPP)
+#define STATISTICS_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+// RunningStats: count, mean, variance, minimum and maximum, using Welford's algorithm.
+// Two instances are merged with the pairwise formula of Chan et al.
+class RunningStats
+{
+    uint64_t m_count { 0 };
+    double m_mean { 0.0 };
+    double m_m2 { 0.0 };	// sum of squared deviations from the mean
+    double m_min { std::numeric_limits<double>::infinity() };
+    double m_max { -std::numeric_limits<double>::infinity() };
+
+public:
+    inline void add(double x) {
+	m_count++;
+	auto delta = x - m_mean;
+	m_mean += delta / m_count;
+	m_m2 += delta * (x - m_mean);
+	if(x < m_min) m_min = x;
+	if(x > m_max) m_max = x;
+    }
+
+    void merge(const RunningStats &other) {
+	if(other.m_count==0) {
+	    return;
+	}
+	if(m_count==0) {
+	    *this = other;
+	    return;
+	}
+	double n = m_count + other.m_count;
+	auto delta = other.m_mean - m_mean;
+	m_mean += delta * other.m_count / n;
+	m_m2 += other.m_m2 + delta * delta * m_count * other.m_count / n;
+	m_count += other.m_count;
+	if(other.m_min < m_min) m_min = other.m_min;
+	if(other.m_max > m_max) m_max = other.m_max;
+    }
+
+    inline uint64_t count() const { return m_count; }
+    inline double mean() const { return m_mean; }
+    inline double min() const { return m_min; }
+    inline double max() const { return m_max; }
+    inline double m2() const { return m_m2; }
+
+    // sample variance
+    inline double variance() const { return m_count>1 ? m_m2 / (m_count - 1) : 0.0; }
+};
+
+
+// SerialAccumulator: what is needed to estimate the serial correlation of a sequence,
+// i.e. lag-1 products and means of consecutive batches. Values are shifted by the first one,
+// to avoid cancellation when the lag-1 numerator is computed around the global mean.
+class SerialAccumulator
+{
+    size_t m_batch_size { 0 };
+    double m_shift { 0.0 };
+    double m_previous { 0.0 };
+    uint64_t m_count { 0 };
+    double m_sum_lag { 0.0 };	// sum of y(i).y(i+1)
+    double m_sum_head { 0.0 };	// sum of y(i), for i<n
+    double m_sum_tail { 0.0 };	// sum of y(i+1), for i<n
+    double m_batch_sum { 0.0 };
+    size_t m_in_batch { 0 };
+    RunningStats m_batch_means;
+
+public:
+    SerialAccumulator() = default;
+    SerialAccumulator(size_t batch_size) : m_batch_size(batch_size) { }
+
+    inline void add(double x) {
+	if(m_count==0) {
+	    m_shift = x;
+	}
+	auto y = x - m_shift;
+	if(m_count>0) {
+	    m_sum_lag += m_previous * y;
+	    m_sum_head += m_previous;
+	    m_sum_tail += y;
+	}
+	m_previous = y;
+	m_count++;
+
+	if(m_batch_size>0) {
+	    m_batch_sum += x;
+	    if(++m_in_batch==m_batch_size) {
+		m_batch_means.add(m_batch_sum / m_batch_size);
+		m_batch_sum = 0.0;
+		m_in_batch = 0;
+	    }
+	}
+    }
+
+    // sum of (x(i)-mean).(x(i+1)-mean) over the sequence, for a given mean
+    inline double lag1_numerator(double mean) const {
+	if(m_count<2) {
+	    return 0.0;
+	}
+	auto c = mean - m_shift;
+	return m_sum_lag - c * (m_sum_head + m_sum_tail) + (m_count - 1) * c * c;
+    }
+
+    inline const RunningStats &batch_means() const { return m_batch_means; }
+};
+
+#endif // STATISTICS_HPP
@@ -0,0 +1,301 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <iostream>
+#include <map>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <openssl/err.h>
+#include <openssl/rsa.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include "swbaseline.hpp"
+
+namespace {
+
+    const std::map<SWBaselineBenchmark::Algorithm, std::string> algorithm_names {
+	{ SWBaselineBenchmark::Algorithm::RSASig, "RSA PKCS#1 v1.5 signature with SHA256" },
+	{ SWBaselineBenchmark::Algorithm::RSAOAEPSHA1, "RSA PKCS#1 OAEP decryption (SHA1)" },
+	{ SWBaselineBenchmark::Algorithm::RSAOAEPSHA256, "RSA PKCS#1 OAEP decryption (SHA256)" },
+	{ SWBaselineBenchmark::Algorithm::ECDSA, "ECDSA signature" },
+	{ SWBaselineBenchmark::Algorithm::ECDH, "ECDH key agreement" },
+	{ SWBaselineBenchmark::Algorithm::HMACSHA1, "HMAC SHA1" },
+	{ SWBaselineBenchmark::Algorithm::HMACSHA256, "HMAC SHA256" },
+	{ SWBaselineBenchmark::Algorithm::HMACSHA512, "HMAC SHA512" },
+	{ SWBaselineBenchmark::Algorithm::DES3ECB, "DES3 Encryption (ECB)" },
+	{ SWBaselineBenchmark::Algorithm::DES3CBC, "DES3 Encryption (CBC)" },
+	{ SWBaselineBenchmark::Algorithm::AESECB, "AES Encryption (ECB)" },
+	{ SWBaselineBenchmark::Algorithm::AESCBC, "AES Encryption (CBC)" },
+	{ SWBaselineBenchmark::Algorithm::AESGCM, "AES Encryption (GCM)" },
+    };
+
+    const std::map<std::string, int> curve_nids {
+	{ "secp256r1", NID_X9_62_prime256v1 },
+	{ "secp384r1", NID_secp384r1 },
+	{ "secp521r1", NID_secp521r1 },
+    };
+
+    // throw a PKCS#11 exception, so that failures are reported the same way as for tokens
+    void check(int rc, const char *what)
+    {
+	if(rc<=0) {
+	    char buf[256];
+	    ERR_error_string_n(ERR_get_error(), buf, sizeof buf);
+	    std::cerr << "Error: OpenSSL " << what << " failed: " << buf << std::endl;
+	    throw Botan::PKCS11::PKCS11_ReturnError(ReturnValue::FunctionFailed);
+	}
+    }
+
+    // the part of the label after the first dash, e.g. "2048" for "rsa-2048", "secp256r1" for "ecdsa-secp256r1"
+    std::string label_suffix(const std::string &label)
+    {
+	auto pos = label.find('-');
+	return pos==std::string::npos ? label : label.substr(pos+1);
+    }
+}
+
+
+SWBaselineBenchmark::SWBaselineBenchmark(const Algorithm algorithm, const std::string &label) :
+    P11Benchmark( "Software baseline, " + algorithm_names.at(algorithm), label, ObjectClass::SecretKey ),
+    m_algorithm(algorithm) { }
+
+
+SWBaselineBenchmark::SWBaselineBenchmark(const SWBaselineBenchmark &other) :
+    P11Benchmark(other), m_algorithm(other.m_algorithm)
+{
+    // keys are not copied, each clone generates its own in prepare()
+}
+
+
+inline SWBaselineBenchmark *SWBaselineBenchmark::clone() const {
+    return new SWBaselineBenchmark{*this};
+}
+
+
+// ECB and CBC are not padded, as with PKCS#11: payloads must be a multiple of the block size
+bool SWBaselineBenchmark::accepts(size_t payload) const
+{
+    switch(m_algorithm) {
+    case Algorithm::DES3ECB:
+    case Algorithm::DES3CBC:
+	return payload % 8 == 0;
+
+    case Algorithm::AESECB:
+    case Algorithm::AESCBC:
+	return payload % 16 == 0;
+
+    default:
+	return true;
+    }
+}
+
+
+void SWBaselineBenchmark::generate_keys()
+{
+    auto generate = [] (int id, std::function<int(EVP_PKEY_CTX *)> setup) -> EVP_PKEY * {
+	EVP_PKEY *pkey = nullptr;
+	std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx { EVP_PKEY_CTX_new_id(id, nullptr), EVP_PKEY_CTX_free };
+
+	check(ctx ? 1 : 0, "EVP_PKEY_CTX_new_id()");
+	check(EVP_PKEY_keygen_init(ctx.get()), "EVP_PKEY_keygen_init()");
+	check(setup(ctx.get()), "key generation parameters");
+	check(EVP_PKEY_keygen(ctx.get(), &pkey), "EVP_PKEY_keygen()");
+	return pkey;
+    };
+
+    std::random_device rd;
+    auto suffix = label_suffix(label());
+
+    switch(m_algorithm) {
+    case Algorithm::RSASig:
+    case Algorithm::RSAOAEPSHA1:
+    case Algorithm::RSAOAEPSHA256: {
+	int bits = std::stoi(suffix);
+	m_pkey.reset(generate(EVP_PKEY_RSA, [bits] (EVP_PKEY_CTX *ctx) { return EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, bits); }));
+	break;
+    }
+
+    case Algorithm::ECDSA:
+    case Algorithm::ECDH: {
+	int nid = curve_nids.at(suffix);
+	m_pkey.reset(generate(EVP_PKEY_EC, [nid] (EVP_PKEY_CTX *ctx) { return EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, nid); }));
+	if(m_algorithm==Algorithm::ECDH) {
+	    m_peer.reset(generate(EVP_PKEY_EC, [nid] (EVP_PKEY_CTX *ctx) { return EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, nid); }));
+	}
+	break;
+    }
+
+    case Algorithm::HMACSHA1:
+    case Algorithm::HMACSHA256:
+    case Algorithm::HMACSHA512:
+	m_secret.resize(std::stoi(suffix)/8);
+	std::generate(m_secret.begin(), m_secret.end(), [&rd] () { return static_cast<uint8_t>(rd()); });
+	m_pkey.reset(EVP_PKEY_new_raw_private_key(EVP_PKEY_HMAC, nullptr, m_secret.data(), m_secret.size()));
+	check(m_pkey ? 1 : 0, "EVP_PKEY_new_raw_private_key()");
+	break;
+
+    default:			// symmetric ciphers
+	m_secret.resize(std::stoi(suffix)/8);
+	std::generate(m_secret.begin(), m_secret.end(), [&rd] () { return static_cast<uint8_t>(rd()); });
+	m_iv.resize(16);
+	std::generate(m_iv.begin(), m_iv.end(), [&rd] () { return static_cast<uint8_t>(rd()); });
+	break;
+    }
+}
+
+
+void SWBaselineBenchmark::prepare(Session &session, Object &obj, std::optional<size_t> threadindex)
+{
+    generate_keys();
+
+    switch(m_algorithm) {
+    case Algorithm::RSAOAEPSHA1:
+    case Algorithm::RSAOAEPSHA256: {
+	// encrypt the payload, to obtain the ciphertext to decrypt
+	std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx { EVP_PKEY_CTX_new(m_pkey.get(), nullptr), EVP_PKEY_CTX_free };
+	size_t outlen = 0;
+
+	check(EVP_PKEY_encrypt_init(ctx.get()), "EVP_PKEY_encrypt_init()");
+	check(EVP_PKEY_CTX_set_rsa_padding(ctx.get(), RSA_PKCS1_OAEP_PADDING), "EVP_PKEY_CTX_set_rsa_padding()");
+	if(m_algorithm==Algorithm::RSAOAEPSHA256) {
+	    check(EVP_PKEY_CTX_set_rsa_oaep_md(ctx.get(), EVP_sha256()), "EVP_PKEY_CTX_set_rsa_oaep_md()");
+	    check(EVP_PKEY_CTX_set_rsa_mgf1_md(ctx.get(), EVP_sha256()), "EVP_PKEY_CTX_set_rsa_mgf1_md()");
+	}
+	check(EVP_PKEY_encrypt(ctx.get(), nullptr, &outlen, m_payload.data(), m_payload.size()), "EVP_PKEY_encrypt()");
+	m_input.resize(outlen);
+	check(EVP_PKEY_encrypt(ctx.get(), m_input.data(), &outlen, m_payload.data(), m_payload.size()), "EVP_PKEY_encrypt()");
+	m_input.resize(outlen);
+	m_output.resize(outlen);
+	break;
+    }
+
+    case Algorithm::ECDSA: {
+	// like for PKCS#11, hashing is performed beforehand, and not accounted for
+	unsigned int mdlen = 0;
+	m_input.resize(EVP_MAX_MD_SIZE);
+	check(EVP_Digest(m_payload.data(), m_payload.size(), m_input.data(), &mdlen, EVP_sha256(), nullptr), "EVP_Digest()");
+	m_input.resize(mdlen);
+	m_output.resize(EVP_PKEY_size(m_pkey.get()));
+	break;
+    }
+
+    case Algorithm::RSASig:
+	m_output.resize(EVP_PKEY_size(m_pkey.get()));
+	break;
+
+    case Algorithm::ECDH:
+	m_output.resize(EVP_PKEY_size(m_pkey.get()));
+	break;
+
+    default:
+	m_output.resize(m_payload.size() + EVP_MAX_BLOCK_LENGTH + EVP_MAX_MD_SIZE);
+	break;
+    }
+}
+
+
+void SWBaselineBenchmark::cipher(const EVP_CIPHER *evp_cipher)
+{
+    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx { EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free };
+    int outlen = 0, finallen = 0;
+
+    check(EVP_EncryptInit_ex(ctx.get(), evp_cipher, nullptr, m_secret.data(), m_iv.data()), "EVP_EncryptInit_ex()");
+    check(EVP_CIPHER_CTX_set_padding(ctx.get(), 0), "EVP_CIPHER_CTX_set_padding()"); // PKCS#11 ECB and CBC mechanisms do not pad
+    check(EVP_EncryptUpdate(ctx.get(), m_output.data(), &outlen, m_payload.data(), m_payload.size()), "EVP_EncryptUpdate()");
+    check(EVP_EncryptFinal_ex(ctx.get(), m_output.data() + outlen, &finallen), "EVP_EncryptFinal_ex()");
+
+    if(m_algorithm==Algorithm::AESGCM) {
+	check(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, 16, m_output.data() + outlen + finallen), "EVP_CIPHER_CTX_ctrl()");
+    }
+}
+
+
+void SWBaselineBenchmark::crashtestdummy(Session &session)
+{
+    switch(m_algorithm) {
+    case Algorithm::RSASig:
+    case Algorithm::HMACSHA1:
+    case Algorithm::HMACSHA256:
+    case Algorithm::HMACSHA512: {
+	const EVP_MD *md = m_algorithm==Algorithm::HMACSHA1 ? EVP_sha1()
+	    : m_algorithm==Algorithm::HMACSHA512 ? EVP_sha512()
+	    : EVP_sha256();
+	std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx { EVP_MD_CTX_new(), EVP_MD_CTX_free };
+	size_t outlen = m_output.size();
+
+	check(EVP_DigestSignInit(ctx.get(), nullptr, md, nullptr, m_pkey.get()), "EVP_DigestSignInit()");
+	check(EVP_DigestSign(ctx.get(), m_output.data(), &outlen, m_payload.data(), m_payload.size()), "EVP_DigestSign()");
+	break;
+    }
+
+    case Algorithm::RSAOAEPSHA1:
+    case Algorithm::RSAOAEPSHA256: {
+	std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx { EVP_PKEY_CTX_new(m_pkey.get(), nullptr), EVP_PKEY_CTX_free };
+	size_t outlen = m_output.size();
+
+	check(EVP_PKEY_decrypt_init(ctx.get()), "EVP_PKEY_decrypt_init()");
+	check(EVP_PKEY_CTX_set_rsa_padding(ctx.get(), RSA_PKCS1_OAEP_PADDING), "EVP_PKEY_CTX_set_rsa_padding()");
+	if(m_algorithm==Algorithm::RSAOAEPSHA256) {
+	    check(EVP_PKEY_CTX_set_rsa_oaep_md(ctx.get(), EVP_sha256()), "EVP_PKEY_CTX_set_rsa_oaep_md()");
+	    check(EVP_PKEY_CTX_set_rsa_mgf1_md(ctx.get(), EVP_sha256()), "EVP_PKEY_CTX_set_rsa_mgf1_md()");
+	}
+	check(EVP_PKEY_decrypt(ctx.get(), m_output.data(), &outlen, m_input.data(), m_input.size()), "EVP_PKEY_decrypt()");
+	break;
+    }
+
+    case Algorithm::ECDSA: {
+	std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx { EVP_PKEY_CTX_new(m_pkey.get(), nullptr), EVP_PKEY_CTX_free };
+	size_t outlen = m_output.size();
+
+	check(EVP_PKEY_sign_init(ctx.get()), "EVP_PKEY_sign_init()");
+	check(EVP_PKEY_sign(ctx.get(), m_output.data(), &outlen, m_input.data(), m_input.size()), "EVP_PKEY_sign()");
+	break;
+    }
+
+    case Algorithm::ECDH: {
+	std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx { EVP_PKEY_CTX_new(m_pkey.get(), nullptr), EVP_PKEY_CTX_free };
+	size_t outlen = m_output.size();
+
+	check(EVP_PKEY_derive_init(ctx.get()), "EVP_PKEY_derive_init()");
+	check(EVP_PKEY_derive_set_peer(ctx.get(), m_peer.get()), "EVP_PKEY_derive_set_peer()");
+	check(EVP_PKEY_derive(ctx.get(), m_output.data(), &outlen), "EVP_PKEY_derive()");
+	break;
+    }
+
+    case Algorithm::DES3ECB:
+	cipher(m_secret.size()==16 ? EVP_des_ede_ecb() : EVP_des_ede3_ecb());
+	break;
+
+    case Algorithm::DES3CBC:
+	cipher(m_secret.size()==16 ? EVP_des_ede_cbc() : EVP_des_ede3_cbc());
+	break;
+
+    case Algorithm::AESECB:
+	cipher(m_secret.size()==16 ? EVP_aes_128_ecb() : m_secret.size()==24 ? EVP_aes_192_ecb() : EVP_aes_256_ecb());
+	break;
+
+    case Algorithm::AESCBC:
+	cipher(m_secret.size()==16 ? EVP_aes_128_cbc() : m_secret.size()==24 ? EVP_aes_192_cbc() : EVP_aes_256_cbc());
+	break;
+
+    case Algorithm::AESGCM:
+	cipher(m_secret.size()==16 ? EVP_aes_128_gcm() : m_secret.size()==24 ? EVP_aes_192_gcm() : EVP_aes_256_gcm());
+	break;
+    }
+}
@@ -0,0 +1,76 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// swbaseline: software (OpenSSL libcrypto) equivalent of PKCS#11 test cases,
+// to compare offloading an operation to the token against executing it on the host.
+
+#if !defined SWBASELINE_HPP
+#define SWBASELINE_HPP
+
+#include <memory>
+#include <openssl/evp.h>
+#include "p11benchmark.hpp"
+
+class SWBaselineBenchmark : public P11Benchmark
+{
+public:
+    enum class Algorithm : size_t {
+	RSASig,			// RSA PKCS#1 v1.5 with SHA256
+	RSAOAEPSHA1,		// RSA OAEP decryption, SHA1
+	RSAOAEPSHA256,		// RSA OAEP decryption, SHA256
+	ECDSA,			// ECDSA over a SHA256 digest
+	ECDH,			// ECDH key agreement
+	HMACSHA1,
+	HMACSHA256,
+	HMACSHA512,
+	DES3ECB,
+	DES3CBC,
+	AESECB,
+	AESCBC,
+	AESGCM
+    };
+
+private:
+    using evp_pkey_ptr = std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)>;
+
+    Algorithm m_algorithm;
+    evp_pkey_ptr m_pkey { nullptr, EVP_PKEY_free };	// asymmetric or HMAC key
+    evp_pkey_ptr m_peer { nullptr, EVP_PKEY_free };	// peer public key, for ECDH
+    std::vector<uint8_t> m_secret;			// symmetric key
+    std::vector<uint8_t> m_iv;
+    std::vector<uint8_t> m_input;			// digest or ciphertext, computed in prepare()
+    std::vector<uint8_t> m_output;
+
+    virtual bool requires_key() const override { return false; };
+    virtual void prepare(Session &session, Object &obj, std::optional<size_t> threadindex) override;
+    virtual void crashtestdummy(Session &session) override;
+    virtual SWBaselineBenchmark *clone() const override;
+
+    void generate_keys();
+    void cipher(const EVP_CIPHER *evp_cipher);
+
+public:
+
+    SWBaselineBenchmark(const Algorithm algorithm, const std::string &label);
+    SWBaselineBenchmark(const SWBaselineBenchmark & other);
+
+    virtual bool accepts(size_t payload) const override;
+
+};
+
+#endif // SWBASELINE_HPP
@@ -82,6 +82,30 @@ TestCoverage::TestCoverage(std::string tocover)
 	    m_algo_coverage.insert(AlgoCoverage::rand);
 	    break;
 
+	case "session"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::session);
+	    break;
+
+	case "find"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::find);
+	    break;
+
+	case "findlabel"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::findlabel);
+	    break;
+
+	case "findid"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::findid);
+	    break;
+
+	case "findclass"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::findclass);
+	    break;
+
+	case "attr"_hash:
+	    m_algo_coverage.insert(AlgoCoverage::attr);
+	    break;
+
 	case "jwe"_hash:
 	    m_algo_coverage.insert(AlgoCoverage::jwe);
 	    break;
@@ -192,6 +216,30 @@ bool TestCoverage::contains(std::string algo)
 	return contains(AlgoCoverage::rand);
 	break;
 
+    case "session"_hash:
+	return contains(AlgoCoverage::session);
+	break;
+
+    case "find"_hash:
+	return contains(AlgoCoverage::find);
+	break;
+
+    case "findlabel"_hash:
+	return contains(AlgoCoverage::findlabel);
+	break;
+
+    case "findid"_hash:
+	return contains(AlgoCoverage::findid);
+	break;
+
+    case "findclass"_hash:
+	return contains(AlgoCoverage::findclass);
+	break;
+
+    case "attr"_hash:
+	return contains(AlgoCoverage::attr);
+	break;
+
     case "jwe"_hash:
 	return contains(AlgoCoverage::jwe);
 	break;
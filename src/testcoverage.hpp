@@ -38,6 +38,12 @@ struct TestCoverage
 	aesgcm,			// AES GCM
 	xorder,			// XOR derivation
 	rand,			// Random number generation
+	session,		// Session lifecycle (open, login, logout, close)
+	find,			// Object search (all templates)
+	findlabel,		// Object search by label
+	findid,			// Object search by ID
+	findclass,		// Object search by class
+	attr,			// Attribute reads
 	jwe,			// JWE decryption (RFC7516)
 	jweoaepsha1,		// subset with OAEP(SHA1)
 	jweoaepsha256,		// subset with OAEP(SHA256)
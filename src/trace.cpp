@@ -0,0 +1,142 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.hpp"
+
+static const char trace_magic[8] = { 'P', '1', '1', 'T', 'R', 'A', 'C', 'E' };
+
+static std::runtime_error trace_error(const std::string &what, const std::string &path)
+{
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+TraceWriter::TraceWriter(const std::string &path, size_t capacity) : m_capacity(capacity)
+{
+    size_t mapsize = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(m_fd<0) {
+	throw trace_error("cannot create", path);
+    }
+
+    if(ftruncate(m_fd, mapsize)<0) {
+	close(m_fd);
+	throw trace_error("cannot size", path);
+    }
+
+    void *map = mmap(nullptr, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(map==MAP_FAILED) {
+	close(m_fd);
+	throw trace_error("cannot map", path);
+    }
+
+    m_header = static_cast<TraceHeader *>(map);
+    m_records = reinterpret_cast<TraceRecord *>(m_header + 1);
+
+    std::memcpy(m_header->magic, trace_magic, sizeof trace_magic);
+    m_header->version = trace_version;
+    m_header->record_size = sizeof(TraceRecord);
+    m_header->count = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    m_header->started = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+TraceWriter::~TraceWriter()
+{
+    flush();
+
+    auto count = m_header->count;
+    munmap(m_header, sizeof(TraceHeader) + m_capacity * sizeof(TraceRecord));
+    // give back unused room
+    if(ftruncate(m_fd, sizeof(TraceHeader) + count * sizeof(TraceRecord))<0) {
+	// nothing we can do, the header tells how many records are valid
+    }
+    close(m_fd);
+}
+
+void TraceWriter::append(const TraceRecord &record)
+{
+    auto slot = m_next.fetch_add(1, std::memory_order_relaxed);
+    if(slot >= m_capacity) {
+	m_dropped.fetch_add(1, std::memory_order_relaxed);
+	return;
+    }
+    m_records[slot] = record;
+}
+
+void TraceWriter::flush()
+{
+    auto next = m_next.load(std::memory_order_relaxed);
+    m_header->count = next < m_capacity ? next : m_capacity;
+    msync(m_header, sizeof(TraceHeader), MS_ASYNC);
+}
+
+TraceReader::TraceReader(const std::string &path)
+{
+    m_fd = open(path.c_str(), O_RDONLY);
+    if(m_fd<0) {
+	throw trace_error("cannot open", path);
+    }
+
+    struct stat st;
+    if(fstat(m_fd, &st)<0 || static_cast<size_t>(st.st_size) < sizeof(TraceHeader)) {
+	close(m_fd);
+	throw std::runtime_error(path + " is not a trace file");
+    }
+
+    m_mapsize = st.st_size;
+    m_map = mmap(nullptr, m_mapsize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if(m_map==MAP_FAILED) {
+	close(m_fd);
+	throw trace_error("cannot map", path);
+    }
+
+    m_header = static_cast<const TraceHeader *>(m_map);
+    m_records = reinterpret_cast<const TraceRecord *>(m_header + 1);
+
+    if(std::memcmp(m_header->magic, trace_magic, sizeof trace_magic)!=0
+       || m_header->version!=trace_version
+       || m_header->record_size!=sizeof(TraceRecord)) {
+	munmap(m_map, m_mapsize);
+	close(m_fd);
+	throw std::runtime_error(path + " is not a trace file, or has an unsupported version");
+    }
+
+    // a trace still being written may have more room than records
+    m_count = (m_mapsize - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    if(m_header->count < m_count) {
+	m_count = m_header->count;
+    }
+
+    madvise(m_map, m_mapsize, MADV_SEQUENTIAL);
+}
+
+TraceReader::~TraceReader()
+{
+    munmap(m_map, m_mapsize);
+    close(m_fd);
+}
@@ -0,0 +1,108 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// trace.hpp: a compact binary format, to record PKCS#11 workloads and replay them
+//
+// A trace file is made of a header, followed by fixed-size records, in native byte order.
+// Files are memory-mapped, both when writing and when reading. Records are appended
+// without locking: each writer claims a slot with an atomic increment.
+
+#if !defined(TRACE_H)
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "../config.h"
+
+struct TraceHeader {
+    char magic[8];		// "P11TRACE"
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;		// number of records
+    uint64_t started;		// start of trace, in ns since the epoch (wall clock)
+};
+
+struct TraceRecord {
+    uint64_t timestamp;		// arrival of the call, in ns since start of trace
+    uint32_t latency;		// in ns, saturated
+    uint32_t mechanism;		// CKM_xxx, or trace_no_mechanism
+    uint32_t payload;		// size of input data, in bytes
+    uint32_t thread;		// calling thread, numbered in order of appearance
+    uint16_t keybits;		// size of the key, in bits (0 if unknown)
+    uint8_t function;		// position of the function in CK_FUNCTION_LIST
+    uint8_t keyclass;		// CKO_xxx, or trace_unknown
+    uint8_t keytype;		// CKK_xxx, or trace_unknown
+    uint8_t flags;		// see trace_flag_xxx
+    uint16_t reserved;
+};
+
+static_assert(sizeof(TraceHeader)==32, "unexpected TraceHeader size");
+static_assert(sizeof(TraceRecord)==32, "unexpected TraceRecord size");
+
+constexpr uint32_t trace_version = 1;
+constexpr uint32_t trace_no_mechanism = 0xffffffff;
+constexpr uint8_t trace_unknown = 0xff;
+constexpr uint8_t trace_flag_error = 0x01; // the call did not return CKR_OK
+
+// TraceWriter: the file is created with room for capacity records, and truncated to its
+// actual content when the writer is destroyed. Records beyond capacity are dropped.
+class TraceWriter
+{
+    int m_fd { -1 };
+    TraceHeader *m_header { nullptr };
+    TraceRecord *m_records { nullptr };
+    size_t m_capacity;
+    std::atomic<uint64_t> m_next { 0 };
+    std::atomic<uint64_t> m_dropped { 0 };
+
+public:
+    TraceWriter(const std::string &path, size_t capacity); // throws std::runtime_error
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter& operator=(const TraceWriter &) = delete;
+    ~TraceWriter();
+
+    void append(const TraceRecord &record);
+    void flush();		// update the header, so that the file can be read while being written
+    inline uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+};
+
+// TraceReader: read-only mapping of a trace file
+class TraceReader
+{
+    int m_fd { -1 };
+    void *m_map { nullptr };
+    size_t m_mapsize { 0 };
+    const TraceHeader *m_header { nullptr };
+    const TraceRecord *m_records { nullptr };
+    size_t m_count { 0 };
+
+public:
+    TraceReader(const std::string &path); // throws std::runtime_error
+    TraceReader(const TraceReader &) = delete;
+    TraceReader& operator=(const TraceReader &) = delete;
+    ~TraceReader();
+
+    inline size_t size() const { return m_count; }
+    inline const TraceRecord *begin() const { return m_records; }
+    inline const TraceRecord *end() const { return m_records + m_count; }
+    inline const TraceRecord &operator[](size_t i) const { return m_records[i]; }
+    inline uint64_t started() const { return m_header->started; }
+};
+
+#endif // TRACE_H
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Copyright (c) 2018 Mastercard
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# mockrun.sh: run p11perftest against the mock PKCS#11 module, and check the results it produces:
+# statistics and percentiles, calibration, comparison against a baseline, and checkpoint resume.
+
+set -e
+
+srcdir=${srcdir:-.}
+top_builddir=${top_builddir:-..}
+p11perftest=$top_builddir/src/p11perftest
+p11mock=$top_builddir/src/.libs/p11mock.so
+
+if [ ! -x "$p11perftest" ] || [ ! -f "$p11mock" ]; then
+    echo "p11perftest or p11mock.so not built, skipping"
+    exit 77
+fi
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+P11MOCK_CONFIG=$srcdir/mock.json
+export P11MOCK_CONFIG
+
+run() {
+    "$p11perftest" -l "$p11mock" -s 0 -p mock -c aesecb,hmac -k aes128,hmac256 -v 16,64 -i 200 "$@" >>"$workdir/p11perftest.log" 2>&1
+}
+
+fail() {
+    echo "FAILED: $*"
+    cat "$workdir/p11perftest.log"
+    exit 1
+}
+
+# check_results FILE FIELD...: every measured vector of FILE has all the fields, given as dotted paths
+check_results() {
+    file=$1
+    shift
+    python3 - "$file" "$@" <<'EOF'
+import json, sys
+
+with open(sys.argv[1]) as f:
+    results = json.load(f)
+results.pop('preflight', None)
+
+def lookup(node, path):
+    for part in path.split('.'):
+        if not isinstance(node, dict) or part not in node:
+            return None
+        node = node[part]
+    return node
+
+vectors = 0
+for testcase, labels in results.items():
+    if testcase.startswith('Calibration'):
+        continue                # the null operation is not reported against itself
+    for label, vecs in labels.items():
+        for vector, fields in vecs.items():
+            if fields.get('errorcode') != 'CKR_OK':
+                sys.exit(f'{testcase} using {label}, {vector}: {fields.get("errorcode")}')
+            for path in sys.argv[2:]:
+                if lookup(fields, path) is None:
+                    sys.exit(f'{testcase} using {label}, {vector}: no {path}')
+            vectors += 1
+
+if vectors == 0:
+    sys.exit('no measured vector')
+EOF
+}
+
+# a plain run: statistics, serial correlation, percentiles
+run -j -o "$workdir/first.json" || fail "run against the mock module"
+check_results "$workdir/first.json" latency.average.value latency.average.error latency.p50.value latency.p99.value \
+	      samples.effective tps.global.value || fail "results of a plain run"
+
+# calibration: the dispatch overhead is reported next to results, with its distribution
+run --calibrate -j -o "$workdir/calibrated.json" || fail "run with calibration"
+check_results "$workdir/calibrated.json" dispatch.average.value dispatch.p50.value dispatch.p99.value || fail "results of a calibrated run"
+
+# comparison against the first run: a verdict for every vector. the threshold is large, so that a noisy host does not fail
+run --compare "$workdir/first.json" --threshold 1000 -j -o "$workdir/compared.json" || fail "run compared against a baseline"
+check_results "$workdir/compared.json" regression.latency.average.verdict regression.latency.average.pvalue || fail "results of a comparison"
+
+# checkpoint: a campaign is resumed with the same options only
+run --checkpoint "$workdir/campaign.json" || fail "run with a checkpoint"
+run --checkpoint "$workdir/campaign.json" --resume -j -o "$workdir/resumed.json" || fail "resume of a completed campaign"
+check_results "$workdir/resumed.json" latency.average.value || fail "results of a resumed campaign"
+if run --checkpoint "$workdir/campaign.json" --resume --keep-going; then
+    fail "resume with different options"
+fi
+
+exit 0
@@ -0,0 +1,362 @@
+// -*- mode: c++; c-file-style:"stroustrup"; -*-
+
+//
+// Copyright (c) 2018 Mastercard
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// unittests.cpp: checks of the statistics, regression, trace and checkpoint code, which do not need a token.
+// each test case counts the checks that failed; the program fails when any check fails.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <forward_list>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <boost/property_tree/json_parser.hpp>
+#include "../src/statistics.hpp"
+#include "../src/histogram.hpp"
+#include "../src/regression.hpp"
+#include "../src/trace.hpp"
+#include "../src/checkpoint.hpp"
+
+namespace {
+
+    int failures = 0;
+
+    void check(bool condition, const std::string &what)
+    {
+	if(!condition) {
+	    std::cerr << "  FAILED: " << what << '\n';
+	    failures++;
+	}
+    }
+
+    bool near(double a, double b, double tolerance)
+    {
+	return std::fabs(a - b) <= tolerance;
+    }
+
+    // a scratch file, removed when going out of scope
+    struct TempFile {
+	std::string path;
+	TempFile(const std::string &name) : path(std::string(std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp")
+						 + "/p11perftest-" + std::to_string(getpid()) + '-' + name) {
+	    std::remove(path.c_str());
+	}
+	~TempFile() { std::remove(path.c_str()); }
+    };
+
+
+    // Welford's algorithm, and Chan's pairwise merge, against the two-pass formulas
+    void running_stats()
+    {
+	std::vector<double> values;
+	for(int i=0; i<1000; i++) {
+	    values.push_back(1e6 + (i * 7919) % 1000 / 10.0); // large offset, to catch cancellation
+	}
+
+	double mean = 0.0;
+	for(auto v: values) mean += v;
+	mean /= values.size();
+	double variance = 0.0;
+	for(auto v: values) variance += (v - mean) * (v - mean);
+	variance /= values.size() - 1;
+
+	RunningStats all, first, second, empty;
+	for(size_t i=0; i<values.size(); i++) {
+	    all.add(values[i]);
+	    (i<300 ? first : second).add(values[i]);
+	}
+
+	check(all.count()==values.size(), "count");
+	check(near(all.mean(), mean, 1e-6), "mean");
+	check(near(all.variance(), variance, 1e-6 * variance), "variance");
+
+	first.merge(second);
+	first.merge(empty);
+	check(first.count()==all.count(), "merged count");
+	check(near(first.mean(), mean, 1e-6), "merged mean");
+	check(near(first.variance(), variance, 1e-6 * variance), "merged variance");
+	check(first.min()==all.min() && first.max()==all.max(), "merged min and max");
+
+	empty.merge(all);
+	check(empty.count()==all.count() && empty.mean()==all.mean(), "merge into an empty accumulator");
+    }
+
+
+    // batch means and lag-1 products
+    void serial_accumulator()
+    {
+	SerialAccumulator alternating(2), constant(10);
+
+	for(int i=0; i<100; i++) {
+	    alternating.add(i%2 ? 110.0 : 90.0);
+	    constant.add(5.0);
+	}
+
+	// each batch holds one low and one high value
+	check(alternating.batch_means().count()==50, "number of batches");
+	check(near(alternating.batch_means().mean(), 100.0, 1e-9), "mean of batch means");
+	check(near(alternating.batch_means().variance(), 0.0, 1e-9), "variance of batch means");
+
+	// consecutive values are anti-correlated: (-10)(+10) for each of the 99 pairs
+	check(near(alternating.lag1_numerator(100.0), -99 * 100.0, 1e-6), "lag-1 numerator");
+	check(near(constant.lag1_numerator(5.0), 0.0, 1e-9), "lag-1 numerator of a constant sequence");
+    }
+
+
+    // percentiles are known within half of a bucket width, and merging histograms is exact
+    void histogram()
+    {
+	Histogram h, odd, even;
+
+	for(uint64_t v=1; v<=100000; v++) {
+	    h.record(v);
+	    (v%2 ? odd : even).record(v);
+	}
+
+	for(auto q: { 0.50, 0.95, 0.99 }) {
+	    double expected = q * 100000;
+	    check(std::fabs(static_cast<double>(h.quantile(q)) - expected) <= h.quantile_error(q),
+		  "quantile " + std::to_string(q) + " within its error");
+	}
+
+	check(h.quantile(0.0)==1 && h.quantile(1.0)==100000, "extreme quantiles clamped to min and max");
+	check(near(h.mean(), 50000.5, 1e-9), "mean");
+
+	odd.add(even);
+	check(odd.count()==h.count() && odd.sum()==h.sum(), "merged count and sum");
+	for(size_t i=0; i<Histogram::buckets; i++) {
+	    if(odd.bucket(i)!=h.bucket(i)) {
+		check(false, "merged bucket " + std::to_string(i));
+		break;
+	    }
+	}
+
+	Histogram none;
+	check(none.quantile(0.5)==0, "quantile of an empty histogram");
+    }
+
+
+    ptree vector_result(double latency, double error, size_t iterations, std::optional<size_t> effective = std::nullopt)
+    {
+	ptree vector;
+	vector.put("threads", 1);
+	vector.put("total iterations", iterations);
+	vector.put("latency.average.value", latency);
+	vector.put("latency.average.error", error);
+	if(effective) {
+	    vector.put("samples.effective", *effective);
+	}
+	return vector;
+    }
+
+    ptree results_of(const ptree &vector)
+    {
+	ptree results;
+	results.put_child(ptree::path_type("AES Encryption (CKM_AES_ECB)|aes-128|testvec0016", '|'), vector);
+	return results;
+    }
+
+    std::optional<Regression::Outcome> compare(const ptree &before, const ptree &after)
+    {
+	TempFile baseline("baseline.json");
+	write_json(baseline.path, results_of(before));
+
+	Regression regression(baseline.path, 0.05);
+	auto results = results_of(after);
+	auto outcomes = regression.compare(results);
+	if(outcomes.size()!=1) {
+	    return std::nullopt;
+	}
+	return outcomes.front();
+    }
+
+
+    // Welch's t-test, and the use of the effective sample size for degrees of freedom
+    void regression()
+    {
+	// identical results
+	auto same = compare(vector_result(1.0, 0.02, 1000), vector_result(1.0, 0.02, 1000));
+	check(same && same->verdict==Regression::Verdict::unchanged && near(same->pvalue, 1.0, 1e-9), "identical results are unchanged");
+
+	// twice slower, with a small error
+	auto slower = compare(vector_result(1.0, 0.02, 1000), vector_result(2.0, 0.02, 1000));
+	check(slower && slower->verdict==Regression::Verdict::regressed && near(slower->delta, 1.0, 1e-9), "twice slower is a regression");
+
+	auto faster = compare(vector_result(2.0, 0.02, 1000), vector_result(1.0, 0.02, 1000));
+	check(faster && faster->verdict==Regression::Verdict::improved, "twice faster is an improvement");
+
+	// errors are given with k=2: standard errors of 1, and a difference of 2.5 standard errors of the difference
+	auto diff = 2.5 * std::sqrt(2.0);
+	auto many = compare(vector_result(100.0, 2.0, 10000), vector_result(100.0 + diff, 2.0, 10000));
+	check(many && many->verdict==Regression::Verdict::within && many->pvalue < 0.05, "significant with many samples");
+
+	// the same difference, with 3 effective samples (4 degrees of freedom), is not significant
+	auto few = compare(vector_result(100.0, 2.0, 10000, 3), vector_result(100.0 + diff, 2.0, 10000, 3));
+	check(few && few->verdict==Regression::Verdict::unchanged && few->pvalue > 0.05, "not significant with few effective samples");
+
+	// results are annotated
+	TempFile baseline("annotated.json");
+	write_json(baseline.path, results_of(vector_result(1.0, 0.02, 1000)));
+	Regression annotating(baseline.path, 0.05);
+	auto results = results_of(vector_result(2.0, 0.02, 1000));
+	annotating.compare(results);
+	auto verdict = results.get_optional<std::string>(ptree::path_type("AES Encryption (CKM_AES_ECB)|aes-128|testvec0016|regression|latency|average|verdict", '|'));
+	check(verdict && *verdict==Regression::verdict(Regression::Verdict::regressed), "verdict added to results");
+    }
+
+
+    // records written are read back as they were
+    void trace()
+    {
+	TempFile file("trace.bin");
+	const size_t count = 1000;
+
+	{
+	    TraceWriter writer(file.path, count);
+	    for(size_t i=0; i<count; i++) {
+		TraceRecord record {};
+		record.timestamp = i * 1000;
+		record.latency = static_cast<uint32_t>(i);
+		record.mechanism = i%2 ? 0x1081 : trace_no_mechanism; // CKM_AES_ECB
+		record.payload = static_cast<uint32_t>(i%64);
+		record.thread = static_cast<uint32_t>(i%4);
+		record.keybits = 128;
+		record.function = static_cast<uint8_t>(i%68);
+		record.flags = i%10 ? 0 : trace_flag_error;
+		writer.append(record);
+	    }
+	    // beyond capacity, records are dropped
+	    writer.append(TraceRecord {});
+	    check(writer.dropped()==1, "records beyond capacity are dropped");
+	}
+
+	TraceReader reader(file.path);
+	check(reader.size()==count, "number of records");
+
+	bool same = true;
+	for(size_t i=0; i<reader.size(); i++) {
+	    auto &record = reader[i];
+	    same = same && record.timestamp==i * 1000 && record.latency==i
+		&& record.mechanism==(i%2 ? 0x1081 : trace_no_mechanism) && record.payload==i%64
+		&& record.thread==i%4 && record.keybits==128 && record.function==i%68
+		&& record.flags==(i%10 ? 0 : trace_flag_error);
+	}
+	check(same, "records read back");
+    }
+
+
+    ptree vector_status(const std::string &errorcode)
+    {
+	ptree tree, vector;
+	vector.put("errorcode", errorcode);
+	tree.put_child(ptree::path_type("aes-128|testvec0016", '|'), vector);
+	return tree;
+    }
+
+
+    // a campaign is resumed only with the same parameters, and completed vectors are skipped
+    void checkpoint()
+    {
+	TempFile file("checkpoint.json");
+	ptree parameters;
+	parameters.put("threads", 1);
+	parameters.put("keep-going", false);
+
+	std::forward_list<std::string> vectors { "testvec0016", "testvec0064" };
+	std::forward_list<std::tuple<std::string, std::string, std::forward_list<std::string> > > cases {
+	    { "AES Encryption (CKM_AES_ECB) using aes-128", "aes-128", vectors },
+	    { "HMAC SHA256 (CKM_SHA256_HMAC) using hmac-256", "hmac-256", vectors } };
+
+	{
+	    Checkpoint cp(file.path, parameters, false);
+	    cp.plan(cases);
+	    cp.complete("AES Encryption (CKM_AES_ECB) using aes-128", vector_status("CKR_OK"));
+	    cp.complete("HMAC SHA256 (CKM_SHA256_HMAC) using hmac-256", vector_status("CKR_DEVICE_ERROR"));
+	}
+
+	bool refused = false;
+	try {
+	    Checkpoint again(file.path, parameters, false);
+	} catch(std::runtime_error &) {
+	    refused = true;
+	}
+	check(refused, "an existing checkpoint is not overwritten");
+
+	refused = false;
+	auto other { parameters };
+	other.put("keep-going", true);
+	try {
+	    Checkpoint different(file.path, other, true);
+	} catch(std::runtime_error &) {
+	    refused = true;
+	}
+	check(refused, "a campaign is not resumed with different parameters");
+
+	Checkpoint resumed(file.path, parameters, true);
+	resumed.plan(cases);	// planning again does not reset progress
+	check(resumed.completed("AES Encryption (CKM_AES_ECB) using aes-128", "testvec0016"), "successful vector is done");
+	check(!resumed.completed("AES Encryption (CKM_AES_ECB) using aes-128", "testvec0064"), "vector not run is pending");
+	check(!resumed.completed("HMAC SHA256 (CKM_SHA256_HMAC) using hmac-256", "testvec0016"), "failed vector is pending");
+	check(resumed.completed_labels().empty(), "no key label is completed");
+	check(resumed.results().size()==2, "results of completed cases are kept");
+
+	resumed.complete("AES Encryption (CKM_AES_ECB) using aes-128", [] () {
+	    auto tree = vector_status("CKR_OK");
+	    tree.put(ptree::path_type("aes-128|testvec0064|errorcode", '|'), "CKR_OK");
+	    return tree;
+	}());
+	auto labels = resumed.completed_labels();
+	check(labels.size()==1 && labels.count("aes-128")==1, "key label of a completed case");
+    }
+}
+
+
+int main()
+{
+    const std::vector<std::pair<std::string, std::function<void()> > > testcases {
+	{ "running statistics", running_stats },
+	{ "serial accumulator", serial_accumulator },
+	{ "histogram", histogram },
+	{ "regression", regression },
+	{ "trace", trace },
+	{ "checkpoint", checkpoint },
+    };
+
+    int failed = 0;
+
+    for(auto &testcase: testcases) {
+	auto before = failures;
+	try {
+	    testcase.second();
+	} catch(std::exception &e) {
+	    std::cerr << "  FAILED: " << e.what() << '\n';
+	    failures++;
+	}
+	bool ok = failures==before;
+	std::cout << (ok ? "PASS: " : "FAIL: ") << testcase.first << std::endl;
+	if(!ok) {
+	    failed++;
+	}
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}